@@ -0,0 +1,168 @@
+//
+// Charger and load switching logic.
+//
+
+#include "charge_controller.h"
+#include <stdio.h> // snprintf
+
+void ChargeController::configure(const RuntimeConfig &config)
+{
+    powerThreshold = config.powerThreshold;
+    deadband = config.switchDeadband;
+    holdTime = config.hysteresisTime * 1000UL;
+    int32_t onThreshold = effectiveThreshold();
+    hysteresisPolicy.configure(onThreshold, holdTime);
+    ewmaPolicy.configure(onThreshold, onThreshold - deadband, holdTime,
+                         config.ewmaTimeConstant * 1000UL, config.trendHorizon * 1000UL);
+    policy = config.policy == POLICY_EWMA ? (SwitchPolicy *)&ewmaPolicy : &hysteresisPolicy;
+}
+
+void ChargeController::setThresholdBias(int32_t thresholdBias)
+{
+    bias = thresholdBias;
+    int32_t onThreshold = effectiveThreshold();
+    hysteresisPolicy.setThreshold(onThreshold);
+    ewmaPolicy.setThresholds(onThreshold, onThreshold - deadband);
+}
+
+int ChargeController::addLoad(const LoadChannelConfig &load)
+{
+    return scheduler.addChannel(load.power, load.priority, load.threshold, load.hysteresisTime);
+}
+
+void ChargeController::restoreCharger(bool on, uint32_t timestamp)
+{
+    charger = on;
+    lastSwitch = timestamp;
+}
+
+void ChargeController::setCharger(bool on, uint32_t timestamp)
+{
+    hal.setRelay(0, on, timestamp);
+    charger = on;
+    lastSwitch = timestamp;
+
+    // The loads wait their hold time again on samples that include the step.
+    scheduler.restart(timestamp);
+}
+
+void ChargeController::setLoad(uint8_t channel, bool on, uint32_t timestamp)
+{
+    hal.setRelay(channel + 1, on, timestamp);
+    scheduler.setState(channel, on, timestamp);
+}
+
+bool ChargeController::update(int32_t power, uint32_t timestamp)
+{
+    // The policy switches once its condition has been met for the hysteresis time.
+    bool wantOn = policy->update(power, timestamp, charger);
+    if (wantOn != charger)
+    {
+        setCharger(wantOn, timestamp);
+        return true; // The sample predates the switch: the loads wait for the next one.
+    }
+    return scheduleLoads(timestamp);
+}
+
+bool ChargeController::expire(uint32_t timestamp)
+{
+    if (policy->expire(timestamp))
+    {
+        setCharger(!charger, timestamp);
+        return true;
+    }
+    // Feeding the last decision power again switches the load whose time is up.
+    if (scheduler.switchPending() && scheduler.remainingTime(timestamp) == 0)
+    {
+        return scheduleLoads(timestamp);
+    }
+    return false;
+}
+
+uint32_t ChargeController::remainingTime(uint32_t currentTime) const
+{
+    uint32_t remaining = policy->switchPending() ? policy->remainingTime(currentTime) : UINT32_MAX;
+    if (scheduler.switchPending())
+    {
+        uint32_t loadRemaining = scheduler.remainingTime(currentTime);
+        remaining = loadRemaining < remaining ? loadRemaining : remaining;
+    }
+    return remaining == UINT32_MAX ? 0 : remaining;
+}
+
+//
+// Allocates the surplus left by the charger over the additional loads.
+//
+bool ChargeController::scheduleLoads(uint32_t timestamp)
+{
+    if (scheduler.count() == 0)
+    {
+        return false;
+    }
+
+    // The charger has the highest priority: the surplus it needs to stay on
+    // is kept free, and while it is off its draw as well.
+    int32_t surplus = policy->decisionPower() - effectiveThreshold();
+    if (!charger)
+    {
+        surplus -= chargerPower;
+    }
+
+    int channel = scheduler.update(surplus, timestamp);
+    if (channel < 0)
+    {
+        return false;
+    }
+    setLoad(channel, !scheduler.isOn(channel), timestamp);
+    return true;
+}
+
+void ChargeController::switchAllOff()
+{
+    uint32_t now = hal.millis();
+    if (charger)
+    {
+        setCharger(false, now);
+    }
+    policy->reset(); // Drop a pending switch decided on the old samples.
+    for (uint8_t i = 0; i < scheduler.count(); i++)
+    {
+        if (scheduler.isOn(i))
+        {
+            setLoad(i, false, now);
+        }
+    }
+    scheduler.reset();
+}
+
+uint16_t ChargeController::relayStates() const
+{
+    uint16_t states = charger ? 1 : 0;
+    for (uint8_t i = 0; i < scheduler.count(); i++)
+    {
+        states |= scheduler.isOn(i) ? 2 << i : 0;
+    }
+    return states;
+}
+
+void ChargeController::formatDisplayLine(uint8_t row, int32_t power, char *buffer, size_t size)
+{
+    // Row 0: Power and Charger status
+    if (row == 0)
+    {
+        snprintf(buffer, size, "P:%dW     C:%s", (int)power, charger ? "On" : "Off");
+        return;
+    }
+
+    // Row 1: Display countdown or Hysteresis and Threshold
+    bool showCountdown = charger && policy->switchPending();
+    unsigned long remainingTime = (policy->remainingTime(hal.millis()) + 999) / 1000; // Whole seconds left
+    if (showCountdown && remainingTime > 0)
+    {
+        snprintf(buffer, size, "Off in: %lus", remainingTime);
+    }
+    else
+    {
+        snprintf(buffer, size, "H:%lus   T:%dW", (unsigned long)(holdTime / 1000), (int)effectiveThreshold());
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "config.h"         // LoadChannelConfig
+#include "hal.h"            // Clock and relay outputs
+#include "load_scheduler.h" // Surplus allocation over additional loads
+#include "runtime_config.h" // Thresholds and policy settings
+#include "switch_policy.h"  // Charger switching policies
+#include <stddef.h>         // size_t
+
+//
+// The switching logic of the controller, free of Arduino dependencies.
+//
+// Every sample is passed to update(), which runs the charger policy and the
+// load scheduler and switches relays through the Hal. Rendering the LCD
+// rows is part of the core as well, so the firmware and the host-side
+// replay harness show and decide exactly the same things.
+//
+class ChargeController
+{
+public:
+    explicit ChargeController(Hal &hal) : hal(hal) {}
+
+    // Selects and configures the switching policy. Restarts pending switches.
+    void configure(const RuntimeConfig &config);
+
+    // Adds a load channel. Returns its index, or -1 if the table is full.
+    int addLoad(const LoadChannelConfig &load);
+
+    // Sets the power draw (W) of the charger, kept free for it while it is off.
+    void setChargerPower(uint16_t power) { chargerPower = power; }
+
+    // Shifts the switching thresholds by `bias` (W), e.g. from the charge
+    // plan, without restarting pending switches.
+    void setThresholdBias(int32_t bias);
+
+    // Takes over the charger state restored at boot, without switching.
+    void restoreCharger(bool on, uint32_t timestamp);
+
+    // Acts on a surplus sample of `power` (W) taken at `timestamp` (ms).
+    // Returns true if a relay was switched.
+    bool update(int32_t power, uint32_t timestamp);
+
+    // Carries out the switches whose hysteresis time has run out by `timestamp`,
+    // based on the last sample. Returns true if a relay was switched.
+    bool expire(uint32_t timestamp);
+
+    // Switches the charger and all loads off and drops pending switches, e.g.
+    // when measurements stopped.
+    void switchAllOff();
+
+    // Renders LCD row `row` for the current state, `power` being the last sample.
+    void formatDisplayLine(uint8_t row, int32_t power, char *buffer, size_t size);
+
+    bool chargerOn() const { return charger; }
+    uint32_t lastSwitchTime() const { return lastSwitch; }
+    int32_t threshold() const { return powerThreshold; }
+    int32_t thresholdBias() const { return bias; }
+    int32_t effectiveThreshold() const { return powerThreshold + bias; } // Switch-on threshold with the bias
+    uint32_t hysteresisTime() const { return holdTime; }
+
+    // True while the charger or a load waits out its hysteresis time.
+    bool switchPending() const { return policy->switchPending() || scheduler.switchPending(); }
+
+    // Time (ms) until the next pending switch is due, 0 if none is pending.
+    uint32_t remainingTime(uint32_t currentTime) const;
+
+    // Relay states as a bitmask: bit 0 the charger, bit 1 + i load channel i.
+    uint16_t relayStates() const;
+
+    SwitchPolicy &switchPolicy() { return *policy; }
+    const SwitchPolicy &switchPolicy() const { return *policy; }
+    const LoadScheduler &loads() const { return scheduler; }
+
+private:
+    void setCharger(bool on, uint32_t timestamp);
+    void setLoad(uint8_t channel, bool on, uint32_t timestamp);
+    bool scheduleLoads(uint32_t timestamp);
+
+    Hal &hal;
+    HysteresisPolicy hysteresisPolicy;
+    EwmaPolicy ewmaPolicy;
+    SwitchPolicy *policy = &hysteresisPolicy;
+    LoadScheduler scheduler;
+
+    int32_t powerThreshold = 1000; // Switch-on threshold in W
+    int32_t deadband = 0;          // Deadband below the threshold in W (EWMA policy)
+    int32_t bias = 0;              // Threshold shift in W
+    uint16_t chargerPower = 0;     // Power draw of the charger in W
+    uint32_t holdTime = 120000;    // Hysteresis time in ms
+    bool charger = false;          // Current state of the charger
+    uint32_t lastSwitch = 0;       // Timestamp of the last charger switch
+};
@@ -0,0 +1,72 @@
+//
+// Forecast-based charge plan.
+//
+
+#include "charge_plan.h"
+
+uint16_t dayNumber(int year, int month, int day)
+{
+    // Counted from 1 March so the leap day is the last day of the year.
+    year -= month <= 2 ? 1 : 0;
+    int era = year / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return (uint16_t)(era * 146097 + dayOfEra - 719468);
+}
+
+void ChargePlan::build(const SolarForecast &forecast, int32_t threshold, uint32_t chargerPower, uint32_t targetEnergy,
+                       uint32_t baseLoad, int32_t maxBias)
+{
+    // Forecast surplus per hour; in Wh per hour, i.e. the mean power in W.
+    int32_t surplus[24];
+    for (uint8_t hour = 0; hour < 24; hour++)
+    {
+        surplus[hour] = (int32_t)forecast.energy[hour] - (int32_t)baseLoad;
+    }
+
+    // Plan the best hours until the charger has enough time for its target.
+    uint32_t hoursNeeded = chargerPower > 0 ? (targetEnergy + chargerPower - 1) / chargerPower : 0;
+    plannedMask = 0;
+    energy = 0;
+    for (uint32_t i = 0; i < hoursNeeded && i < 24; i++)
+    {
+        int best = -1;
+        for (uint8_t hour = 0; hour < 24; hour++)
+        {
+            if ((plannedMask & (1UL << hour)) == 0 && surplus[hour] > 0 && (best < 0 || surplus[hour] > surplus[best]))
+            {
+                best = hour;
+            }
+        }
+        if (best < 0)
+        {
+            break; // No more hours with a surplus.
+        }
+        plannedMask |= 1UL << best;
+        energy += (uint32_t)surplus[best];
+    }
+
+    for (uint8_t hour = 0; hour < 24; hour++)
+    {
+        int32_t bias = 0;
+        if ((plannedMask & (1UL << hour)) != 0 && surplus[hour] < threshold)
+        {
+            bias = surplus[hour] - threshold;
+            bias = bias < -maxBias ? -maxBias : bias;
+        }
+        biases[hour] = (int16_t)bias;
+    }
+    planDay = forecast.day;
+    valid = true;
+}
+
+uint8_t ChargePlan::plannedHours() const
+{
+    uint8_t hours = 0;
+    for (uint32_t mask = plannedMask; mask != 0; mask &= mask - 1)
+    {
+        hours++;
+    }
+    return hours;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Hourly PV forecast for one day, as fetched once a day and kept in NVS.
+//
+struct SolarForecast
+{
+    uint8_t version;     // Layout version, SOLAR_FORECAST_VERSION
+    uint8_t reserved;    // Keeps the record free of implicit padding
+    uint16_t day;        // Local date, as returned by dayNumber()
+    uint16_t energy[24]; // Forecast PV energy (Wh) in each local hour
+};
+
+static_assert(sizeof(SolarForecast) == 52, "SolarForecast layout changed, bump SOLAR_FORECAST_VERSION");
+
+const uint8_t SOLAR_FORECAST_VERSION = 1;
+
+// Days since 1970-01-01 of a date in the Gregorian calendar (month 1..12).
+uint16_t dayNumber(int year, int month, int day);
+
+//
+// Charge plan for one day, precomputed from the forecast.
+//
+// The charger needs targetEnergy / chargerPower hours of charging. The hours
+// with the highest forecast surplus (PV minus the base load) are planned for
+// it. In a planned hour whose forecast surplus stays below the switch-on
+// threshold, the reactive controller would rarely switch on although it is
+// one of the best hours of the day, so the thresholds are lowered towards
+// the forecast surplus, by at most maxBias. On a sunny day the planned
+// hours reach the threshold and nothing changes; on a partly cloudy day the
+// charger uses the best hours instead of waiting for peaks that will not
+// come. Outside the plan the thresholds are left as they are.
+//
+// bias() is a table lookup, so applying the plan costs nothing per sample.
+//
+class ChargePlan
+{
+public:
+    void build(const SolarForecast &forecast, int32_t threshold, uint32_t chargerPower, uint32_t targetEnergy,
+               uint32_t baseLoad, int32_t maxBias);
+
+    // Forgets the plan, e.g. at the end of its day.
+    void clear() { valid = false; }
+
+    // True if the plan is for local date `day`.
+    bool covers(uint16_t day) const { return valid && planDay == day; }
+
+    // Threshold bias (W, zero or negative) for local hour `hour` (0..23).
+    int32_t bias(uint8_t hour) const { return valid && hour < 24 ? biases[hour] : 0; }
+
+    bool planned(uint8_t hour) const { return valid && hour < 24 && (plannedMask & (1UL << hour)) != 0; }
+    uint8_t plannedHours() const;
+    uint32_t plannedEnergy() const { return energy; } // Forecast surplus (Wh) in the planned hours
+
+private:
+    bool valid = false;
+    uint16_t planDay = 0;
+    uint32_t plannedMask = 0; // Bit h is set when hour h is planned
+    uint32_t energy = 0;
+    int16_t biases[24] = {};
+};
@@ -32,9 +32,384 @@ const int DIP_PIN_3 = 23;   // DIP switch for setting power threshold (500W, 100
 // Interval (in milliseconds) at which power data is fetched from the API.
 const unsigned long MEASUREMENT_INTERVAL = 10000UL; // 10 seconds
 
+// The interval adapts to how close the controller is to a switching
+// decision: fast within POLL_NEAR_BAND watts of the threshold or while a
+// switch is pending, slow beyond POLL_FAR_BAND, and idle once the power has
+// stayed that far away for POLL_IDLE_DELAY (e.g. at night).
+const unsigned long MEASUREMENT_INTERVAL_FAST = 2000UL;  // 2 seconds
+const unsigned long MEASUREMENT_INTERVAL_SLOW = 30000UL; // 30 seconds
+const unsigned long MEASUREMENT_INTERVAL_IDLE = 60000UL; // 60 seconds
+const int POLL_NEAR_BAND = 300;                          // Distance (in watts) to the threshold for fast polling
+const int POLL_FAR_BAND = 1000;                          // Distance (in watts) to the threshold for slow polling
+const unsigned long POLL_IDLE_DELAY = 1800000UL;         // Time (in milliseconds) far from the threshold before idling (30 min)
+
+// Timeout (in milliseconds) for connecting to and reading from the meter API.
+const unsigned long METER_HTTP_TIMEOUT = 2000UL; // 2 seconds
+
+// =================================================================
+// WiFi Reconnection
+// =================================================================
+// Failed connection attempts are retried with an exponential backoff from
+// WIFI_BACKOFF_MIN up to WIFI_BACKOFF_MAX.
+const unsigned long WIFI_CONNECT_TIMEOUT = 10000UL;   // Time (in milliseconds) allowed per connection attempt
+const unsigned long WIFI_BACKOFF_MIN = 1000UL;        // First retry delay (in milliseconds)
+const unsigned long WIFI_BACKOFF_MAX = 60000UL;       // Longest retry delay (in milliseconds)
+
+// =================================================================
+// Meter Sources
+// =================================================================
+// Measurements are taken from the sources in METER_SOURCES, in priority
+// order: the samples of the first source that is delivering are used, and
+// the sources below it are only polled while all sources above them are
+// stale. A polled source turns stale with a failed request or after two
+// measurement intervals without a sample, a stream after its stale timeout;
+// the primary takes over again with its first sample.
+//
+// Whatever the source, the charger and the loads are switched off when no
+// sample has arrived for the sample interval of the active source (the
+// measurement interval of a polled source, the stale timeout of a stream or
+// of shared samples) plus SAMPLE_STALE_TIMEOUT, as the surplus is then
+// unknown. The policy switches them again once samples resume.
+enum MeterSourceType
+{
+    METER_SOURCE_HTTP,   // HomeWizard P1 meter API at `apiUrl`, polled at the measurement interval
+    METER_SOURCE_PUSH,   // HomeWizard local API v2 push stream (requires `meterToken` in secrets.h)
+    METER_SOURCE_SHARED, // Samples shared by another controller (see Shared Meter Reading)
+    METER_SOURCE_MODBUS, // Grid power register of an inverter or meter over Modbus TCP
+    METER_SOURCE_CT      // Local CT clamp (see Local Current Sensor)
+};
+const MeterSourceType METER_SOURCES[] = {METER_SOURCE_HTTP}; // In priority order, e.g. {METER_SOURCE_PUSH, METER_SOURCE_HTTP, METER_SOURCE_CT}
+const int METER_SOURCE_COUNT = sizeof(METER_SOURCES) / sizeof(METER_SOURCES[0]);
+const unsigned long SAMPLE_STALE_TIMEOUT = 30000UL; // Delay (in milliseconds) past the due sample before the relays are switched off
+
+// Modbus TCP source: the grid power as a signed 16 or 32-bit register,
+// address and scale as given in the manual of the inverter or meter.
+const unsigned char MODBUS_HOST[4] = {192, 168, 1, 50}; // IP address of the device
+const int MODBUS_PORT = 502;                            // TCP port of the device
+const int MODBUS_UNIT_ID = 1;                           // Unit id (slave address) of the power register
+const int MODBUS_FUNCTION = 3;                          // 3: holding registers, 4: input registers
+const int MODBUS_POWER_REGISTER = 0;                    // Register address (0-based) of the grid power
+const int MODBUS_POWER_WORDS = 1;                       // 1: int16, 2: int32 high word first
+const long MODBUS_MILLIWATTS_PER_COUNT = 1000;          // Scale of the register
+const int MODBUS_POWER_SIGN = -1;                       // -1: import counts positive, 1: export counts positive
+const unsigned long MODBUS_TIMEOUT = 2000UL;            // Timeout (in milliseconds) for connecting and each response
+
+// =================================================================
+// Switching Policy
+// =================================================================
+enum SwitchPolicyType
+{
+    POLICY_HYSTERESIS, // Raw power against POWER_THRESHOLD, timer restarts on every crossing
+    POLICY_EWMA        // Smoothed, trend-aware power with an on/off deadband
+};
+const SwitchPolicyType SWITCH_POLICY = POLICY_EWMA;
+
+// Settings of the EWMA policy. The charger switches on at POWER_THRESHOLD
+// and off below POWER_THRESHOLD - SWITCH_DEADBAND.
+const int SWITCH_DEADBAND = 200;                  // Deadband (in watts) between on and off threshold
+const unsigned long EWMA_TIME_CONSTANT = 30000UL; // Time constant (in milliseconds) of the power filter
+const unsigned long TREND_HORIZON = 20000UL;      // Time (in milliseconds) the power trend is extrapolated
+
+// =================================================================
+// Solar Forecast
+// =================================================================
+// When enabled, the PV forecast for the day is fetched once from
+// `forecastUrl` (secrets.h) and kept in NVS, so a reboot does not fetch it
+// again. It is turned into an hourly charge plan: the hours with the best
+// forecast surplus that give the charger, drawing CHARGER_POWER,
+// FORECAST_CHARGE_TARGET get their thresholds lowered towards that surplus,
+// by up to FORECAST_MAX_BIAS, so on a partly cloudy day the charger uses
+// them instead of waiting for a peak above POWER_THRESHOLD. Hours are local
+// time per TIME_ZONE.
+const bool FORECAST_ENABLED = false;
+const unsigned long FORECAST_CHARGE_TARGET = 6000UL;    // Energy (in Wh) the charger should get per day
+const unsigned long FORECAST_BASE_LOAD = 300UL;         // Household consumption (in watts) subtracted from the PV forecast
+const int FORECAST_MAX_BIAS = 500;                      // Largest threshold reduction (in watts)
+const unsigned long FORECAST_RETRY_INTERVAL = 900000UL; // Delay (in milliseconds) before retrying a failed fetch (15 min)
+const unsigned long FORECAST_HTTP_TIMEOUT = 5000UL;     // Timeout (in milliseconds) for the forecast API
+const unsigned long FORECAST_PLAN_CHECK = 60000UL;      // Interval (in milliseconds) at which the plan hour is checked
+const char *const TIME_ZONE = "CET-1CEST,M3.5.0,M10.5.0/3"; // POSIX time zone of the site
+
+// =================================================================
+// Load Channels
+// =================================================================
+// Additional loads (boilers, heaters, more chargers) switched on relay
+// outputs besides the charger on RELAY_PIN. The surplus left over by the
+// charger is allocated greedily in priority order (lower value first); a
+// load switches on when the surplus remaining after its power draw is at
+// least its threshold, and each switch waits for its hysteresis time.
+// Only the first LOAD_CHANNEL_COUNT entries are used.
+// A load is switched on a local pin, or on an output of a relay node
+// (see Relay Nodes below) when `node` is set.
+struct LoadChannelConfig
+{
+    const char *name;             // Shown on the serial monitor
+    int pin;                      // Relay output: GPIO pin, or output index on the node
+    unsigned power;               // Nominal power draw in watts
+    unsigned priority;            // Lower values are served first
+    int threshold;                // Surplus (in watts) that must remain with the load on
+    unsigned long hysteresisTime; // Time (in milliseconds) a change must hold before switching
+    int node;                     // Index in RELAY_NODES, or -1 for a local pin
+};
+const LoadChannelConfig LOAD_CHANNELS[] = {
+    {"boiler", 32, 2000, 1, 100, 300000UL, -1}, // Example: 2 kW water heater
+    {"heater", 33, 800, 2, 100, 120000UL, -1},  // Example: 800 W space heater
+    {"garage", 0, 3700, 3, 200, 300000UL, 0},   // Example: charger on output 0 of relay node 0
+};
+const int LOAD_CHANNEL_COUNT = 0; // Number of LOAD_CHANNELS entries in use
+
+// =================================================================
+// Relay Nodes
+// =================================================================
+// Loads can be switched by remote relay nodes (firmware: the relay_node
+// environment in platformio.ini) over ESP-NOW, without a WiFi association
+// of their own. The controller keeps all switching decisions; the node
+// only applies them. Commands are repeated until acknowledged and
+// refreshed periodically; a node that hears nothing for
+// RELAY_NODE_FAILSAFE_TIMEOUT switches its outputs off. Traffic is
+// encrypted with `espnowKey` from secrets.h.
+const unsigned char RELAY_NODES[][6] = {
+    {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01}, // Example: MAC address of relay node 0
+};
+const int RELAY_NODE_COUNT = 0;                           // Number of RELAY_NODES entries in use
+const unsigned long RELAY_RETRY_INTERVAL = 100UL;         // Delay (in milliseconds) between repeats of an unacknowledged command
+const int RELAY_RETRY_LIMIT = 20;                         // Fast repeats before falling back to the refresh interval
+const unsigned long RELAY_REFRESH_INTERVAL = 2000UL;      // Interval (in milliseconds) at which the state is resent
+const unsigned long RELAY_NODE_OFFLINE_TIMEOUT = 10000UL; // Time without acknowledgement (in milliseconds) before a node counts as offline
+
+// Relay node firmware settings
+const unsigned char RELAY_CONTROLLER_MAC[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x00}; // MAC address of the controller
+const int RELAY_NODE_PINS[] = {19, 18};                    // Relay pins of the node outputs
+const unsigned long RELAY_NODE_FAILSAFE_TIMEOUT = 30000UL; // Silence (in milliseconds) after which the outputs switch off
+const unsigned long RELAY_NODE_SEARCH_TIMEOUT = 6000UL;    // Silence (in milliseconds) after which the node searches all channels
+const unsigned long RELAY_NODE_HOP_DWELL = 2500UL;         // Time (in milliseconds) spent listening on each channel while searching
+
+// =================================================================
+// Energy Accounting
+// =================================================================
+// The surplus energy that went into the charger and each load, the energy
+// exported, the switch-ons and the on-time are counted per local day from
+// the samples and the nominal draws (CHARGER_POWER, LOAD_CHANNELS power).
+// The counters are kept in NVS every ENERGY_SAVE_INTERVAL and when a day
+// ends, so a reboot loses at most that much.
+const unsigned long CHARGER_POWER = 2000UL;           // Power draw (in watts) of the charger
+const unsigned long ENERGY_MAX_GAP = 300000UL;        // Longer gaps (in milliseconds) between samples are not counted (5 min)
+const unsigned long ENERGY_SAVE_INTERVAL = 1800000UL; // Interval (in milliseconds) at which the counters are stored (30 min)
+
+// =================================================================
+// Power History
+// =================================================================
+// Recent samples are kept in RAM with rolling statistics over two windows,
+// given in number of samples (at the normal 10 s interval: 1 and 5 minutes).
+const int POWER_HISTORY_SIZE = 64;     // Number of samples kept
+const unsigned STATS_SHORT_WINDOW = 6; // Samples in the short statistics window
+const unsigned STATS_LONG_WINDOW = 30; // Samples in the long statistics window
+
+// =================================================================
+// Instrumentation
+// =================================================================
+// Interval (in milliseconds) at which the per-stage latency histograms are
+// printed to the serial monitor.
+const unsigned long PERF_REPORT_INTERVAL = 60000UL; // 60 seconds
+// The free heap is sampled on every loop() iteration; the largest free
+// block and the task stack high-water marks take a walk over the heap or
+// stack, so they are sampled at this interval (in milliseconds).
+const unsigned long MEMORY_SAMPLE_INTERVAL = 1000UL;
+
+// =================================================================
+// Meter Push Stream
+// =================================================================
+// With METER_SOURCE_PUSH, measurements are received from the WebSocket
+// stream of the HomeWizard local API v2 (requires `meterToken` in
+// secrets.h). List METER_SOURCE_HTTP after it to poll whenever the stream
+// is down.
+const unsigned long METER_PUSH_STALE_TIMEOUT = 5000UL;      // Fall back after this long without a pushed measurement
+const unsigned long METER_PUSH_RECONNECT_INTERVAL = 5000UL; // Delay (in milliseconds) between WebSocket reconnect attempts
+const unsigned long METER_PUSH_SERVICE_PERIOD = 20UL;       // Interval (in milliseconds) at which the stream is serviced
+
+// =================================================================
+// MQTT Telemetry
+// =================================================================
+// When enabled, samples, relay states and switch events are published to
+// the broker at `mqtt_server` (secrets.h). Samples are batched into one
+// message per MQTT_BATCH_SIZE samples or MQTT_BATCH_INTERVAL, whichever
+// comes first; switch events are sent right away. While the broker is
+// unreachable up to MQTT_BUFFER_SIZE records are kept and sent on reconnect,
+// the oldest being dropped when the buffer is full.
+const bool MQTT_ENABLED = false;
+enum TelemetryEncoding
+{
+    TELEMETRY_JSON,  // Human-readable JSON
+    TELEMETRY_BINARY // Compact varint/delta encoding, about a third of the JSON size
+};
+const TelemetryEncoding TELEMETRY_ENCODING = TELEMETRY_JSON;
+const int MQTT_PORT = 1883;
+const char *const MQTT_TOPIC_PREFIX = "energy-monitor";  // Topics are <prefix>/<device id>/...
+const int MQTT_BATCH_SIZE = 6;                           // Samples per message (1 minute at the normal interval)
+const unsigned long MQTT_BATCH_INTERVAL = 60000UL;       // Longest time (in milliseconds) a sample waits to be sent
+const int MQTT_BATCH_MAX = 24;                           // Most records per message, when catching up after an outage
+const int MQTT_BUFFER_SIZE = 360;                        // Records kept while the broker is unreachable
+const int MQTT_QUEUE_SIZE = 16;                          // Records queued from loop() to the meter task (power of two)
+const unsigned long MQTT_RECONNECT_INTERVAL = 5000UL;    // Delay (in milliseconds) between broker connection attempts
+const unsigned long MQTT_SERVICE_PERIOD = 1000UL;        // Longest time (in milliseconds) between MQTT client services
+
+// With MQTT_CONFIG_ENABLED the runtime configuration can be changed
+// remotely: a message of "name=value" pairs (the names of the `set`
+// console command) on <prefix>/<device>/config/set is applied and stored
+// if every pair is valid, and then the configuration is published
+// (retained) on <prefix>/<device>/config. A rejected message is answered on
+// <prefix>/<device>/config/error. Anyone allowed to publish on the broker
+// can change the thresholds, so restrict the topic with the broker's ACLs.
+const bool MQTT_CONFIG_ENABLED = false;
+const int MQTT_CONFIG_SIZE = 128; // Longest configuration message, in characters
+
+// =================================================================
+// Flash History
+// =================================================================
+// Every sample is logged with its wall-clock time to the "history" data
+// partition (partitions.csv), about ten days at the normal interval, and
+// kept across reboots. Logging starts once the clock is set over NTP.
+const char *const HISTORY_PARTITION = "history";       // Label of the data partition
+const int HISTORY_WRITE_BATCH = 16;                    // Records per flash write (one 256-byte page)
+const unsigned long HISTORY_FLUSH_INTERVAL = 600000UL; // Longest time (in milliseconds) records wait in RAM (10 min)
+const char *const NTP_SERVER = "pool.ntp.org";         // Time server for the log timestamps
+const unsigned long MIN_VALID_TIME = 1700000000UL;     // Clock values before this are treated as unset
+
+// =================================================================
+// Status Server
+// =================================================================
+// Current readings, relay states and instrumentation are served in the
+// Prometheus text format at http://<device>/metrics.
+const bool HTTP_SERVER_ENABLED = true;
+const int HTTP_SERVER_PORT = 80;
+const unsigned long HTTP_SERVER_TIMEOUT = 1000UL; // Time (in milliseconds) a client has to send its request
+const unsigned long HTTP_SEND_TIMEOUT = 5000UL;   // Time (in milliseconds) a client has to take the response
+const int HTTP_RESPONSE_SIZE = 12288;             // Size of the response buffer in bytes
+
+// =================================================================
+// Shared Meter Reading
+// =================================================================
+// With several controllers on one meter, one unit polls it and shares the
+// samples over UDP multicast; the others list METER_SOURCE_SHARED instead
+// of polling. With METER_SOURCE_HTTP after it, a subscriber falls back to
+// polling the meter itself when no shared sample has arrived for
+// METER_SHARE_STALE_TIMEOUT.
+enum MeterShareMode
+{
+    METER_SHARE_OFF,    // Share nothing
+    METER_SHARE_PUBLISH // Share every sample
+};
+const MeterShareMode METER_SHARE_MODE = METER_SHARE_OFF;
+const unsigned char METER_SHARE_GROUP[4] = {239, 255, 42, 1}; // Multicast group address
+const int METER_SHARE_PORT = 4210;                             // UDP port of the group
+const unsigned long METER_SHARE_STALE_TIMEOUT = 70000UL;       // Longer than the idle interval of the publisher
+const unsigned long METER_SHARE_SERVICE_PERIOD = 50UL;         // Interval (in milliseconds) at which the group is read
+
+// =================================================================
+// Local Current Sensor
+// =================================================================
+// With METER_SOURCE_CT the surplus is measured locally with a CT clamp on
+// CT_PIN (an ADC1 pin; burden resistor, bias at mid-supply), sampled
+// continuously by DMA, and a sample is ready every CT_REPORT_INTERVAL.
+// Listed first it replaces the meter; listed after the meter it takes over
+// whenever the meter is stale. Every sample used is logged and published,
+// so at a sub-second interval the flash history covers less time.
+//
+// A CT measures neither the direction of the current nor the voltage: the
+// power is CT_VOLTAGE * current * CT_POWER_FACTOR, counted as surplus with
+// CT_POWER_SIGN = 1 (a line that only feeds back, e.g. a separate inverter
+// feed) or as consumption with -1 (a line that only draws).
+const int CT_PIN = 34;                              // ADC1 pin of the CT clamp
+const int CT_SAMPLE_RATE = 10000;                   // ADC samples per second
+const int CT_BLOCK_SIZE = 2000;                     // Samples per RMS block (10 mains cycles at 50 Hz)
+const unsigned long CT_REPORT_INTERVAL = 500UL;     // Interval (in milliseconds) between samples
+const unsigned long CT_SERVICE_PERIOD = 50UL;       // Interval (in milliseconds) at which the DMA buffers are read
+const unsigned long CT_MICROAMPS_PER_COUNT = 24000; // Calibration: primary current (in uA) per ADC count
+const unsigned long CT_NOISE_FLOOR = 150;           // Currents below this (in mA) are reported as 0
+const int CT_VOLTAGE = 230;                         // Nominal mains voltage in V
+const int CT_POWER_FACTOR = 100;                    // Assumed power factor in percent
+const int CT_POWER_SIGN = 1;                        // 1: feed-back line (surplus), -1: consuming line
+
+// =================================================================
+// Power Saving
+// =================================================================
+// Between measurements the radio and CPU can sleep. With
+// POWER_SAVE_MODEM the radio wakes only for every third beacon and
+// the CPU clock drops to POWER_SAVE_MIN_FREQ while idle; POWER_SAVE_LIGHT
+// additionally puts the chip into light sleep whenever all tasks wait,
+// woken by the FreeRTOS timer of the next poll (needs a framework build
+// with CONFIG_PM_ENABLE and tickless idle, falls back to modem sleep
+// otherwise). Relay outputs are latched while the chip sleeps. Traffic to
+// the device (metrics scrapes, relay node acknowledgements) is delayed
+// by up to a few hundred milliseconds; the push stream and shared meter
+// reading keep the meter task awake every few tens of milliseconds.
+enum PowerSaveMode
+{
+    POWER_SAVE_OFF,   // Radio and CPU always on
+    POWER_SAVE_MODEM, // Modem sleep between beacons, CPU frequency scaling
+    POWER_SAVE_LIGHT  // Modem sleep plus automatic light sleep
+};
+const PowerSaveMode POWER_SAVE_MODE = POWER_SAVE_OFF;
+const int POWER_SAVE_MAX_FREQ = 240;                // CPU frequency (in MHz) while busy
+const int POWER_SAVE_MIN_FREQ = 80;                 // CPU frequency (in MHz) while idle
+const unsigned long POWER_SAVE_LOOP_PERIOD = 100UL; // Delay (in milliseconds) between idle loop() iterations
+
+// =================================================================
+// Firmware Update
+// =================================================================
+// When enabled, `otaUrl` (secrets.h) is checked every OTA_CHECK_INTERVAL
+// for a package built with tools/make_ota.py; the `update` console command
+// checks right away. A check that finds the running image reads only the
+// package header. While an update is written the relays hold their state
+// (unless measurements stop), and they stay latched through the restart
+// into the new image.
+const bool OTA_ENABLED = false;
+const unsigned long OTA_CHECK_INTERVAL = 21600000UL; // Interval (in milliseconds) between update checks (6 h)
+const unsigned long OTA_TIMEOUT = 10000UL;           // Timeout (in milliseconds) for the update server
+const int OTA_TASK_STACK_SIZE = 6144;                // Stack size of the update task in bytes
+const int OTA_TASK_PRIORITY = 1;                     // Priority of the update task, on the meter task core
+
+// =================================================================
+// Task Configuration
+// =================================================================
+// The meter is polled from a separate FreeRTOS task on core 0, while
+// loop() runs the control logic on core 1.
+const int METER_TASK_CORE = 0;                  // Core the meter task is pinned to
+const int METER_TASK_PRIORITY = 1;              // Priority of the meter task
+const int METER_TASK_STACK_SIZE = 8192;         // Stack size of the meter task in bytes
+const int METER_QUEUE_SIZE = 8;                 // Capacity of the sample queue (power of two)
+const unsigned long CONTROL_LOOP_PERIOD = 10UL; // Longest delay (in milliseconds) between loop() iterations
+
 // =================================================================
 // LCD Configuration
 // =================================================================
-const int LCD_ADDRESS = 0x27; // I2C address of the LCD
-const int LCD_COLS = 16;      // Number of columns on the LCD
-const int LCD_ROWS = 2;       // Number of rows on the LCD
+const int LCD_ADDRESS = 0x27;   // I2C address of the LCD
+const int LCD_COLS = 16;        // Number of columns on the LCD
+const int LCD_ROWS = 2;         // Number of rows on the LCD
+const int LCD_FLUSH_BUDGET = 4; // Maximum number of changed cells written per loop() iteration
+
+// =================================================================
+// LCD Pages
+// =================================================================
+// Besides the status page, the LCD has diagnostic pages (per-phase power,
+// today's energy, WiFi, uptime and heap, error counters), stepped through
+// with a push button or a rotary encoder. A button press (or a turn of the
+// encoder) shows the next page; the encoder's push switch returns to the
+// status page, as does UI_PAGE_TIMEOUT without input. Pages are rendered
+// from values cached by loop(), and they reach the display through the
+// framebuffer like any other update. Inputs are active low, with the
+// internal pull-ups.
+enum NavInputType
+{
+    NAV_INPUT_NONE,    // Status page only
+    NAV_INPUT_BUTTON,  // Push button on NAV_BUTTON_PIN
+    NAV_INPUT_ENCODER  // Rotary encoder on NAV_ENCODER_PIN_A/B, its push switch on NAV_BUTTON_PIN
+};
+const NavInputType NAV_INPUT = NAV_INPUT_BUTTON;
+const int NAV_BUTTON_PIN = 27;                    // Push button (or encoder switch) to ground
+const int NAV_ENCODER_PIN_A = 14;                 // Encoder channel A
+const int NAV_ENCODER_PIN_B = 13;                 // Encoder channel B
+const int NAV_ENCODER_STEPS = 4;                  // Quadrature steps per detent of the encoder
+const unsigned long NAV_DEBOUNCE_TIME = 50UL;     // Time (in milliseconds) the button must be released before the next press counts
+const unsigned long UI_PAGE_TIMEOUT = 60000UL;    // Time (in milliseconds) without input before the status page returns (1 min)
+const unsigned long UI_REFRESH_INTERVAL = 1000UL; // Interval (in milliseconds) at which a diagnostic page is redrawn
@@ -0,0 +1,134 @@
+//
+// CT clamp sampled by the I2S-driven ADC.
+//
+
+#include "ct_sensor.h"
+#include "config.h"      // Sample rate, block size and calibration
+#include <Arduino.h>     // Serial, digitalPinToAnalogChannel
+#include <driver/adc.h>  // ADC1 channels and attenuation
+#include <driver/i2s.h>  // ADC sampling through I2S DMA
+
+static const i2s_port_t CT_I2S_PORT = I2S_NUM_0; // The built-in ADC mode is only available on I2S0
+static const int CT_DMA_BUFFERS = 4;             // DMA buffers of CT_DMA_BUFFER_LENGTH samples each,
+static const int CT_DMA_BUFFER_LENGTH = 1024;    // 0.4 s at 10 kHz
+
+// Integer square root, rounded down.
+static uint64_t isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+bool CtSensor::begin(int pin)
+{
+    int8_t channel = digitalPinToAnalogChannel(pin);
+    if (channel < 0 || channel >= ADC1_CHANNEL_MAX)
+    {
+        Serial.printf("CT pin %d is not an ADC1 pin. CT sensor disabled.\n", pin);
+        return false;
+    }
+
+    i2s_config_t config = {};
+    config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+    config.sample_rate = CT_SAMPLE_RATE;
+    config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+    config.dma_buf_count = CT_DMA_BUFFERS;
+    config.dma_buf_len = CT_DMA_BUFFER_LENGTH;
+    if (i2s_driver_install(CT_I2S_PORT, &config, 0, nullptr) != ESP_OK)
+    {
+        Serial.println("I2S driver installation failed. CT sensor disabled.");
+        return false;
+    }
+    i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channel);
+    adc1_config_channel_atten((adc1_channel_t)channel, ADC_ATTEN_DB_11); // Full 0..3.3 V range
+    i2s_adc_enable(CT_I2S_PORT);
+
+    started = true;
+    lastReport = millis();
+    return true;
+}
+
+bool CtSensor::read(MeterSample &sample, uint32_t currentTime)
+{
+    if (!started)
+    {
+        return false;
+    }
+
+    // Drain the filled DMA buffers without waiting for the next one.
+    size_t bytes = 0;
+    while (i2s_read(CT_I2S_PORT, buffer, sizeof(buffer), &bytes, 0) == ESP_OK && bytes > 0)
+    {
+        for (size_t i = 0; i < bytes / sizeof(buffer[0]); i++)
+        {
+            int32_t deviation = (int32_t)(buffer[i] & 0x0FFF) - offset;
+            sum += deviation;
+            sumSquares += (uint64_t)((int64_t)deviation * deviation);
+            if (++blockSamples == (uint32_t)CT_BLOCK_SIZE)
+            {
+                addBlock();
+            }
+        }
+    }
+
+    if (reportBlocks == 0 || currentTime - lastReport < CT_REPORT_INTERVAL)
+    {
+        return false;
+    }
+    uint32_t current = (uint32_t)(currentSum / reportBlocks); // uA
+    lastReport = currentTime;
+    currentSum = 0;
+    reportBlocks = 0;
+    if (current < CT_NOISE_FLOOR * 1000UL)
+    {
+        current = 0; // ADC noise without any load
+    }
+
+    // uA * V * percent / 10^8 = W
+    int64_t power = (int64_t)current * CT_VOLTAGE * CT_POWER_FACTOR / 100000000LL;
+    sample = {};
+    sample.timestamp = currentTime;
+    sample.power = CT_POWER_SIGN * (int32_t)power;
+    sample.current[0] = (int16_t)(current / 10000); // 0.01 A
+    sample.fields = (1U << FIELD_POWER) | (1U << FIELD_CURRENT_L1);
+    return true;
+}
+
+//
+// Adds the RMS current of the completed block to the report.
+//
+void CtSensor::addBlock()
+{
+    // n^2 * variance = n * sum(d^2) - sum(d)^2, so the RMS deviation in
+    // counts is sqrt(that) / n.
+    int64_t n = blockSamples;
+    uint64_t spread = (uint64_t)(n * (int64_t)sumSquares - (int64_t)sum * sum);
+    currentSum += isqrt(spread) * CT_MICROAMPS_PER_COUNT / n;
+    reportBlocks++;
+    blocks++;
+
+    offset += sum / (int32_t)n; // Follow the bias as it drifts with temperature.
+    blockSamples = 0;
+    sum = 0;
+    sumSquares = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "meter_sample.h" // Decoded meter measurements
+#include <stdint.h>       // Fixed-width integer types
+
+//
+// Local power measurement with a current transformer (CT clamp) on an ADC pin.
+//
+// The ADC is clocked by the I2S peripheral and fills DMA buffers in the
+// background, so sampling costs no CPU time and never misses a sample. read()
+// drains the buffers without blocking and computes the RMS current of each
+// block of CT_BLOCK_SIZE samples in integer arithmetic, from the sums of the
+// deviations from the DC bias and of their squares; the bias estimate
+// follows the mean of the previous block to keep the sums small. Every
+// CT_REPORT_INTERVAL the block results are averaged into one MeterSample.
+//
+// A CT alone measures the current but not its direction or the voltage, so
+// the power is estimated as CT_VOLTAGE * I * CT_POWER_FACTOR with the sign
+// chosen by CT_POWER_SIGN.
+//
+class CtSensor
+{
+public:
+    // Starts DMA sampling on ADC1 pin `pin`. Returns false if the pin has no
+    // ADC1 channel or the I2S driver could not be installed.
+    bool begin(int pin);
+
+    // Processes the samples sampled since the last call. Returns true and
+    // fills `sample` once per CT_REPORT_INTERVAL.
+    bool read(MeterSample &sample, uint32_t currentTime);
+
+    bool running() const { return started; }
+    unsigned long blockCount() const { return blocks; }
+
+private:
+    void addBlock();
+
+    bool started = false;
+    uint16_t buffer[256];      // DMA data: 12-bit samples tagged with the channel
+
+    int32_t offset = 2048;     // DC bias estimate in ADC counts
+    uint32_t blockSamples = 0; // Samples in the current block
+    int32_t sum = 0;           // Sum of the deviations from `offset`
+    uint64_t sumSquares = 0;   // Sum of their squares
+
+    uint64_t currentSum = 0;   // Sum of the block RMS currents in uA since the last report
+    uint32_t reportBlocks = 0; // Blocks in currentSum
+    uint32_t lastReport = 0;   // millis() of the last report
+    unsigned long blocks = 0;  // Blocks processed
+};
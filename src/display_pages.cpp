@@ -0,0 +1,108 @@
+//
+// Diagnostic LCD pages.
+//
+
+#include "display_pages.h"
+#include <stdio.h> // snprintf
+
+//
+// Formats `label` and an energy in Wh as kWh with two decimals.
+//
+static void formatEnergy(const char *label, uint32_t wattHours, char *buffer, size_t size)
+{
+    snprintf(buffer, size, "%s %lu.%02lu kWh", label, (unsigned long)(wattHours / 1000),
+             (unsigned long)(wattHours % 1000 / 10));
+}
+
+void formatPageLine(DisplayPage page, uint8_t row, const DisplayState &state, char *buffer, size_t size)
+{
+    switch (page)
+    {
+    case PAGE_PHASES:
+        if (state.phases == 0)
+        {
+            snprintf(buffer, size, "%s", row == 0 ? "Phase power" : "not reported");
+        }
+        else
+        {
+            // L1 and L2 on the first row, L3 on the second
+            char power[2][12];
+            for (uint8_t i = 0; i < 2; i++)
+            {
+                uint8_t phase = row * 2 + i;
+                if (phase < 3 && (state.phases >> phase) & 1)
+                {
+                    snprintf(power[i], sizeof(power[i]), "%5ld", (long)state.phasePower[phase]);
+                }
+                else
+                {
+                    snprintf(power[i], sizeof(power[i]), "   --");
+                }
+            }
+            if (row == 0)
+            {
+                snprintf(buffer, size, "L1%s L2%s", power[0], power[1]);
+            }
+            else
+            {
+                snprintf(buffer, size, "L3%s W", power[0]);
+            }
+        }
+        break;
+    case PAGE_ENERGY:
+        formatEnergy(row == 0 ? "Div:" : "Exp:", row == 0 ? state.divertedToday : state.exportedToday, buffer, size);
+        break;
+    case PAGE_NETWORK:
+        if (!state.wifiConnected)
+        {
+            if (row == 0)
+            {
+                snprintf(buffer, size, "WiFi: down");
+            }
+            else
+            {
+                snprintf(buffer, size, "for %lus", (unsigned long)state.wifiOutage);
+            }
+        }
+        else if (row == 0)
+        {
+            snprintf(buffer, size, "WiFi: %ddBm", state.rssi);
+        }
+        else
+        {
+            snprintf(buffer, size, "%u.%u.%u.%u", state.address[0], state.address[1], state.address[2],
+                     state.address[3]);
+        }
+        break;
+    case PAGE_SYSTEM:
+        if (row == 0)
+        {
+            uint32_t seconds = state.uptime;
+            snprintf(buffer, size, "Up %lud %02lu:%02lu:%02lu", (unsigned long)(seconds / 86400),
+                     (unsigned long)(seconds / 3600 % 24), (unsigned long)(seconds / 60 % 60),
+                     (unsigned long)(seconds % 60));
+        }
+        else
+        {
+            // Free and lowest free heap
+            snprintf(buffer, size, "Heap %luk/%luk", (unsigned long)(state.freeHeap / 1024),
+                     (unsigned long)(state.minFreeHeap / 1024));
+        }
+        break;
+    case PAGE_ERRORS:
+        if (row == 0)
+        {
+            snprintf(buffer, size, "Stale:%lu Drop:%lu", (unsigned long)state.staleCount,
+                     (unsigned long)state.droppedCount);
+        }
+        else
+        {
+            snprintf(buffer, size, "WiFi:%lu Alloc:%lu", (unsigned long)state.reconnectCount,
+                     (unsigned long)state.failedAllocs);
+        }
+        break;
+    default:
+        snprintf(buffer, size, "%s", "");
+        break;
+    }
+}
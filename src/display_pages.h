@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+//
+// The LCD pages after the status page, which the charge controller formats.
+//
+enum DisplayPage : uint8_t
+{
+    PAGE_STATUS,  // Power, charger, countdown or hysteresis and threshold
+    PAGE_PHASES,  // Power per phase
+    PAGE_ENERGY,  // Energy diverted and exported today
+    PAGE_NETWORK, // WiFi signal and address, or the outage
+    PAGE_SYSTEM,  // Uptime and heap
+    PAGE_ERRORS,  // Error counters
+    PAGE_COUNT
+};
+
+//
+// The values shown on the pages, cached by loop() so a page is formatted
+// from RAM alone.
+//
+struct DisplayState
+{
+    uint8_t phases;           // Phases the meter reports, bit 0 for L1
+    int32_t phasePower[3];    // Surplus (W) of L1..L3
+    uint32_t divertedToday;   // Surplus energy (Wh) that went into the charger and loads today
+    uint32_t exportedToday;   // Energy (Wh) exported today
+    bool wifiConnected;       // Whether the WiFi link is up
+    int8_t rssi;              // Signal strength (dBm) while connected
+    uint8_t address[4];       // IPv4 address while connected
+    uint32_t wifiOutage;      // Time (s) since the link was lost
+    uint32_t uptime;          // Time (s) since boot
+    uint32_t freeHeap;        // Free heap (bytes)
+    uint32_t minFreeHeap;     // Lowest free heap since boot (bytes)
+    uint32_t staleCount;      // Times measurements stopped
+    uint32_t droppedCount;    // Samples dropped by a full queue
+    uint32_t reconnectCount;  // WiFi reconnects
+    uint32_t failedAllocs;    // Failed allocations
+};
+
+// Formats row `row` of `page` (not PAGE_STATUS) from `state`.
+void formatPageLine(DisplayPage page, uint8_t row, const DisplayState &state, char *buffer, size_t size);
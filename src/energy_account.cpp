@@ -0,0 +1,128 @@
+//
+// Incremental energy accounting.
+//
+
+#include "energy_account.h"
+
+EnergyAccount::EnergyAccount(uint32_t maxGap) : maxGap(maxGap)
+{
+    state.version = ENERGY_RECORD_VERSION;
+}
+
+void EnergyAccount::setChannelPower(uint8_t channel, uint16_t power)
+{
+    if (channel < ENERGY_CHANNELS)
+    {
+        channelPower[channel] = power;
+    }
+}
+
+bool EnergyAccount::restore(const EnergyRecord &stored)
+{
+    if (stored.version != ENERGY_RECORD_VERSION)
+    {
+        return false;
+    }
+    state = stored;
+    havePrevious = false; // The time before the reboot is a gap.
+    return true;
+}
+
+void EnergyAccount::add(int32_t power, uint16_t states, uint32_t timestamp)
+{
+    int32_t onPower = 0;
+    for (uint8_t channel = 0; channel < ENERGY_CHANNELS; channel++)
+    {
+        onPower += (states >> channel) & 1 ? channelPower[channel] : 0;
+    }
+    int32_t solar = power + onPower;
+
+    // Millisecond timestamps wrap, the difference does not.
+    uint32_t elapsed = timestamp - previousTime;
+    if (havePrevious && elapsed > 0 && elapsed <= maxGap)
+    {
+        integrate(previousSolar, solar, states, elapsed);
+    }
+    havePrevious = true;
+    previousTime = timestamp;
+    previousSolar = solar;
+}
+
+//
+// Integrates the surplus from `from` to `to` (W) over `elapsed` (ms) with `states` on.
+//
+void EnergyAccount::integrate(int32_t from, int32_t to, uint16_t states, uint32_t elapsed)
+{
+    state.covered += elapsed;
+    for (uint8_t channel = 0; channel < ENERGY_CHANNELS; channel++)
+    {
+        if (((states >> channel) & 1) == 0)
+        {
+            continue;
+        }
+        // The channel gets the surplus left by the ones before it, up to its draw.
+        int32_t power = channelPower[channel];
+        int32_t shareFrom = from < 0 ? 0 : from > power ? power : from;
+        int32_t shareTo = to < 0 ? 0 : to > power ? power : to;
+        state.diverted[channel] += trapezoid(shareFrom, shareTo, elapsed);
+        state.onTime[channel] += elapsed;
+        from -= power;
+        to -= power;
+    }
+    state.exported += trapezoid(from < 0 ? 0 : from, to < 0 ? 0 : to, elapsed);
+}
+
+uint64_t EnergyAccount::trapezoid(int32_t from, int32_t to, uint32_t elapsed)
+{
+    return ((uint64_t)(uint32_t)from + (uint32_t)to) * elapsed / 2;
+}
+
+void EnergyAccount::recordSwitch(uint8_t channel, bool on)
+{
+    if (on && channel < ENERGY_CHANNELS && state.cycles[channel] < UINT16_MAX)
+    {
+        state.cycles[channel]++;
+    }
+}
+
+bool EnergyAccount::startDay(uint16_t day)
+{
+    if (day == 0 || day == state.day)
+    {
+        return false;
+    }
+    if (state.day == 0)
+    {
+        state.day = day; // Counted since boot, before the clock was set.
+        return false;
+    }
+
+    state.totalExported += exportedToday();
+    for (uint8_t channel = 0; channel < ENERGY_CHANNELS; channel++)
+    {
+        state.totalDiverted[channel] += divertedToday(channel);
+        state.totalCycles[channel] += state.cycles[channel];
+        state.diverted[channel] = 0;
+        state.cycles[channel] = 0;
+        state.onTime[channel] = 0;
+    }
+    state.exported = 0;
+    state.covered = 0;
+    state.day = day;
+    return true;
+}
+
+uint32_t EnergyAccount::divertedToday() const
+{
+    uint64_t diverted = 0;
+    for (uint8_t channel = 0; channel < ENERGY_CHANNELS; channel++)
+    {
+        diverted += state.diverted[channel];
+    }
+    return wattHours(diverted);
+}
+
+uint8_t EnergyAccount::dutyCycle(uint8_t channel) const
+{
+    return state.covered > 0 ? (uint8_t)((uint64_t)state.onTime[channel] * 100 / state.covered) : 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+// Relay channels accounted: the charger and the first loads.
+const uint8_t ENERGY_CHANNELS = 4;
+
+//
+// Energy counters of the current day and totals of the closed days, as
+// kept in NVS. Energies of the day are in watt-milliseconds (mJ), so
+// integrating a sample adds no rounding error worth counting; the totals
+// are in Wh.
+//
+struct EnergyRecord
+{
+    uint8_t version;                         // Layout version, ENERGY_RECORD_VERSION
+    uint8_t reserved;                        // Keeps the record free of implicit padding
+    uint16_t day;                            // Local date (dayNumber()), 0 while the clock is unset
+    uint16_t cycles[ENERGY_CHANNELS];        // Switch-ons today
+    uint32_t covered;                        // Time (ms) today covered by samples
+    uint32_t onTime[ENERGY_CHANNELS];        // Time (ms) on today
+    uint64_t exported;                       // Energy (mJ) fed into the grid today
+    uint64_t diverted[ENERGY_CHANNELS];      // Surplus energy (mJ) that went into each channel today
+    uint32_t totalExported;                  // Energy (Wh) exported on the closed days
+    uint32_t totalDiverted[ENERGY_CHANNELS]; // Surplus energy (Wh) per channel on the closed days
+    uint32_t totalCycles[ENERGY_CHANNELS];   // Switch-ons on the closed days
+    uint32_t reserved2;
+};
+
+static_assert(sizeof(EnergyRecord) == 112, "EnergyRecord layout changed, bump ENERGY_RECORD_VERSION");
+
+const uint8_t ENERGY_RECORD_VERSION = 1;
+
+//
+// Incremental energy accounting over the timestamped samples.
+//
+// The surplus before the relayed loads is reconstructed at each sample as
+// the measured surplus plus the nominal draw of the channels that were on.
+// Between two samples, with the relays in the state they were measured
+// in, it is integrated with the trapezoidal rule: what the channels that
+// are on take of it, in channel order and up to their draw, counts as
+// diverted, and what is left over as exported. Gaps longer than `maxGap`
+// (outages, reboots) are not counted. Nothing but the last sample is kept.
+//
+class EnergyAccount
+{
+public:
+    explicit EnergyAccount(uint32_t maxGap);
+
+    // Channel `channel` (0 the charger, 1 + i load i) draws `power` (W) when on.
+    void setChannelPower(uint8_t channel, uint16_t power);
+
+    // Continues from a stored record, of any day.
+    bool restore(const EnergyRecord &stored);
+    const EnergyRecord &record() const { return state; }
+
+    // Adds the surplus `power` (W, export positive) measured at `timestamp`
+    // (ms) with `states` (bit 0 the charger, bit 1 + i load i) on.
+    void add(int32_t power, uint16_t states, uint32_t timestamp);
+
+    // Counts a relay switch of `channel`.
+    void recordSwitch(uint8_t channel, bool on);
+
+    // Starts local date `day` when it differs from the one counted: the
+    // counted day is added to the totals and the day counters restart.
+    // Counters collected before the clock was set (day 0) are kept for
+    // the first day. Returns true when a day was closed.
+    bool startDay(uint16_t day);
+
+    uint16_t day() const { return state.day; }
+
+    // Energies (Wh), switch-ons and the share of the covered time a channel was on today (percent).
+    uint32_t exportedToday() const { return wattHours(state.exported); }
+    uint32_t divertedToday(uint8_t channel) const { return wattHours(state.diverted[channel]); }
+    uint32_t divertedToday() const;
+    uint16_t cyclesToday(uint8_t channel) const { return state.cycles[channel]; }
+    uint8_t dutyCycle(uint8_t channel) const;
+
+    // Totals (Wh) including today.
+    uint32_t exportedTotal() const { return state.totalExported + exportedToday(); }
+    uint32_t divertedTotal(uint8_t channel) const { return state.totalDiverted[channel] + divertedToday(channel); }
+    uint32_t cyclesTotal(uint8_t channel) const { return state.totalCycles[channel] + state.cycles[channel]; }
+
+private:
+    static uint32_t wattHours(uint64_t milliJoules) { return (uint32_t)(milliJoules / 3600000ULL); }
+    static uint64_t trapezoid(int32_t from, int32_t to, uint32_t elapsed);
+    void integrate(int32_t from, int32_t to, uint16_t states, uint32_t elapsed);
+
+    uint32_t maxGap;
+    uint16_t channelPower[ENERGY_CHANNELS] = {};
+    EnergyRecord state = {};
+    bool havePrevious = false;
+    uint32_t previousTime = 0;  // Timestamp (ms) of the last sample
+    int32_t previousSolar = 0;  // Surplus (W) before the relayed loads at the last sample
+};
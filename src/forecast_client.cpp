@@ -0,0 +1,120 @@
+//
+// Daily PV forecast download.
+//
+
+#include "forecast_client.h"
+#include "config.h" // FORECAST_HTTP_TIMEOUT
+#include <stdio.h>  // snprintf
+#include <string.h> // strlen, strncmp
+
+bool ForecastClient::fetch(const char *url, int year, int month, int day, SolarForecast &forecast)
+{
+    snprintf(date, sizeof(date), "%04d-%02d-%02d", year, month, day);
+    forecast = {};
+    forecast.version = SOLAR_FORECAST_VERSION;
+    forecast.day = dayNumber(year, month, day);
+    target = &forecast;
+    periods = 0;
+
+    http.setTimeout(FORECAST_HTTP_TIMEOUT);
+    http.setConnectTimeout(FORECAST_HTTP_TIMEOUT);
+    if (!http.begin(tcp, url))
+    {
+        Serial.println("Forecast URL is invalid.");
+        failures++;
+        return false;
+    }
+    int httpResponseCode = http.GET();
+    bool parsed = false;
+    if (httpResponseCode == 200)
+    {
+        JsonScanner scanner(handler, this);
+        parsed = readJson(scanner);
+    }
+    else
+    {
+        Serial.printf("Forecast HTTP response error: %d\n", httpResponseCode);
+    }
+    http.end();
+    tcp.stop(); // Not needed again until tomorrow.
+
+    if (!parsed || periods == 0)
+    {
+        Serial.printf("Forecast for %s not available.\n", date);
+        failures++;
+        return false;
+    }
+    fetches++;
+    return true;
+}
+
+//
+// Reads the response body in fixed-size chunks until the JSON document is complete.
+//
+bool ForecastClient::readJson(JsonScanner &scanner)
+{
+    int remaining = http.getSize(); // Content-Length, or -1 when unknown
+    unsigned long lastData = millis();
+    while (!scanner.done() && remaining != 0)
+    {
+        int available = tcp.available();
+        if (available <= 0)
+        {
+            if (!tcp.connected() || millis() - lastData >= FORECAST_HTTP_TIMEOUT)
+            {
+                return false;
+            }
+            delay(1);
+            continue;
+        }
+
+        size_t chunk = available < (int)sizeof(readBuffer) ? available : sizeof(readBuffer);
+        if (remaining > 0 && (int)chunk > remaining)
+        {
+            chunk = remaining;
+        }
+        int received = tcp.read((uint8_t *)readBuffer, chunk);
+        if (received <= 0 || !scanner.feed(readBuffer, received))
+        {
+            return false;
+        }
+        if (remaining > 0)
+        {
+            remaining -= received;
+        }
+        lastData = millis();
+    }
+    return scanner.done();
+}
+
+//
+// Adds a "YYYY-MM-DD HH:MM:SS": Wh period of the requested date to its hour.
+//
+void ForecastClient::handler(void *context, uint8_t depth, const char *key, const char *value, bool isString)
+{
+    ForecastClient &client = *(ForecastClient *)context;
+    if (depth != 2 || isString || strlen(key) != 19 || strncmp(key, client.date, 10) != 0)
+    {
+        return;
+    }
+    int32_t energy;
+    if (!jsonToFixed(value, 0, energy) || energy < 0)
+    {
+        return;
+    }
+
+    // A period ending on the full hour belongs to the hour before.
+    int hour = (key[11] - '0') * 10 + (key[12] - '0');
+    bool fullHour = strncmp(key + 14, "00:00", 5) == 0;
+    if (fullHour)
+    {
+        hour--;
+    }
+    if (hour < 0 || hour > 23)
+    {
+        return;
+    }
+    uint32_t sum = client.target->energy[hour] + (uint32_t)energy;
+    client.target->energy[hour] = sum > UINT16_MAX ? UINT16_MAX : (uint16_t)sum;
+    client.periods++;
+}
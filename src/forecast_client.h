@@ -0,0 +1,42 @@
+#pragma once
+
+#include "charge_plan.h"  // SolarForecast
+#include "json_scanner.h" // Allocation-free JSON scanning of responses
+#include <HTTPClient.h>   // HTTP client for the forecast API
+#include <WiFiClient.h>   // TCP connection to the forecast API
+
+//
+// Fetches the daily PV forecast.
+//
+// The response is the forecast.solar "watt_hours_period" estimate: an
+// object "result" mapping local times ("YYYY-MM-DD HH:MM:SS") to the energy
+// (Wh) produced in the period ending then. The periods of the requested
+// date are summed into hourly buckets as they stream in, so the response
+// is never held in memory. Called once a day, so a new connection is
+// opened for every fetch.
+//
+class ForecastClient
+{
+public:
+    // Fetches the forecast for local date `year`-`month`-`day` (month 1..12)
+    // from `url` into `forecast`. Returns false on errors or when the
+    // response holds no period of that date.
+    bool fetch(const char *url, int year, int month, int day, SolarForecast &forecast);
+
+    unsigned long fetchCount() const { return fetches; }
+    unsigned long failureCount() const { return failures; }
+
+private:
+    static void handler(void *context, uint8_t depth, const char *key, const char *value, bool isString);
+    bool readJson(JsonScanner &scanner);
+
+    WiFiClient tcp;
+    HTTPClient http;
+    char readBuffer[128]; // Fixed chunk buffer for reading the response body
+
+    char date[11] = "";              // "YYYY-MM-DD" of the requested date
+    SolarForecast *target = nullptr; // Forecast being filled in
+    uint8_t periods = 0;             // Periods of the requested date found
+    unsigned long fetches = 0;       // Successful fetches
+    unsigned long failures = 0;      // Failed fetches
+};
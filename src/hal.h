@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Hardware seen by the control core.
+//
+// ChargeController only reaches the clock and the relays through this
+// interface, so the same decisions run on the ESP32 (millis(), GPIO and
+// ESP-NOW relays, NVS) and on the host, where the replay harness drives it
+// from a recorded power trace with a simulated clock.
+//
+class Hal
+{
+public:
+    virtual ~Hal() {}
+
+    // Current time in ms. Wraps like millis(); only differences are used.
+    virtual uint32_t millis() = 0;
+
+    // Drives relay `channel` (0 the charger, 1 + i load channel i). Called
+    // once per switch, with the sample timestamp the decision was made at.
+    virtual void setRelay(uint8_t channel, bool on, uint32_t timestamp) = 0;
+};
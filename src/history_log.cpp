@@ -0,0 +1,328 @@
+//
+// Wear-levelled sample log on a raw flash partition.
+//
+
+#include "history_log.h"
+#include <Arduino.h> // Serial
+#include <string.h>  // memset
+
+static const uint32_t HISTORY_MAGIC = 0x474F4C48; // "HLOG"
+static const uint16_t HISTORY_VERSION = 1;
+static const uint32_t ERASED = 0xFFFFFFFF;
+
+bool HistoryLog::begin(const char *label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr)
+    {
+        Serial.printf("History partition '%s' not found. Flash history disabled.\n", label);
+        return false;
+    }
+    sectorCount = partition->size / SECTOR_SIZE;
+    if (sectorCount > MAX_SECTORS)
+    {
+        sectorCount = MAX_SECTORS;
+    }
+    if (sectorCount < 2)
+    {
+        partition = nullptr;
+        return false;
+    }
+
+    // The newest sector is the valid one with the highest sequence number.
+    bool found = false;
+    for (uint16_t sector = 0; sector < sectorCount; sector++)
+    {
+        SectorHeader header;
+        esp_partition_read(partition, sector * SECTOR_SIZE, &header, sizeof(header));
+        bool valid = header.magic == HISTORY_MAGIC && header.version == HISTORY_VERSION &&
+                     header.recordSize == sizeof(HistoryRecord);
+        uint32_t first = valid ? slotTimestamp(sector, 1) : ERASED;
+        sectorStart[sector] = first == ERASED ? 0 : first;
+        if (sectorStart[sector] != 0 && (!found || (int32_t)(header.sequence - headSequence) > 0))
+        {
+            found = true;
+            headSector = sector;
+            headSequence = header.sequence;
+        }
+    }
+
+    if (!found)
+    {
+        // Empty log: the first flush starts at sector 0.
+        headSector = sectorCount - 1;
+        headSlot = SLOTS_PER_SECTOR;
+        headSequence = 0;
+        Serial.printf("History: new log, %u records capacity.\n", (unsigned)capacity());
+        return true;
+    }
+
+    // Records fill a sector from slot 1 on, so the first erased slot is found by bisection.
+    uint16_t low = 1;
+    uint16_t high = SLOTS_PER_SECTOR;
+    while (low < high)
+    {
+        uint16_t middle = (low + high) / 2;
+        if (slotTimestamp(headSector, middle) == ERASED)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    headSlot = low;
+    lastTimestamp = slotTimestamp(headSector, headSlot - 1);
+    Serial.printf("History: %u records from %lu to %lu.\n", (unsigned)recordCount(),
+                  (unsigned long)oldestTimestamp(), (unsigned long)lastTimestamp);
+    return true;
+}
+
+void HistoryLog::append(const HistoryRecord &record)
+{
+    if (!ready())
+    {
+        return;
+    }
+    if (pendingCount == HISTORY_WRITE_BATCH && !flush())
+    {
+        return; // Flash failed; the record is dropped rather than blocking.
+    }
+    pending[pendingCount] = record;
+    if (pending[pendingCount].timestamp < lastTimestamp)
+    {
+        pending[pendingCount].timestamp = lastTimestamp; // Keep the log sorted when the clock steps back.
+    }
+    lastTimestamp = pending[pendingCount].timestamp;
+    pendingCount++;
+}
+
+void HistoryLog::service(unsigned long currentTime, bool quiet)
+{
+    if (!ready())
+    {
+        return;
+    }
+    if (pendingCount == HISTORY_WRITE_BATCH ||
+        (pendingCount > 0 && currentTime - lastFlushTime >= HISTORY_FLUSH_INTERVAL))
+    {
+        flush();
+        lastFlushTime = currentTime;
+    }
+    else if (pendingCount == 0)
+    {
+        lastFlushTime = currentTime;
+    }
+
+    // Erase the next sector ahead of time, while nothing is about to switch.
+    if (quiet && !nextErased && headSlot >= SLOTS_PER_SECTOR / 2)
+    {
+        uint16_t next = (headSector + 1) % sectorCount;
+        nextErased = eraseSector(next);
+    }
+}
+
+//
+// Writes the pending records after the last record in flash, continuing in
+// the next sector when the head sector is full.
+//
+bool HistoryLog::flush()
+{
+    uint8_t written = 0;
+    while (written < pendingCount)
+    {
+        if (headSlot >= SLOTS_PER_SECTOR && !startNextSector(pending[written].timestamp))
+        {
+            return false;
+        }
+        uint16_t room = SLOTS_PER_SECTOR - headSlot;
+        uint16_t count = pendingCount - written < room ? pendingCount - written : room;
+        size_t offset = headSector * SECTOR_SIZE + headSlot * sizeof(HistoryRecord);
+        if (esp_partition_write(partition, offset, &pending[written], count * sizeof(HistoryRecord)) != ESP_OK)
+        {
+            Serial.println("History write failed.");
+            return false;
+        }
+        headSlot += count;
+        written += count;
+    }
+    pendingCount = 0;
+    return true;
+}
+
+//
+// Moves the head to the next sector, overwriting the oldest one.
+//
+bool HistoryLog::startNextSector(uint32_t firstTimestamp)
+{
+    uint16_t next = (headSector + 1) % sectorCount;
+    if (!nextErased && !eraseSector(next))
+    {
+        return false;
+    }
+    SectorHeader header = {HISTORY_MAGIC, headSequence + 1, HISTORY_VERSION, sizeof(HistoryRecord), ERASED};
+    if (esp_partition_write(partition, next * SECTOR_SIZE, &header, sizeof(header)) != ESP_OK)
+    {
+        return false;
+    }
+    headSector = next;
+    headSlot = 1;
+    headSequence++;
+    nextErased = false;
+    sectorStart[next] = firstTimestamp;
+    return true;
+}
+
+bool HistoryLog::eraseSector(uint16_t sector)
+{
+    sectorStart[sector] = 0; // The oldest records are gone from here on.
+    if (esp_partition_erase_range(partition, sector * SECTOR_SIZE, SECTOR_SIZE) != ESP_OK)
+    {
+        Serial.println("History erase failed.");
+        return false;
+    }
+    return true;
+}
+
+uint32_t HistoryLog::slotTimestamp(uint16_t sector, uint16_t slot) const
+{
+    uint32_t timestamp = ERASED;
+    esp_partition_read(partition, sector * SECTOR_SIZE + slot * sizeof(HistoryRecord), &timestamp,
+                       sizeof(timestamp));
+    return timestamp;
+}
+
+//
+// Unused sectors only precede the used ones in ring order (oldest first),
+// so the first used one is found by bisection.
+//
+uint16_t HistoryLog::firstValidLogical() const
+{
+    uint16_t low = 0;
+    uint16_t high = sectorCount - 1; // The head sector, used unless the log is empty
+    while (low < high)
+    {
+        uint16_t middle = (low + high) / 2;
+        if (sectorStart[sectorAt(middle)] == 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+size_t HistoryLog::read(uint32_t timestamp, HistoryRecord *records, size_t maxCount, size_t skip)
+{
+    if (!ready() || maxCount == 0)
+    {
+        return 0;
+    }
+    size_t copied = 0;
+    uint16_t head = sectorCount - 1; // Logical index of the head sector
+    if (sectorStart[headSector] != 0)
+    {
+        // Last sector starting at or before `timestamp`.
+        uint16_t low = firstValidLogical();
+        uint16_t high = head;
+        while (low < high)
+        {
+            uint16_t middle = (low + high + 1) / 2;
+            if (sectorStart[sectorAt(middle)] <= timestamp)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle - 1;
+            }
+        }
+
+        // First slot at or after `timestamp` in that sector.
+        uint16_t sector = sectorAt(low);
+        uint16_t end = low == head ? headSlot : SLOTS_PER_SECTOR;
+        uint16_t first = 1;
+        uint16_t last = end;
+        while (first < last)
+        {
+            uint16_t middle = (first + last) / 2;
+            if (slotTimestamp(sector, middle) < timestamp)
+            {
+                first = middle + 1;
+            }
+            else
+            {
+                last = middle;
+            }
+        }
+
+        // Copy sequentially from there, sector by sector, after the skipped records.
+        for (uint16_t logical = low; logical <= head && copied < maxCount; logical++)
+        {
+            sector = sectorAt(logical);
+            end = logical == head ? headSlot : SLOTS_PER_SECTOR;
+            uint16_t count = end > first ? end - first : 0;
+            uint16_t skipped = count < skip ? count : (uint16_t)skip;
+            first += skipped;
+            count -= skipped;
+            skip -= skipped;
+            if (count > maxCount - copied)
+            {
+                count = maxCount - copied;
+            }
+            esp_partition_read(partition, sector * SECTOR_SIZE + first * sizeof(HistoryRecord),
+                               &records[copied], count * sizeof(HistoryRecord));
+            copied += count;
+            first = 1;
+        }
+    }
+
+    // Records not written to flash yet come last.
+    for (uint8_t i = 0; i < pendingCount && copied < maxCount; i++)
+    {
+        if (pending[i].timestamp < timestamp)
+        {
+            continue;
+        }
+        if (skip > 0)
+        {
+            skip--;
+        }
+        else
+        {
+            records[copied++] = pending[i];
+        }
+    }
+    return copied;
+}
+
+uint32_t HistoryLog::recordCount() const
+{
+    uint32_t count = pendingCount;
+    for (uint16_t sector = 0; sector < sectorCount; sector++)
+    {
+        if (sectorStart[sector] != 0)
+        {
+            count += sector == headSector ? headSlot - 1 : SLOTS_PER_SECTOR - 1;
+        }
+    }
+    return count;
+}
+
+uint32_t HistoryLog::capacity() const
+{
+    return (uint32_t)sectorCount * (SLOTS_PER_SECTOR - 1);
+}
+
+uint32_t HistoryLog::oldestTimestamp() const
+{
+    if (sectorStart[headSector] == 0)
+    {
+        return pendingCount ? pending[0].timestamp : 0;
+    }
+    return sectorStart[sectorAt(firstValidLogical())];
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "config.h"        // Batch size and flush interval
+#include <esp_partition.h> // Raw access to the history partition
+#include <stddef.h>        // size_t
+#include <stdint.h>        // Fixed-width integer types
+
+// One logged sample, 16 bytes so records never straddle a flash page.
+struct HistoryRecord
+{
+    uint32_t timestamp; // Unix time in seconds; 0xFFFFFFFF marks an erased slot
+    int32_t power;      // Surplus power in W
+    int32_t decision;   // Power the switching decision was based on, in W
+    uint16_t states;    // Relay states (bit 0 the charger, bit 1 + i load channel i)
+    uint16_t reserved;
+};
+
+static_assert(sizeof(HistoryRecord) == 16, "HistoryRecord must stay 16 bytes");
+
+//
+// Append-only sample log on a raw flash partition, kept across reboots.
+//
+// The partition is used as a ring of 4 KB sectors. Each sector starts with
+// a header slot (magic and a sequence number) followed by 255 records, so
+// the newest sector is found at boot from the headers alone and the whole
+// partition wears evenly: every sector is erased once per pass of the ring.
+//
+// Records are collected in RAM and written HISTORY_WRITE_BATCH at a time,
+// a full 256-byte flash page, or when HISTORY_FLUSH_INTERVAL has passed.
+// The next sector is erased ahead of time once the current one is half full
+// and only when the caller reports a quiet moment, so the erase stall (tens
+// of milliseconds, during which flash access stops on both cores) does not
+// hit a pending switching decision.
+//
+// The first timestamp of each sector is kept in RAM, so finding a time is a
+// binary search over the sectors followed by one within a sector.
+//
+class HistoryLog
+{
+public:
+    // Opens the data partition `label` and locates the end of the log.
+    bool begin(const char *label);
+
+    bool ready() const { return partition != nullptr; }
+
+    // Queues a record. Timestamps must not decrease.
+    void append(const HistoryRecord &record);
+
+    // Writes due batches and erases ahead. Erasing is only done when `quiet`.
+    void service(unsigned long currentTime, bool quiet);
+
+    // Writes the queued records right away, e.g. before a restart.
+    bool sync() { return ready() && flush(); }
+
+    // Copies up to `maxCount` records, starting with the first one at or after
+    // `timestamp` and leaving out the `skip` records after it, into `records`.
+    // Returns the number of records copied.
+    size_t read(uint32_t timestamp, HistoryRecord *records, size_t maxCount, size_t skip = 0);
+
+    uint32_t recordCount() const;
+    uint32_t capacity() const;
+    uint32_t oldestTimestamp() const;
+    uint32_t newestTimestamp() const { return lastTimestamp; }
+
+private:
+    static const uint32_t SECTOR_SIZE = 4096;
+    static const uint16_t SLOTS_PER_SECTOR = SECTOR_SIZE / sizeof(HistoryRecord); // Slot 0 is the header
+    static const uint16_t MAX_SECTORS = 512;
+
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t reserved;
+    };
+
+    bool flush();
+    bool startNextSector(uint32_t firstTimestamp);
+    bool eraseSector(uint16_t sector);
+    uint32_t slotTimestamp(uint16_t sector, uint16_t slot) const;
+    uint16_t sectorAt(uint16_t logical) const { return (headSector + 1 + logical) % sectorCount; }
+    uint16_t firstValidLogical() const;
+
+    const esp_partition_t *partition = nullptr;
+    uint16_t sectorCount = 0;
+    uint16_t headSector = 0;           // Sector currently being filled
+    uint16_t headSlot = 0;             // Next free slot in the head sector
+    uint32_t headSequence = 0;         // Sequence number of the head sector
+    bool nextErased = false;           // The sector after the head has been erased
+    uint32_t lastTimestamp = 0;        // Newest timestamp appended
+    uint32_t sectorStart[MAX_SECTORS]; // First timestamp per sector, 0 if unused
+
+    HistoryRecord pending[HISTORY_WRITE_BATCH]; // Not yet written to flash
+    uint8_t pendingCount = 0;
+    unsigned long lastFlushTime = 0;
+};
@@ -0,0 +1,312 @@
+//
+// Streaming, allocation-free JSON scanner.
+//
+
+#include "json_scanner.h"
+#include <string.h> // strcmp
+
+JsonScanner::JsonScanner(ValueHandler handler, void *context)
+    : onValue(handler), context(context)
+{
+    reset();
+}
+
+void JsonScanner::reset()
+{
+    state = ExpectValue;
+    escaped = false;
+    depth = 0;
+    arrayMask = 0;
+    keyLength = 0;
+    tokenLength = 0;
+    key[0] = '\0';
+    token[0] = '\0';
+}
+
+bool JsonScanner::feed(const char *data, size_t length)
+{
+    for (size_t i = 0; i < length && state != Done && state != Failed; i++)
+    {
+        process(data[i]);
+    }
+    return state != Failed;
+}
+
+static bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+//
+// Advances the state machine by one input character.
+//
+void JsonScanner::process(char c)
+{
+    switch (state)
+    {
+    case ExpectValue:
+        if (isWhitespace(c))
+        {
+            return;
+        }
+        if (c == '{' || c == '[')
+        {
+            pushContainer(c == '[');
+        }
+        else if (c == ']' && depth > 0 && (arrayMask & (1U << (depth - 1))))
+        {
+            popContainer(true); // Empty array
+        }
+        else if (c == '"')
+        {
+            tokenLength = 0;
+            escaped = false;
+            state = InString;
+        }
+        else if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n')
+        {
+            token[0] = c;
+            tokenLength = 1;
+            state = InLiteral;
+        }
+        else
+        {
+            state = Failed;
+        }
+        return;
+
+    case ExpectKeyOrEnd:
+    case ExpectKey:
+        if (isWhitespace(c))
+        {
+            return;
+        }
+        if (c == '"')
+        {
+            keyLength = 0;
+            escaped = false;
+            state = InKey;
+        }
+        else if (c == '}' && state == ExpectKeyOrEnd)
+        {
+            popContainer(false); // Empty object
+        }
+        else
+        {
+            state = Failed;
+        }
+        return;
+
+    case ExpectColon:
+        if (isWhitespace(c))
+        {
+            return;
+        }
+        state = c == ':' ? ExpectValue : Failed;
+        return;
+
+    case ExpectCommaOrEnd:
+        if (isWhitespace(c))
+        {
+            return;
+        }
+        if (c == ',')
+        {
+            bool inArray = arrayMask & (1U << (depth - 1));
+            state = inArray ? ExpectValue : ExpectKey;
+        }
+        else if (c == '}' || c == ']')
+        {
+            popContainer(c == ']');
+        }
+        else
+        {
+            state = Failed;
+        }
+        return;
+
+    case InKey:
+    case InString:
+    {
+        char *buffer = state == InKey ? key : token;
+        uint8_t &length = state == InKey ? keyLength : tokenLength;
+        uint8_t capacity = state == InKey ? KEY_SIZE : TOKEN_SIZE;
+        if (!escaped && c == '"')
+        {
+            buffer[length] = '\0';
+            if (state == InKey)
+            {
+                state = ExpectColon;
+            }
+            else
+            {
+                emit(true);
+                endValue();
+            }
+            return;
+        }
+        escaped = !escaped && c == '\\';
+        if (!escaped && length < capacity - 1)
+        {
+            buffer[length++] = c; // Escaped characters are kept without their backslash.
+        }
+        return;
+    }
+
+    case InLiteral:
+        if (isWhitespace(c) || c == ',' || c == '}' || c == ']')
+        {
+            token[tokenLength] = '\0';
+            emit(false);
+            endValue();
+            if (state != Done)
+            {
+                process(c); // The delimiter belongs to the enclosing container.
+            }
+            return;
+        }
+        if (tokenLength < TOKEN_SIZE - 1)
+        {
+            token[tokenLength++] = c;
+        }
+        return;
+
+    case Done:
+    case Failed:
+        return;
+    }
+}
+
+void JsonScanner::pushContainer(bool isArray)
+{
+    if (depth >= MAX_DEPTH)
+    {
+        state = Failed;
+        return;
+    }
+    if (isArray)
+    {
+        arrayMask |= 1U << depth;
+    }
+    else
+    {
+        arrayMask &= ~(1U << depth);
+    }
+    depth++;
+    keyLength = 0;
+    key[0] = '\0';
+    state = isArray ? ExpectValue : ExpectKeyOrEnd;
+}
+
+void JsonScanner::popContainer(bool isArray)
+{
+    bool topIsArray = arrayMask & (1U << (depth - 1));
+    if (topIsArray != isArray)
+    {
+        state = Failed;
+        return;
+    }
+    depth--;
+    keyLength = 0;
+    key[0] = '\0';
+    endValue();
+}
+
+void JsonScanner::endValue()
+{
+    state = depth == 0 ? Done : ExpectCommaOrEnd;
+}
+
+void JsonScanner::emit(bool isString)
+{
+    bool inArray = depth > 0 && (arrayMask & (1U << (depth - 1)));
+    onValue(context, depth, inArray ? "" : key, token, isString);
+}
+
+bool jsonToFixed(const char *text, uint8_t decimals, int32_t &value)
+{
+    bool negative = *text == '-';
+    if (negative)
+    {
+        text++;
+    }
+    if (*text < '0' || *text > '9')
+    {
+        return false;
+    }
+
+    int64_t result = 0;
+    while (*text >= '0' && *text <= '9')
+    {
+        result = result * 10 + (*text++ - '0');
+        if (result > INT32_MAX)
+        {
+            return false;
+        }
+    }
+
+    uint8_t fractionDigits = 0;
+    bool roundUp = false;
+    if (*text == '.')
+    {
+        text++;
+        while (*text >= '0' && *text <= '9')
+        {
+            if (fractionDigits < decimals)
+            {
+                result = result * 10 + (*text - '0');
+                fractionDigits++;
+            }
+            else if (fractionDigits == decimals)
+            {
+                roundUp = *text >= '5'; // First dropped digit decides the rounding.
+                fractionDigits++;
+            }
+            text++;
+        }
+    }
+    if (*text != '\0')
+    {
+        return false; // Exponents are not used by the meter.
+    }
+    for (; fractionDigits < decimals; fractionDigits++)
+    {
+        result *= 10;
+    }
+    if (roundUp)
+    {
+        result++;
+    }
+    if (result > INT32_MAX)
+    {
+        return false;
+    }
+
+    value = (int32_t)(negative ? -result : result);
+    return true;
+}
+
+JsonFieldSet::JsonFieldSet(const JsonField *fields, uint8_t count, int32_t *values, uint8_t depth)
+    : fields(fields), count(count), values(values), depth(depth)
+{
+}
+
+void JsonFieldSet::handler(void *context, uint8_t depth, const char *key, const char *value, bool isString)
+{
+    JsonFieldSet *set = (JsonFieldSet *)context;
+    if (depth != set->depth || isString)
+    {
+        return;
+    }
+    for (uint8_t i = 0; i < set->count; i++)
+    {
+        if (strcmp(set->fields[i].key, key) == 0)
+        {
+            if (jsonToFixed(value, set->fields[i].decimals, set->values[i]))
+            {
+                set->foundMask |= 1UL << i;
+            }
+            return;
+        }
+    }
+}
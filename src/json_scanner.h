@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Streaming JSON scanner with zero heap allocations.
+//
+// Input is fed in chunks of any size as it arrives from the network. Every
+// scalar value (number, string, true/false/null) is reported to a handler
+// together with its key and nesting depth; nothing else is stored, so memory
+// use is fixed to the key and token buffers below regardless of document
+// size. Keys or tokens longer than the buffers are truncated.
+//
+class JsonScanner
+{
+public:
+    // Called for every scalar value. `depth` is the number of enclosing
+    // containers (1 for top-level fields), `key` is empty for array elements.
+    typedef void (*ValueHandler)(void *context, uint8_t depth, const char *key, const char *value, bool isString);
+
+    JsonScanner(ValueHandler handler, void *context);
+
+    // Prepares the scanner for a new document.
+    void reset();
+
+    // Processes the next chunk of input. Returns false once the input is malformed.
+    bool feed(const char *data, size_t length);
+
+    // True once the outermost value has been completely read.
+    bool done() const { return state == Done; }
+    bool failed() const { return state == Failed; }
+
+private:
+    enum State : uint8_t
+    {
+        ExpectValue,
+        ExpectKeyOrEnd,
+        ExpectKey,
+        ExpectColon,
+        ExpectCommaOrEnd,
+        InKey,
+        InString,
+        InLiteral,
+        Done,
+        Failed
+    };
+
+    static const uint8_t MAX_DEPTH = 16;
+    static const uint8_t KEY_SIZE = 32;
+    static const uint8_t TOKEN_SIZE = 24;
+
+    void process(char c);
+    void pushContainer(bool isArray);
+    void popContainer(bool isArray);
+    void endValue();
+    void emit(bool isString);
+
+    ValueHandler onValue;
+    void *context;
+
+    State state = ExpectValue;
+    bool escaped = false;    // Previous string character was a backslash
+    uint8_t depth = 0;       // Number of open containers
+    uint16_t arrayMask = 0;  // Bit n is set when container n is an array
+    uint8_t keyLength = 0;
+    uint8_t tokenLength = 0;
+    char key[KEY_SIZE];
+    char token[TOKEN_SIZE];
+};
+
+//
+// Converts a JSON number to a fixed-point integer (value * 10^decimals),
+// rounding half away from zero. Returns false for non-numeric text.
+//
+bool jsonToFixed(const char *text, uint8_t decimals, int32_t &value);
+
+// Numeric field extracted by JsonFieldSet
+struct JsonField
+{
+    const char *key;  // Field name
+    uint8_t decimals; // Decimal places kept in the fixed-point value
+};
+
+//
+// Extracts a table of numeric fields into fixed-point values. Fields are
+// matched at nesting `depth` (1 for top-level fields). Use
+// JsonFieldSet::handler as the scanner's handler with the set as context.
+//
+class JsonFieldSet
+{
+public:
+    JsonFieldSet(const JsonField *fields, uint8_t count, int32_t *values, uint8_t depth = 1);
+
+    void reset() { foundMask = 0; }
+
+    // True if the field at `index` was present in the document.
+    bool has(uint8_t index) const { return (foundMask & (1UL << index)) != 0; }
+
+    static void handler(void *context, uint8_t depth, const char *key, const char *value, bool isString);
+
+private:
+    const JsonField *fields;
+    uint8_t count;
+    int32_t *values;
+    uint8_t depth;
+    uint32_t foundMask = 0;
+};
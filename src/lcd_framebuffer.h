@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+#include <string.h> // memset
+
+//
+// Framebuffer for a character LCD that only sends the cells that changed.
+//
+// Text is drawn into a RAM copy of the display without any I2C traffic.
+// flush() compares it with what the display currently shows, cell by cell,
+// and writes only the changed runs, issuing setCursor() only where a run
+// does not continue at the current cursor position. The number of cells
+// written per flush can be limited, so the slow I2C writes can be spread
+// over several loop() iterations and kept off the control path.
+//
+template <uint8_t Cols, uint8_t Rows>
+class LcdFramebuffer
+{
+public:
+    LcdFramebuffer()
+    {
+        memset(target, ' ', sizeof(target));
+        invalidate();
+    }
+
+    // Replaces a whole row; the rest of the row is cleared.
+    void setLine(uint8_t row, const char *text)
+    {
+        if (row >= Rows)
+        {
+            return;
+        }
+        uint8_t col = 0;
+        for (; col < Cols && text[col] != '\0'; col++)
+        {
+            target[row][col] = text[col];
+        }
+        for (; col < Cols; col++)
+        {
+            target[row][col] = ' ';
+        }
+    }
+
+    // Writes text at a position without touching the rest of the row.
+    void write(uint8_t col, uint8_t row, const char *text)
+    {
+        for (; row < Rows && col < Cols && *text != '\0'; col++)
+        {
+            target[row][col] = *text++;
+        }
+    }
+
+    // True if the display does not show the framebuffer yet.
+    bool dirty() const { return memcmp(target, shown, sizeof(target)) != 0; }
+
+    // Forgets what the display shows, e.g. after it was cleared or re-initialized.
+    void invalidate()
+    {
+        memset(shown, 0, sizeof(shown)); // Never equal to a printable character
+        cursorValid = false;
+    }
+
+    //
+    // Sends up to `maxCells` changed cells to `display`, which must provide
+    // setCursor(col, row) and write(char). Returns the number of cells written.
+    //
+    template <typename Display>
+    size_t flush(Display &display, size_t maxCells)
+    {
+        size_t written = 0;
+        for (uint8_t row = 0; row < Rows; row++)
+        {
+            for (uint8_t col = 0; col < Cols; col++)
+            {
+                if (target[row][col] == shown[row][col])
+                {
+                    continue;
+                }
+                if (written == maxCells)
+                {
+                    return written;
+                }
+                if (!cursorValid || cursorRow != row || cursorCol != col)
+                {
+                    display.setCursor(col, row);
+                }
+                display.write((uint8_t)target[row][col]);
+                shown[row][col] = target[row][col];
+                written++;
+
+                // The display advances its cursor after each character.
+                cursorValid = col + 1 < Cols;
+                cursorRow = row;
+                cursorCol = col + 1;
+            }
+        }
+        return written;
+    }
+
+private:
+    char target[Rows][Cols]; // Content to display
+    char shown[Rows][Cols];  // Content the display currently shows
+    bool cursorValid = false;
+    uint8_t cursorRow = 0;
+    uint8_t cursorCol = 0;
+};
@@ -0,0 +1,140 @@
+//
+// Greedy surplus scheduler for multiple loads.
+//
+
+#include "load_scheduler.h"
+
+int LoadScheduler::addChannel(uint16_t power, uint8_t priority, int32_t threshold, uint32_t holdTime)
+{
+    if (channelCount >= MAX_CHANNELS)
+    {
+        return -1;
+    }
+    uint8_t index = channelCount++;
+    channels[index] = {power, priority, threshold, holdTime, false, false, false, 0};
+
+    // Insert into the priority order; equal priorities keep the table order.
+    uint8_t position = index;
+    while (position > 0 && channels[order[position - 1]].priority > priority)
+    {
+        order[position] = order[position - 1];
+        position--;
+    }
+    order[position] = index;
+    return index;
+}
+
+int LoadScheduler::update(int32_t power, uint32_t timestamp)
+{
+    // The measured surplus already has the draw of the running loads taken off.
+    int32_t available = power + onPower();
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        Channel &channel = channels[order[i]];
+        channel.allocated = available - channel.power >= channel.threshold;
+        if (channel.allocated)
+        {
+            available -= channel.power;
+        }
+
+        bool differs = channel.allocated != channel.on;
+        if (differs && !channel.pending)
+        {
+            channel.pendingStart = timestamp;
+        }
+        channel.pending = differs;
+    }
+
+    // Shed load first, lowest priority first; then add load, highest priority first.
+    for (uint8_t i = channelCount; i-- > 0;)
+    {
+        const Channel &channel = channels[order[i]];
+        if (channel.pending && channel.on && timestamp - channel.pendingStart >= channel.holdTime)
+        {
+            return order[i];
+        }
+    }
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        const Channel &channel = channels[order[i]];
+        if (channel.pending && !channel.on && timestamp - channel.pendingStart >= channel.holdTime)
+        {
+            return order[i];
+        }
+    }
+    return -1;
+}
+
+void LoadScheduler::setState(uint8_t channel, bool on, uint32_t timestamp)
+{
+    channels[channel].on = on;
+
+    // The surplus changes with the switch: every other pending switch waits
+    // its hold time again, based on measurements that include this step.
+    restart(timestamp);
+}
+
+void LoadScheduler::restart(uint32_t timestamp)
+{
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        channels[i].pending = channels[i].allocated != channels[i].on;
+        channels[i].pendingStart = timestamp;
+    }
+}
+
+void LoadScheduler::reset()
+{
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        channels[i].allocated = channels[i].on;
+        channels[i].pending = false;
+    }
+}
+
+bool LoadScheduler::switchPending() const
+{
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        if (channels[i].pending)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int32_t LoadScheduler::onPower() const
+{
+    int32_t total = 0;
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        if (channels[i].on)
+        {
+            total += channels[i].power;
+        }
+    }
+    return total;
+}
+
+uint32_t LoadScheduler::remainingTime(uint32_t currentTime) const
+{
+    uint32_t remaining = 0;
+    bool found = false;
+    for (uint8_t i = 0; i < channelCount; i++)
+    {
+        const Channel &channel = channels[i];
+        if (!channel.pending)
+        {
+            continue;
+        }
+        uint32_t elapsed = currentTime - channel.pendingStart;
+        uint32_t left = elapsed >= channel.holdTime ? 0 : channel.holdTime - elapsed;
+        if (!found || left < remaining)
+        {
+            remaining = left;
+            found = true;
+        }
+    }
+    return remaining;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Greedy allocation of the surplus power over several switchable loads.
+//
+// Every load (relay channel) has a nominal power draw, a priority, a
+// threshold and a hold time. On each update the power available to the
+// loads (the measured surplus plus the draw of the loads that are on) is
+// handed out in priority order: a load gets its share when the power left
+// after its draw is at least its threshold. A load whose allocation differs
+// from its state switches once that has held for its hold time, and only
+// one load switches per update, so the meter can show the effect of each
+// step before the next one is taken.
+//
+class LoadScheduler
+{
+public:
+    static const uint8_t MAX_CHANNELS = 8;
+
+    // Adds a load drawing `power` (W). Lower `priority` values are served first.
+    // `threshold` is the surplus (W) that must remain with the load on.
+    // Returns the channel index, or -1 if the table is full.
+    int addChannel(uint16_t power, uint8_t priority, int32_t threshold, uint32_t holdTime);
+
+    // Feeds the surplus `power` (W) measured at `timestamp` (ms). Returns the
+    // channel that should toggle now, or -1 if none.
+    int update(int32_t power, uint32_t timestamp);
+
+    // Records the state of a channel after its relay was switched.
+    void setState(uint8_t channel, bool on, uint32_t timestamp);
+
+    // Restarts the hold time of the pending switches at `timestamp` (ms), e.g.
+    // after a relay outside the table changed the surplus.
+    void restart(uint32_t timestamp);
+
+    // Forgets pending switches, e.g. after the loads were forced off.
+    void reset();
+
+    uint8_t count() const { return channelCount; }
+    bool isOn(uint8_t channel) const { return channels[channel].on; }
+    bool isAllocated(uint8_t channel) const { return channels[channel].allocated; }
+    bool switchPending() const;
+
+    // Power (W) drawn by the loads that are on.
+    int32_t onPower() const;
+
+    // Time (ms) until the next pending switch happens, 0 if none is pending.
+    uint32_t remainingTime(uint32_t currentTime) const;
+
+private:
+    struct Channel
+    {
+        uint16_t power;
+        uint8_t priority;
+        int32_t threshold;
+        uint32_t holdTime;
+        bool on;
+        bool allocated;        // Given a share of the surplus in the last update
+        bool pending;          // State and allocation differ
+        uint32_t pendingStart; // Timestamp at which they started to differ
+    };
+
+    Channel channels[MAX_CHANNELS];
+    uint8_t order[MAX_CHANNELS]; // Channel indices sorted by priority
+    uint8_t channelCount = 0;
+};
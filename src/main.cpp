@@ -4,40 +4,194 @@
 //
 // Core Functionality:
 //   Monitors power consumption via HTTP requests to an API endpoint
+//   Pluggable meter sources (HTTP, push stream, shared, Modbus TCP, CT) with priority-ordered failover
+//   Relays switched off when the last sample is too old
 //   Controls charging signal based on power thresholds
-//   Implements a hysteresis timer to prevent rapid switching
+//   Optional hourly charge plan from a daily PV forecast, biasing the thresholds
+//   Pluggable switching policy (hysteresis or smoothed, trend-aware) to prevent rapid switching
+//   Switching logic behind a hardware interface, replayable on the PC (native environment)
 //
 // Main Components:
-//   WiFi connectivity with automatic reconnection
-//   HTTP client for fetching power data
-//   JSON parsing for API responses
+//   WiFi connectivity with non-blocking reconnection and exponential backoff
+//   Keep-alive HTTP client for fetching power data
+//   Background meter task feeding samples through a lock-free queue
+//   Optional sharing of meter samples between controllers over UDP multicast
+//   Optional local CT clamp measurement, sampled by DMA
+//   Power history with rolling statistics
+//   Per-stage latency instrumentation
+//   Heap, stack high-water and per-subsystem allocation instrumentation
+//   Diff-based LCD framebuffer, flushed incrementally outside the control path
+//   Diagnostic LCD pages stepped through with a push button or rotary encoder
+//   Adaptive measurement interval, fast near a switching decision
+//   Fast boot: relay state restored from NVS, networking brought up in the background
+//   Runtime configuration in NVS, tunable over the serial console, DIP switches as presets
+//   Allocation-free streaming JSON parsing for API responses
+//   Batched MQTT telemetry with offline buffering
+//   Days of sample history in a wear-levelled flash log
+//   Daily energy accounting (diverted, exported, switch-ons, duty cycle) kept in NVS
+//   Non-blocking HTTP endpoint with Prometheus metrics
 //   Digital output control for charging signal
+//   Additional loads on relay channels, staged greedily by priority from the remaining surplus
+//   Remote relay nodes switched over ESP-NOW
+//   Optional modem or light sleep between measurements, relay outputs latched
+//   Firmware updates over the air from full or delta packages, relays held meanwhile
 //
 
+#include "charge_controller.h" // Charger and load switching logic
+#include "charge_plan.h"       // Forecast-based charge plan
 #include "config.h"            // Project configuration constants
+#include "display_pages.h"     // Diagnostic LCD pages
+#include "ct_sensor.h"         // Local CT clamp measurement
+#include "energy_account.h"    // Diverted and exported energy per day
+#include "forecast_client.h"   // Daily PV forecast download
+#include "history_log.h"       // Sample history in flash
+#include "lcd_framebuffer.h"   // Diff-based LCD rendering
+#include "load_scheduler.h"    // Surplus allocation over additional loads
+#include "mem_stats.h"         // Heap, stack and allocation instrumentation
+#include "meter_adapters.h"    // Meter sources on top of the protocol clients
+#include "meter_sample.h"      // Decoded meter measurements
+#include "meter_source.h"      // Priority-ordered meter sources
+#include "perf_stats.h"        // Per-stage latency histograms
+#include "persist.h"           // State kept in NVS across reboots
+#include "relay_link.h"        // ESP-NOW link to remote relay nodes
+#include "poll_scheduler.h"    // Adaptive measurement interval
+#include "power_save.h"        // Modem and light sleep between measurements
+#include "meter_client.h"      // Keep-alive HTTP client for the meter API
+#include "meter_push.h"        // WebSocket push stream from the meter
+#include "meter_share.h"       // Meter samples shared between controllers
+#include "modbus_client.h"     // Modbus TCP register reads
+#include "mqtt_publisher.h"    // Batched MQTT telemetry
+#include "nav_input.h"         // Push button and rotary encoder
+#include "ota_update.h"        // Firmware update from a package server
+#include "rolling_stats.h"     // Power history and rolling statistics
+#include "runtime_config.h"    // Thresholds and policy settings stored in NVS
 #include "secrets.h"           // WiFi credentials and API configuration
-#include <ArduinoJson.h>       // JSON parsing for API responses
-#include <HTTPClient.h>        // HTTP client for API requests
+#include "spsc_queue.h"        // Lock-free queue between meter task and loop()
+#include "status_server.h"     // HTTP metrics endpoint
+#include "switch_policy.h"     // Charger switching policies
+#include "wifi_manager.h"      // Non-blocking WiFi reconnection
 #include <LiquidCrystal_I2C.h> // LCD display control
+#include <atomic>              // Poll interval shared with the meter task
+#include <esp_timer.h>         // Hysteresis deadline timer
 #include <WiFi.h>              // WiFi connectivity
 #include <Wire.h>              // I2C communication for LCD
 
-float POWER_THRESHOLD = 1000.0;      // Default power threshold in watts
-unsigned long HYSTERESIS_TIME = 120000UL; // Default hysteresis time in milliseconds (120s)
+// Settings loaded from NVS in setup() and applied to the controller
+RuntimeConfig runtimeConfig;
 
 // Initialize 16x2 I2C LCD display for user interface
 LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
 
+// WiFi connection state machine
+WifiManager wifiManager;
+
+// Persistent connection to the P1 meter, reused across measurements
+MeterClient meterClient;
+
+// Real-time measurement stream from the meter (METER_SOURCE_PUSH)
+MeterPushClient meterPush;
+
+// Samples shared with other controllers (METER_SHARE_MODE) or received from them (METER_SOURCE_SHARED)
+MeterShare meterShare;
+
+// Inverter or meter read over Modbus TCP (METER_SOURCE_MODBUS)
+ModbusClient modbusClient;
+
+// Local CT clamp measurement (METER_SOURCE_CT)
+CtSensor ctSensor;
+
+// Telemetry posted by loop() and published from the meter task (when MQTT_ENABLED)
+MqttPublisher mqttPublisher;
+
+// Samples handed from the meter task (producer) to loop() (consumer)
+SpscQueue<MeterSample, METER_QUEUE_SIZE> sampleQueue;
+
+// Poll interval chosen by loop() and used by the meter task
+PollScheduler pollScheduler;
+std::atomic<unsigned long> pollInterval{MEASUREMENT_INTERVAL};
+TaskHandle_t meterTaskHandle = nullptr;
+TaskHandle_t loopTaskHandle = nullptr; // Woken by the meter task when a sample is queued
+
+// The sources of METER_SOURCES, serviced by the meter task in priority order
+HttpMeterSource httpSource(meterClient, pollInterval);
+PushMeterSource pushSource(meterPush, meterClient, meterToken);
+SharedMeterSource sharedSource(meterShare);
+ModbusMeterSource modbusSource(modbusClient, pollInterval);
+CtMeterSource ctSource(ctSensor);
+MeterSourceSet meterSources;
+unsigned long lastSampleTime = 0; // Timestamp of the last sample received by loop(), for the staleness watchdog
+bool sampleStale = false;         // Whether the last sample is too old to act on
+unsigned long staleCount = 0;     // Times the samples went stale
+
+// Daily PV forecast, fetched by the meter task and planned by loop() (when FORECAST_ENABLED)
+ForecastClient forecastClient;
+SpscQueue<SolarForecast, 2> forecastQueue;
+std::atomic<uint16_t> forecastDay{0}; // Local date of the forecast in use, 0 for none
+unsigned long lastForecastAttempt = 0;
+bool forecastAttempted = false;
+SolarForecast solarForecast = {}; // The forecast the charge plan was built from
+ChargePlan chargePlan;
+unsigned long lastPlanCheck = 0;
+
+// Energy counters of the day and totals of the closed days, kept in NVS
+EnergyAccount energyAccount(ENERGY_MAX_GAP);
+unsigned long lastEnergySave = 0;
+const int ACCOUNTED_CHANNELS = 1 + LOAD_CHANNEL_COUNT < ENERGY_CHANNELS ? 1 + LOAD_CHANNEL_COUNT : ENERGY_CHANNELS;
+
+// Firmware updates, checked every OTA_CHECK_INTERVAL (when OTA_ENABLED) or with the `update` command
+OtaUpdater otaUpdater;
+unsigned long lastUpdateCheck = 0;
+
+// One-shot timer at the next hysteresis deadline, on the 64-bit microsecond esp_timer clock
+esp_timer_handle_t switchTimer = nullptr;
+bool switchTimerArmed = false;
+uint32_t switchDeadline = 0;      // millis() at which the armed deadline is due
+int64_t switchDeadlineMicros = 0; // esp_timer_get_time() at which the armed deadline is due
+
+// Recent samples and rolling statistics of the surplus power
+SampleRing<MeterSample, POWER_HISTORY_SIZE> powerHistory;
+RollingStats<POWER_HISTORY_SIZE> shortPowerStats(STATS_SHORT_WINDOW);
+RollingStats<POWER_HISTORY_SIZE> longPowerStats(STATS_LONG_WINDOW);
+
 // Global state variables
-bool chargerOn = false;                // Tracks the current state of the charger (on/off)
-unsigned long lastSwitchTime = 0;      // Timestamp of the last time the charger was switched on or off
-unsigned long lastMeasurementTime = 0; // Timestamp of the last power measurement
-unsigned long powerHighStartTime = 0;  // Timestamp when power first exceeded the threshold
-unsigned long powerLowStartTime = 0;   // Timestamp when power first dropped below the threshold
+unsigned long lastPerfReportTime = 0;  // Timestamp of the last instrumentation report
+bool firstDecisionDone = false;        // Whether a measurement has been acted on since boot
+
+// Metrics endpoint for monitoring (when HTTP_SERVER_ENABLED)
+StatusServer statusServer;
 
-// LCD display buffers to track what's currently shown
-char lcdLine0[LCD_COLS + 1] = "";
-char lcdLine1[LCD_COLS + 1] = "";
+// Sample history kept in flash across reboots
+HistoryLog historyLog;
+
+// Additional loads from the LOAD_CHANNELS table, switched on the surplus left by the charger
+static_assert(LOAD_CHANNEL_COUNT <= (int)(sizeof(LOAD_CHANNELS) / sizeof(LOAD_CHANNELS[0])),
+              "LOAD_CHANNEL_COUNT exceeds the LOAD_CHANNELS table");
+// Remote relay nodes for loads with a `node` (when RELAY_NODE_COUNT > 0)
+RelayLink relayLink;
+
+//
+// The hardware behind the control core: millis(), the relay outputs, NVS and telemetry.
+//
+class DeviceHal : public Hal
+{
+public:
+    uint32_t millis() override { return ::millis(); }
+    void setRelay(uint8_t channel, bool on, uint32_t timestamp) override;
+};
+DeviceHal deviceHal;
+
+// Charger and load switching; the runtime configuration selects the policy in setup()
+ChargeController controller(deviceHal);
+
+// LCD framebuffer; only changed cells are sent to the display
+LcdFramebuffer<LCD_COLS, LCD_ROWS> lcdFrame;
+
+// LCD page shown, selected with the button or encoder, and the values the pages show
+NavInput navInput;
+DisplayPage displayPage = PAGE_STATUS;
+DisplayState displayState = {};
+unsigned long lastNavInput = 0;   // Time of the last button press or encoder detent
+unsigned long lastPageRender = 0; // Time the diagnostic page was last drawn
 
 //
 // Handles WiFi events like connection and disconnection.
@@ -52,10 +206,9 @@ void WiFiEvent(WiFiEvent_t event)
         Serial.print("WiFi connected. IP address: ");
         Serial.println(WiFi.localIP());
         break;
-    // If the ESP32 loses connection, it will attempt to reconnect.
+    // Reconnection is handled by wifiManager from loop().
     case SYSTEM_EVENT_STA_DISCONNECTED:
-        Serial.println("WiFi lost connection. Reconnecting...");
-        WiFi.begin(ssid, password);
+        Serial.println("WiFi disconnected.");
         break;
     default:
         break;
@@ -63,185 +216,1068 @@ void WiFiEvent(WiFiEvent_t event)
 }
 
 //
-// Fetches the current solar power generation from the API endpoint.
+// Queues a measurement for the control loop.
 //
-bool getSolarPower(int &power)
+void queueSample(const MeterSample &sample)
 {
-    // Check for WiFi connection before making an HTTP request.
-    if (WiFi.status() != WL_CONNECTED)
+    if (METER_SHARE_MODE == METER_SHARE_PUBLISH)
     {
-        Serial.println("WiFi not connected. Skipping measurement.");
-        return false;
+        meterShare.publish(sample); // Other controllers use this sample instead of polling.
+    }
+    if (!sampleQueue.push(sample))
+    {
+        Serial.println("Sample queue full. Dropping measurement.");
+    }
+    else if (loopTaskHandle != nullptr)
+    {
+        xTaskNotifyGive(loopTaskHandle); // Wake loop() for the new sample.
+    }
+}
+
+//
+// True if `type` is listed in METER_SOURCES.
+//
+bool meterSourceUsed(MeterSourceType type)
+{
+    for (int i = 0; i < METER_SOURCE_COUNT; i++)
+    {
+        if (METER_SOURCES[i] == type)
+        {
+            return true;
+        }
     }
+    return false;
+}
 
-    HTTPClient http;
-    http.begin(apiUrl);                // Initialize HTTP client with the API URL.
-    int httpResponseCode = http.GET(); // Send a GET request.
+//
+// The source object of each METER_SOURCES entry.
+//
+MeterSource &meterSource(MeterSourceType type)
+{
+    switch (type)
+    {
+    case METER_SOURCE_PUSH:
+        return pushSource;
+    case METER_SOURCE_SHARED:
+        return sharedSource;
+    case METER_SOURCE_MODBUS:
+        return modbusSource;
+    case METER_SOURCE_CT:
+        return ctSource;
+    default:
+        return httpSource;
+    }
+}
 
-    // Check if the request was successful.
-    if (httpResponseCode == 200)
+//
+// The local time per TIME_ZONE, once the clock has been set over NTP.
+//
+bool localTime(struct tm &local)
+{
+    time_t now = time(nullptr);
+    return now >= (time_t)MIN_VALID_TIME && localtime_r(&now, &local) != nullptr;
+}
+
+//
+// Fetches the PV forecast of the day when none is in use, retrying failures
+// every FORECAST_RETRY_INTERVAL, and hands it to loop(). Runs in the meter
+// task, which may block on the network.
+//
+void fetchForecast(unsigned long currentTime)
+{
+    struct tm local;
+    if (!localTime(local) || WiFi.status() != WL_CONNECTED)
     {
-        JsonDocument doc;
-        // Parse the JSON response from the HTTP stream.
-        DeserializationError error = deserializeJson(doc, http.getStream());
-        if (error)
+        return;
+    }
+    int year = local.tm_year + 1900;
+    int month = local.tm_mon + 1;
+    if (forecastDay.load() == dayNumber(year, month, local.tm_mday) ||
+        (forecastAttempted && currentTime - lastForecastAttempt < FORECAST_RETRY_INTERVAL))
+    {
+        return;
+    }
+    lastForecastAttempt = currentTime;
+    forecastAttempted = true;
+    SolarForecast forecast;
+    if (forecastClient.fetch(forecastUrl, year, month, local.tm_mday, forecast))
+    {
+        forecastQueue.push(forecast);
+    }
+}
+
+//
+// Background task that feeds meter samples to the control loop.
+// Runs on the core not used by loop(), so a slow or unreachable meter never stalls the control loop.
+// The samples of the first fresh source in METER_SOURCES are used; the sources below it are only
+// polled while it is stale, at the interval chosen by the poll scheduler.
+//
+void meterTask(void *parameter)
+{
+    int activeSource = -1; // Reported when it changes
+    for (;;)
+    {
+        meterSources.service(millis(), queueSample); // Delivers the samples through queueSample().
+
+        int active = meterSources.active(millis());
+        if (active != activeSource)
+        {
+            activeSource = active;
+            Serial.printf("Meter source: %s\n", active >= 0 ? meterSources.source(active).name() : "none");
+        }
+
+        if (MQTT_ENABLED)
+        {
+            MemScope scope(MEM_MQTT);
+            mqttPublisher.service(millis()); // Publishes the telemetry posted by loop().
+        }
+
+        if (FORECAST_ENABLED)
+        {
+            MemScope scope(MEM_FORECAST);
+            fetchForecast(millis()); // Once a day.
+        }
+
+        // Sleep until a source is due, or until loop() shortens the interval.
+        unsigned long wait = meterSources.serviceDelay(millis());
+        if (wait > MEASUREMENT_INTERVAL_IDLE)
+        {
+            wait = MEASUREMENT_INTERVAL_IDLE; // No source is polled.
+        }
+        if (MQTT_ENABLED && wait > MQTT_SERVICE_PERIOD)
         {
-            Serial.print("deserializeJson() failed: ");
-            Serial.println(error.c_str());
-            http.end();
-            return false;
+            wait = MQTT_SERVICE_PERIOD; // Keep the broker connection alive.
         }
-        // Extract the power value and negate it to represent solar generation.
-        power = -doc["active_power_w"].as<int>();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
     }
-    else
+}
+
+//
+// Posts a switch event of relay `channel` (0 the charger, 1 + i load i) for MQTT.
+//
+void publishSwitch(uint8_t channel, bool on, unsigned long currentTime)
+{
+    if (MQTT_ENABLED)
     {
-        Serial.print("HTTP response error: ");
-        Serial.println(httpResponseCode);
-        http.end();
-        return false;
+        mqttPublisher.post({(uint32_t)currentTime, controller.switchPolicy().decisionPower(), TELEMETRY_SWITCH,
+                            channel, on});
     }
+}
 
-    http.end(); // Free resources.
-    return true;
+//
+// Posts a sample with the relay states for MQTT.
+//
+void publishSample(const MeterSample &sample)
+{
+    if (MQTT_ENABLED)
+    {
+        mqttPublisher.post({sample.timestamp, sample.power, TELEMETRY_SAMPLE, 0, controller.relayStates()});
+    }
 }
 
-void turnChargerOn(unsigned long currentTime)
+//
+// Appends a sample to the flash history once the clock has been set.
+//
+void logSample(const MeterSample &sample)
 {
-    if (powerHighStartTime == 0)
+    time_t now = time(nullptr);
+    if (!historyLog.ready() || now < (time_t)MIN_VALID_TIME)
     {
-        powerHighStartTime = currentTime; // Start the timer
+        return;
     }
-    if (currentTime - powerHighStartTime >= HYSTERESIS_TIME)
+    // Date the sample by its age, as it may have waited in the queue.
+    uint32_t age = (millis() - sample.timestamp) / 1000;
+    historyLog.append({(uint32_t)now - age, sample.power, controller.switchPolicy().decisionPower(),
+                       controller.relayStates(), 0});
+}
+
+//
+// Switches a relay for the controller: the charger on RELAY_PIN, a load on
+// its pin or relay node.
+//
+void DeviceHal::setRelay(uint8_t channel, bool on, uint32_t timestamp)
+{
+    if (channel == 0)
+    {
+        writeRelayPin(RELAY_PIN, on);
+        saveRelayState(on); // Restored at the next boot.
+        Serial.println(on ? "Charger ON" : "Charger OFF");
+    }
+    else
+    {
+        const LoadChannelConfig &config = LOAD_CHANNELS[channel - 1];
+        if (config.node >= 0)
+        {
+            relayLink.setRelay(config.node, config.pin, on); // Delivered and confirmed by relayLink.service().
+        }
+        else
+        {
+            writeRelayPin(config.pin, on);
+        }
+        Serial.printf("Load %s %s\n", config.name, on ? "ON" : "OFF");
+    }
+    energyAccount.recordSwitch(channel, on);
+    publishSwitch(channel, on, timestamp);
+}
+
+//
+// Adds a sample to the power history and rolling statistics.
+//
+void recordSample(const MeterSample &sample)
+{
+    powerHistory.push(sample);
+    shortPowerStats.add(sample.power);
+    longPowerStats.add(sample.power);
+}
+
+//
+// Name of relay channel `channel` (0 the charger, 1 + i load i).
+//
+const char *channelName(uint8_t channel)
+{
+    return channel == 0 ? "charger" : LOAD_CHANNELS[channel - 1].name;
+}
+
+//
+// Prints the energy counters of the day to the serial monitor.
+//
+void printEnergy()
+{
+    uint32_t diverted = energyAccount.divertedToday();
+    uint32_t exported = energyAccount.exportedToday();
+    Serial.printf("Energy today: %lu.%03lu kWh diverted, %lu.%03lu kWh exported\n", (unsigned long)(diverted / 1000),
+                  (unsigned long)(diverted % 1000), (unsigned long)(exported / 1000), (unsigned long)(exported % 1000));
+    for (uint8_t channel = 0; channel < ACCOUNTED_CHANNELS; channel++)
     {
-        digitalWrite(RELAY_PIN, HIGH); // Turn on the relay.
-        chargerOn = true;
-        lastSwitchTime = currentTime;
-        powerLowStartTime = 0; // Reset the low power timer
-        Serial.println("Charger ON");
+        Serial.printf("  %s: %lu Wh, %u switch-ons, on %u%% of the time\n", channelName(channel),
+                      (unsigned long)energyAccount.divertedToday(channel), energyAccount.cyclesToday(channel),
+                      energyAccount.dutyCycle(channel));
     }
 }
 
-void turnChargerOff(unsigned long currentTime)
+//
+// Counts the energy up to `sample` with the relays it was measured with.
+// At local midnight the day is closed into the totals and stored.
+//
+void accountSample(const MeterSample &sample)
 {
-    if (powerLowStartTime == 0)
+    struct tm local;
+    if (localTime(local))
     {
-        powerLowStartTime = currentTime; // Start the timer
+        uint16_t day = dayNumber(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+        if (energyAccount.day() != 0 && day != energyAccount.day())
+        {
+            Serial.print("Day closed. ");
+            printEnergy();
+        }
+        if (energyAccount.startDay(day))
+        {
+            saveEnergyRecord(energyAccount.record());
+        }
     }
-    if (currentTime - powerLowStartTime >= HYSTERESIS_TIME)
+    energyAccount.add(sample.power, controller.relayStates(), sample.timestamp);
+}
+
+//
+// Stores the energy counters every ENERGY_SAVE_INTERVAL.
+//
+void serviceEnergy(unsigned long currentTime)
+{
+    if (currentTime - lastEnergySave >= ENERGY_SAVE_INTERVAL)
     {
-        digitalWrite(RELAY_PIN, LOW); // Turn off the relay.
-        chargerOn = false;
-        lastSwitchTime = currentTime;
-        powerHighStartTime = 0; // Reset the high power timer
-        Serial.println("Charger OFF");
+        lastEnergySave = currentTime;
+        saveEnergyRecord(energyAccount.record());
     }
 }
 
 //
 // Controls the charger relay based on the available solar power.
 //
-void controlCharger(int solarPower)
+void controlCharger(const MeterSample &sample)
 {
-    unsigned long currentTime = millis(); // Get the current time.
+    if (!firstDecisionDone)
+    {
+        firstDecisionDone = true;
+        Serial.printf("First measurement-based decision %lu ms after boot.\n", millis());
+        OtaUpdater::confirmRunning(); // An updated image that got this far is kept.
+    }
+
+    // The charger policy and the load scheduler switch through deviceHal.
+    if (controller.update(sample.power, sample.timestamp))
+    {
+        perfRecord(STAGE_SAMPLE_TO_RELAY, (millis() - sample.timestamp) * 1000UL);
+    }
 
-    if (!chargerOn)
+    // Poll faster while a decision is close, slower when far from the threshold.
+    unsigned long previousInterval = pollInterval.load();
+    unsigned long interval = pollScheduler.update(controller.switchPolicy().switchDistance(controller.chargerOn()),
+                                                  controller.switchPending(), sample.timestamp);
+    if (interval != previousInterval)
+    {
+        pollInterval.store(interval);
+        Serial.printf("Measurement interval: %lus\n", interval / 1000);
+        if (interval < previousInterval && meterTaskHandle != nullptr)
+        {
+            xTaskNotifyGive(meterTaskHandle); // Don't wait out the longer interval.
+        }
+    }
+}
+
+//
+// Sends a limited number of changed LCD cells to the display.
+// Called at the end of each loop() iteration, so a screen update is spread over
+// several iterations instead of delaying the next control decision.
+//
+void flushLCD()
+{
+    if (!lcdFrame.dirty())
+    {
+        return;
+    }
+    PerfTimer timer(STAGE_LCD_WRITE);
+    lcdFrame.flush(lcd, LCD_FLUSH_BUDGET);
+}
+
+//
+// Renders the page shown into the LCD framebuffer. The status page shows the
+// power and charger status, then the countdown or the hysteresis and
+// threshold; the other pages show displayState.
+//
+void renderDisplay(int32_t power)
+{
+    char lineBuffer[LCD_COLS + 1];
+    for (uint8_t row = 0; row < LCD_ROWS; row++)
     {
-        // Turn the charger on if there is enough surplus power and the condition has been met for the hysteresis time.
-        if (solarPower >= POWER_THRESHOLD)
+        if (displayPage == PAGE_STATUS)
         {
-            turnChargerOn(currentTime);
+            controller.formatDisplayLine(row, power, lineBuffer, sizeof(lineBuffer));
         }
         else
         {
-            powerHighStartTime = 0; // Reset the high power timer
+            formatPageLine(displayPage, row, displayState, lineBuffer, sizeof(lineBuffer));
         }
+        lcdFrame.setLine(row, lineBuffer);
     }
-    else
+}
+
+//
+// Copies the values of the diagnostic pages into displayState. Everything
+// is already in RAM; the WiFi driver is only asked for the signal strength.
+//
+void updateDisplayState(unsigned long currentTime)
+{
+    if (!powerHistory.empty())
     {
-        // Turn the charger off if the power drops below the threshold and the condition has been met for the hysteresis time.
-        if (solarPower < POWER_THRESHOLD)
+        const MeterSample &sample = powerHistory.recent(0);
+        displayState.phases = 0;
+        for (uint8_t phase = 0; phase < 3; phase++)
         {
-            turnChargerOff(currentTime);
+            displayState.phases |= sample.has(FIELD_POWER_L1 + phase) ? 1 << phase : 0;
+            displayState.phasePower[phase] = sample.phasePower[phase];
         }
-        else
+    }
+    displayState.divertedToday = energyAccount.divertedToday();
+    displayState.exportedToday = energyAccount.exportedToday();
+    displayState.wifiConnected = wifiManager.connected();
+    displayState.wifiOutage = wifiManager.outageDuration(currentTime) / 1000;
+    if (displayState.wifiConnected && displayPage == PAGE_NETWORK)
+    {
+        IPAddress address = WiFi.localIP();
+        displayState.rssi = WiFi.RSSI();
+        for (uint8_t i = 0; i < 4; i++)
         {
-            powerLowStartTime = 0; // Reset the low power timer
+            displayState.address[i] = address[i];
         }
     }
+    displayState.uptime = (uint32_t)(esp_timer_get_time() / 1000000);
+    displayState.freeHeap = memStats().freeHeap;
+    displayState.minFreeHeap = memStats().minFreeHeap;
+    displayState.staleCount = staleCount;
+    displayState.droppedCount = sampleQueue.droppedCount();
+    displayState.reconnectCount = wifiManager.reconnectCount();
+    displayState.failedAllocs = memStats().failedCount;
 }
 
 //
-// Updates a specific line on the LCD if the content has changed.
+// Follows the button or encoder through the pages and keeps a diagnostic
+// page current, redrawn every UI_REFRESH_INTERVAL. The status page returns
+// after UI_PAGE_TIMEOUT without input. Only the framebuffer is written;
+// flushLCD() sends the changed cells.
 //
-void updateLCDLine(int line, const char* text)
+void serviceDisplay(unsigned long currentTime)
 {
-    if (line == 0)
+    DisplayPage page = displayPage;
+    NavEvent event;
+    while ((event = navInput.read()) != NAV_NONE)
     {
-        if (strcmp(lcdLine0, text) != 0)
+        lastNavInput = currentTime;
+        if (event == NAV_NEXT)
         {
-            strncpy(lcdLine0, text, LCD_COLS);
-            lcdLine0[LCD_COLS] = '\0'; // Ensure null termination
-            lcd.setCursor(0, 0);
-            lcd.print(text);
-            // Clear the rest of the line if the new text is shorter
-            int len = strlen(text);
-            for (int i = len; i < LCD_COLS; i++)
-            {
-                lcd.print(' ');
-            }
+            page = (DisplayPage)((page + 1) % PAGE_COUNT);
         }
+        else if (event == NAV_PREVIOUS)
+        {
+            page = (DisplayPage)((page + PAGE_COUNT - 1) % PAGE_COUNT);
+        }
+        else
+        {
+            page = PAGE_STATUS;
+        }
+    }
+    if (page != PAGE_STATUS && currentTime - lastNavInput >= UI_PAGE_TIMEOUT)
+    {
+        page = PAGE_STATUS;
     }
-    else if (line == 1)
+
+    bool changed = page != displayPage;
+    displayPage = page;
+    if (page == PAGE_STATUS)
     {
-        if (strcmp(lcdLine1, text) != 0)
+        if (changed && !powerHistory.empty())
         {
-            strncpy(lcdLine1, text, LCD_COLS);
-            lcdLine1[LCD_COLS] = '\0'; // Ensure null termination
-            lcd.setCursor(0, 1);
-            lcd.print(text);
-            // Clear the rest of the line if the new text is shorter
-            int len = strlen(text);
-            for (int i = len; i < LCD_COLS; i++)
-            {
-                lcd.print(' ');
-            }
+            renderDisplay(powerHistory.recent(0).power);
+        }
+        else if (changed)
+        {
+            lcdFrame.setLine(0, "Starting...");
+            lcdFrame.setLine(1, "");
         }
+        return;
+    }
+    if (changed || currentTime - lastPageRender >= UI_REFRESH_INTERVAL)
+    {
+        lastPageRender = currentTime;
+        updateDisplayState(currentTime);
+        renderDisplay(0);
     }
 }
 
 //
 // Prints the current status of the system to the serial monitor and LCD.
 //
-void printStatus(int solarPower)
+void printStatus(const MeterSample &sample)
 {
+    int solarPower = sample.power;
     Serial.print("Solar panel power: ");
     Serial.print(solarPower);
+    Serial.print("W, Decision: ");
+    Serial.print(controller.switchPolicy().decisionPower());
     Serial.print("W, Charger: ");
-    Serial.println(chargerOn ? "ON" : "OFF");
+    Serial.println(controller.chargerOn() ? "ON" : "OFF");
+    Serial.printf("  Avg: %ldW (last %u), %ldW (last %u), range %ld..%ldW, stddev %ldW\n",
+                  (long)shortPowerStats.mean(), (unsigned)shortPowerStats.count(),
+                  (long)longPowerStats.mean(), (unsigned)longPowerStats.count(),
+                  (long)longPowerStats.min(), (long)longPowerStats.max(), (long)longPowerStats.stddev());
 
-    // Row 0: Power and Charger status
-    char line0Buffer[LCD_COLS + 1];
-    snprintf(line0Buffer, sizeof(line0Buffer), "P:%dW     C:%s", solarPower, chargerOn ? "On" : "Off");
-    updateLCDLine(0, line0Buffer);
+    // Per-phase readings, when the meter reports them (three-phase installs)
+    for (uint8_t phase = 0; phase < 3; phase++)
+    {
+        if (sample.has(FIELD_POWER_L1 + phase))
+        {
+            Serial.printf("  L%u: %ldW %d.%dV %d.%02dA\n", phase + 1, (long)sample.phasePower[phase],
+                          sample.voltage[phase] / 10, abs(sample.voltage[phase] % 10),
+                          sample.current[phase] / 100, abs(sample.current[phase] % 100));
+        }
+    }
 
-    // Row 1: Display countdown or Hysteresis and Threshold
-    bool showCountdown = chargerOn && solarPower < POWER_THRESHOLD && powerLowStartTime > 0;
-    unsigned long elapsedTime = millis() - powerLowStartTime;
+    // Load channel states, when additional loads are configured
+    const LoadScheduler &loads = controller.loads();
+    if (loads.count() > 0)
+    {
+        Serial.printf("  Loads (%ldW on):", (long)loads.onPower());
+        for (uint8_t i = 0; i < loads.count(); i++)
+        {
+            Serial.printf(" %s=%s%s", LOAD_CHANNELS[i].name, loads.isOn(i) ? "ON" : "OFF",
+                          loads.isOn(i) != loads.isAllocated(i) ? "*" : "");
+        }
+        Serial.println();
+    }
+
+    renderDisplay(solarPower);
+}
+
+//
+// Called by esp_timer at a hysteresis deadline. The switch itself is made in loop().
+//
+void onSwitchDeadline(void *argument)
+{
+    xTaskNotifyGive(loopTaskHandle);
+}
+
+//
+// Makes the switches whose hysteresis time has run out and keeps the switch
+// timer on the next deadline, so a relay switches when its time is up rather
+// than at the next sample. A contrary sample clears the pending switch, which
+// stops the timer. Between samples the LCD countdown is kept current.
+//
+void serviceSwitchDeadline(unsigned long currentTime)
+{
+    if (controller.switchPending() && controller.remainingTime(currentTime) == 0 &&
+        controller.expire(currentTime) && switchTimerArmed)
+    {
+        perfRecord(STAGE_SWITCH_DEADLINE, (uint32_t)(esp_timer_get_time() - switchDeadlineMicros));
+    }
 
-    if (showCountdown && elapsedTime < HYSTERESIS_TIME)
+    bool pending = controller.switchPending();
+    uint32_t deadline = currentTime + controller.remainingTime(currentTime);
+    if (pending != switchTimerArmed || (pending && deadline != switchDeadline))
+    {
+        esp_timer_stop(switchTimer);
+        switchTimerArmed = pending;
+        switchDeadline = deadline;
+        if (pending)
+        {
+            uint64_t timeout = (uint64_t)(deadline - currentTime) * 1000ULL;
+            switchDeadlineMicros = esp_timer_get_time() + (int64_t)timeout;
+            esp_timer_start_once(switchTimer, timeout > 0 ? timeout : 1);
+        }
+    }
+
+    if (pending && !powerHistory.empty())
+    {
+        renderDisplay(powerHistory.recent(0).power); // Only changed cells reach the display.
+    }
+}
+
+//
+// Keeps the relays in a safe state while no measurements arrive. Without a
+// sample within the sample interval of the active source (its poll interval,
+// or the stale timeout of a stream) plus SAMPLE_STALE_TIMEOUT the surplus is
+// unknown, whichever source failed: the charger and the loads are switched
+// off and pending switches are dropped, counted from boot so a restored
+// relay state is not kept without measurements either.
+//
+void checkSampleAge(unsigned long currentTime)
+{
+    unsigned long age = currentTime - lastSampleTime;
+    bool stale = age >= meterSources.sampleInterval(currentTime) + SAMPLE_STALE_TIMEOUT;
+    if (stale && (controller.relayStates() != 0 || controller.switchPending()))
+    {
+        Serial.printf("No measurement for %lus. Switching the charger and loads off until measurements resume.\n",
+                      age / 1000);
+        controller.switchAllOff();
+    }
+    if (stale && !sampleStale)
+    {
+        staleCount++;
+    }
+    if (stale && displayPage == PAGE_STATUS)
     {
-        unsigned long remainingTime = (HYSTERESIS_TIME - elapsedTime) / 1000;
         char line1Buffer[LCD_COLS + 1];
-        snprintf(line1Buffer, sizeof(line1Buffer), "Off in: %lus", remainingTime);
-        updateLCDLine(1, line1Buffer);
+        snprintf(line1Buffer, sizeof(line1Buffer), "No data: %lus", age / 1000);
+        lcdFrame.setLine(1, line1Buffer);
+    }
+    sampleStale = stale;
+}
+
+//
+// Keeps the LCD informative while WiFi is down. The relays are kept safe by
+// checkSampleAge(), as sources without WiFi (the CT) may still deliver.
+//
+void handleWiFiOutage(unsigned long currentTime)
+{
+    if (displayPage != PAGE_STATUS)
+    {
+        return; // The network page shows the outage.
+    }
+    unsigned long outage = wifiManager.outageDuration(currentTime);
+    char line1Buffer[LCD_COLS + 1];
+    snprintf(line1Buffer, sizeof(line1Buffer), "No WiFi: %lus", outage / 1000);
+    lcdFrame.setLine(1, line1Buffer);
+}
+
+//
+// Builds the charge plan from solarForecast for the current threshold.
+//
+void planForecast()
+{
+    chargePlan.build(solarForecast, controller.threshold(), CHARGER_POWER, FORECAST_CHARGE_TARGET,
+                     FORECAST_BASE_LOAD, FORECAST_MAX_BIAS);
+    forecastDay.store(solarForecast.day);
+    Serial.printf("Charge plan: %u h, %lu Wh forecast surplus, hours:", chargePlan.plannedHours(),
+                  (unsigned long)chargePlan.plannedEnergy());
+    for (uint8_t hour = 0; hour < 24; hour++)
+    {
+        if (chargePlan.planned(hour))
+        {
+            Serial.printf(" %u (%ldW)", hour, (long)chargePlan.bias(hour));
+        }
+    }
+    Serial.println();
+}
+
+//
+// Sets the threshold bias of the current local hour; none without a plan for today.
+//
+void applyChargePlan()
+{
+    struct tm local;
+    int32_t bias = 0;
+    if (localTime(local) &&
+        chargePlan.covers(dayNumber(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday)))
+    {
+        bias = chargePlan.bias(local.tm_hour);
+    }
+    if (bias != controller.thresholdBias())
+    {
+        controller.setThresholdBias(bias);
+        Serial.printf("Charge plan: threshold %ldW\n", (long)controller.effectiveThreshold());
+    }
+}
+
+//
+// Plans a newly fetched forecast, stored in NVS for reboots, and follows
+// the plan hour by hour. The bias is a table lookup, checked once every
+// FORECAST_PLAN_CHECK.
+//
+void serviceChargePlan(unsigned long currentTime)
+{
+    bool replanned = false;
+    while (forecastQueue.pop(solarForecast))
+    {
+        saveSolarForecast(solarForecast);
+        planForecast();
+        replanned = true;
+    }
+    if (replanned || currentTime - lastPlanCheck >= FORECAST_PLAN_CHECK)
+    {
+        lastPlanCheck = currentTime;
+        applyChargePlan();
+    }
+}
+
+//
+// Checks for a firmware update every OTA_CHECK_INTERVAL and restarts into
+// an installed one. While an update is written the LCD shows its progress.
+//
+void serviceUpdate(unsigned long currentTime)
+{
+    if (otaUpdater.active())
+    {
+        if (displayPage == PAGE_STATUS)
+        {
+            char line1Buffer[LCD_COLS + 1];
+            snprintf(line1Buffer, sizeof(line1Buffer), "Updating: %u%%", otaUpdater.progress());
+            lcdFrame.setLine(1, line1Buffer);
+        }
+        return;
+    }
+    if (otaUpdater.readyToRestart())
+    {
+        // Keep the relays as they are until setup() of the new image takes them over.
+        historyLog.sync();
+        saveEnergyRecord(energyAccount.record());
+        holdRelayPin(RELAY_PIN);
+        for (int i = 0; i < LOAD_CHANNEL_COUNT; i++)
+        {
+            if (LOAD_CHANNELS[i].node < 0)
+            {
+                holdRelayPin(LOAD_CHANNELS[i].pin);
+            }
+        }
+        lcdFrame.setLine(1, "Restarting...");
+        lcdFrame.flush(lcd, LCD_COLS * LCD_ROWS);
+        Serial.println("Restarting into the new firmware.");
+        Serial.flush();
+        ESP.restart();
+    }
+    if (OTA_ENABLED && wifiManager.connected() && currentTime - lastUpdateCheck >= OTA_CHECK_INTERVAL)
+    {
+        lastUpdateCheck = currentTime;
+        otaUpdater.start(otaUrl);
+    }
+}
+
+//
+// Reads the DIP switches using bitwise operations for efficiency.
+//
+int readDipSwitches()
+{
+    return (digitalRead(DIP_PIN_1) == HIGH ? 4 : 0) |
+           (digitalRead(DIP_PIN_2) == HIGH ? 2 : 0) |
+           (digitalRead(DIP_PIN_3) == HIGH ? 1 : 0);
+}
+
+//
+// Applies the runtime configuration to the switching policies.
+//
+void applyRuntimeConfig()
+{
+    controller.configure(runtimeConfig);
+    if (FORECAST_ENABLED && solarForecast.version == SOLAR_FORECAST_VERSION)
+    {
+        planForecast(); // The biases depend on the threshold.
+        applyChargePlan();
+    }
+}
+
+//
+// Prints the runtime configuration to the serial monitor and, with remote
+// configuration, publishes it.
+//
+void printRuntimeConfig()
+{
+    char text[128];
+    runtimeConfigFormat(runtimeConfig, text, sizeof(text));
+    Serial.printf("Config: %s\n", text);
+    if (MQTT_ENABLED && MQTT_CONFIG_ENABLED)
+    {
+        mqttPublisher.postConfig(true, text);
+    }
+}
+
+//
+// Stores a changed runtime configuration and switches with it.
+//
+void commitRuntimeConfig()
+{
+    saveRuntimeConfig(runtimeConfig);
+    applyRuntimeConfig(); // Restarts the switching policy with the new settings.
+    printRuntimeConfig();
+}
+
+//
+// Applies the configuration messages received over MQTT. A message is only
+// applied if all of its settings are valid; the new configuration is then
+// stored and published, a rejection answered with its reason.
+//
+void serviceRemoteConfig()
+{
+    char text[MQTT_CONFIG_SIZE + 1];
+    bool complete;
+    while (mqttPublisher.receiveConfig(text, sizeof(text), complete))
+    {
+        char error[MQTT_CONFIG_SIZE + 32];
+        RuntimeConfig changed = runtimeConfig;
+        if (!complete)
+        {
+            snprintf(error, sizeof(error), "message longer than %d characters", MQTT_CONFIG_SIZE);
+        }
+        else if (runtimeConfigSetPairs(changed, text, error, sizeof(error)))
+        {
+            Serial.println("Configuration changed over MQTT.");
+            runtimeConfig = changed;
+            commitRuntimeConfig();
+            continue;
+        }
+        Serial.printf("Configuration message rejected: %s\n", error);
+        mqttPublisher.postConfig(false, error);
+    }
+}
+
+//
+// Prints `count` logged samples starting at Unix time `from`; 0 selects the newest ones.
+//
+void printHistory(uint32_t from, uint32_t count)
+{
+    Serial.printf("History: %lu of %lu records, %lu to %lu\n", (unsigned long)historyLog.recordCount(),
+                  (unsigned long)historyLog.capacity(), (unsigned long)historyLog.oldestTimestamp(),
+                  (unsigned long)historyLog.newestTimestamp());
+    if (from == 0)
+    {
+        uint32_t newest = historyLog.newestTimestamp();
+        from = newest > count * (MEASUREMENT_INTERVAL / 1000) ? newest - count * (MEASUREMENT_INTERVAL / 1000) : 0;
+    }
+
+    // Paged by position after `from`: records can share a second.
+    HistoryRecord records[16];
+    size_t printed = 0;
+    while (count > 0)
+    {
+        size_t read = historyLog.read(from, records, count < 16 ? count : 16, printed);
+        if (read == 0)
+        {
+            break;
+        }
+        for (size_t i = 0; i < read; i++)
+        {
+            Serial.printf("  %lu %ldW (decision %ldW) relays 0x%x\n", (unsigned long)records[i].timestamp,
+                          (long)records[i].power, (long)records[i].decision, records[i].states);
+        }
+        printed += read;
+        count -= read;
+    }
+}
+
+//
+// Executes one console command:
+//   config               print the configuration
+//   set <name> <value>   change a setting and store it in NVS
+//   dip                  reload the preset of the current DIP switch position
+//   history [from] [n]   print n logged samples from Unix time `from` (default: the last 20)
+//   energy               print the energy counters of the day
+//   update [url]         check for a firmware update at `url` (default: otaUrl) and install it
+//
+void runCommand(char *line)
+{
+    char *command = strtok(line, " ");
+    if (command == nullptr)
+    {
+        return;
+    }
+    if (strcmp(command, "config") == 0)
+    {
+        printRuntimeConfig();
+        return;
+    }
+    if (strcmp(command, "history") == 0)
+    {
+        char *from = strtok(nullptr, " ");
+        char *count = strtok(nullptr, " ");
+        printHistory(from ? strtoul(from, nullptr, 10) : 0, count ? strtoul(count, nullptr, 10) : 20);
+        return;
+    }
+    if (strcmp(command, "energy") == 0)
+    {
+        printEnergy();
+        return;
+    }
+    if (strcmp(command, "update") == 0)
+    {
+        char *packageUrl = strtok(nullptr, " ");
+        if (!otaUpdater.start(packageUrl != nullptr ? packageUrl : otaUrl))
+        {
+            Serial.println("An update check is already running.");
+        }
+        return;
+    }
+    if (strcmp(command, "set") == 0)
+    {
+        char *name = strtok(nullptr, " ");
+        char *value = strtok(nullptr, " ");
+        if (name == nullptr || value == nullptr || !runtimeConfigSet(runtimeConfig, name, value))
+        {
+            Serial.println("Invalid setting. Usage: set <name> <value>");
+            return;
+        }
+    }
+    else if (strcmp(command, "dip") == 0)
+    {
+        runtimeConfigApplyDip(runtimeConfig, readDipSwitches());
     }
     else
     {
-        char line1Buffer[LCD_COLS + 1];
-        snprintf(line1Buffer, sizeof(line1Buffer), "H:%lus   T:%dW", HYSTERESIS_TIME / 1000, (int)POWER_THRESHOLD);
-        updateLCDLine(1, line1Buffer);
+        Serial.println("Unknown command. Commands: config, set <name> <value>, dip, history [from] [n], energy, update [url]");
+        return;
+    }
+    commitRuntimeConfig();
+}
+
+//
+// Collects console input without blocking and runs complete lines.
+//
+void handleSerialCommands()
+{
+    static char line[64];
+    static size_t length = 0;
+    while (Serial.available() > 0)
+    {
+        char c = (char)Serial.read();
+        if (c == '\r' || c == '\n')
+        {
+            line[length] = '\0';
+            length = 0;
+            runCommand(line);
+        }
+        else if (length < sizeof(line) - 1)
+        {
+            line[length++] = c;
+        }
+    }
+}
+
+//
+// Writes the metrics page in the Prometheus text format.
+//
+bool writeStatusPage(const char *path, TextWriter &body)
+{
+    if (strcmp(path, "/metrics") != 0)
+    {
+        return false;
+    }
+    unsigned long currentTime = millis();
+    body.printf("# TYPE energy_monitor_uptime_seconds counter\n");
+    body.metric("energy_monitor_uptime_seconds", nullptr, (long)(currentTime / 1000));
+
+    // Latest meter sample
+    if (!powerHistory.empty())
+    {
+        const MeterSample &sample = powerHistory.recent(0);
+        body.printf("# TYPE energy_monitor_power_watts gauge\n");
+        body.metric("energy_monitor_power_watts", nullptr, (long)sample.power);
+        body.metric("energy_monitor_sample_age_seconds", nullptr, (int32_t)(currentTime - sample.timestamp), 3);
+        for (uint8_t phase = 0; phase < 3; phase++)
+        {
+            char labels[16];
+            snprintf(labels, sizeof(labels), "phase=\"L%u\"", phase + 1);
+            if (sample.has(FIELD_POWER_L1 + phase))
+            {
+                body.metric("energy_monitor_phase_power_watts", labels, (long)sample.phasePower[phase]);
+            }
+            if (sample.has(FIELD_VOLTAGE_L1 + phase))
+            {
+                body.metric("energy_monitor_voltage_volts", labels, sample.voltage[phase], 1);
+            }
+            if (sample.has(FIELD_CURRENT_L1 + phase))
+            {
+                body.metric("energy_monitor_current_amperes", labels, sample.current[phase], 2);
+            }
+        }
+        if (sample.has(FIELD_IMPORT))
+        {
+            body.printf("# TYPE energy_monitor_import_kwh_total counter\n");
+            body.metric("energy_monitor_import_kwh_total", nullptr, (int32_t)sample.importWh, 3);
+        }
+        if (sample.has(FIELD_EXPORT))
+        {
+            body.printf("# TYPE energy_monitor_export_kwh_total counter\n");
+            body.metric("energy_monitor_export_kwh_total", nullptr, (int32_t)sample.exportWh, 3);
+        }
+        body.metric("energy_monitor_power_mean_watts", "window=\"short\"", (long)shortPowerStats.mean());
+        body.metric("energy_monitor_power_mean_watts", "window=\"long\"", (long)longPowerStats.mean());
+        body.metric("energy_monitor_power_stddev_watts", "window=\"long\"", (long)longPowerStats.stddev());
+    }
+
+    // Switching state
+    const SwitchPolicy &policy = controller.switchPolicy();
+    const LoadScheduler &loads = controller.loads();
+    body.metric("energy_monitor_decision_power_watts", nullptr, (long)policy.decisionPower());
+    body.metric("energy_monitor_threshold_watts", nullptr, (long)controller.threshold());
+    if (FORECAST_ENABLED)
+    {
+        body.metric("energy_monitor_threshold_bias_watts", nullptr, (long)controller.thresholdBias());
+        body.metric("energy_monitor_plan_hours", nullptr, (long)chargePlan.plannedHours());
+        body.metric("energy_monitor_plan_energy_wh", nullptr, (long)chargePlan.plannedEnergy());
+        body.printf("# TYPE energy_monitor_forecast_fetches_total counter\n");
+        body.metric("energy_monitor_forecast_fetches_total", nullptr, (long)forecastClient.fetchCount());
+        body.metric("energy_monitor_forecast_failures_total", nullptr, (long)forecastClient.failureCount());
+    }
+    // Energy accounting
+    body.metric("energy_monitor_exported_today_kwh", nullptr, (int32_t)energyAccount.exportedToday(), 3);
+    body.printf("# TYPE energy_monitor_exported_surplus_kwh_total counter\n");
+    body.metric("energy_monitor_exported_surplus_kwh_total", nullptr, (int32_t)energyAccount.exportedTotal(), 3);
+    for (uint8_t channel = 0; channel < ACCOUNTED_CHANNELS; channel++)
+    {
+        char labels[40];
+        snprintf(labels, sizeof(labels), "channel=\"%s\"", channelName(channel));
+        body.metric("energy_monitor_diverted_today_kwh", labels, (int32_t)energyAccount.divertedToday(channel), 3);
+        body.metric("energy_monitor_duty_cycle_percent", labels, (long)energyAccount.dutyCycle(channel));
+        body.metric("energy_monitor_switch_ons_today", labels, (long)energyAccount.cyclesToday(channel));
+        body.metric("energy_monitor_diverted_kwh_total", labels, (int32_t)energyAccount.divertedTotal(channel), 3);
+        body.metric("energy_monitor_switch_ons_total", labels, (long)energyAccount.cyclesTotal(channel));
+    }
+    body.metric("energy_monitor_hysteresis_seconds", nullptr, (long)(controller.hysteresisTime() / 1000));
+    body.metric("energy_monitor_charger_on", nullptr, controller.chargerOn() ? 1L : 0L);
+    body.metric("energy_monitor_switch_pending", nullptr, policy.switchPending() ? 1L : 0L);
+    body.metric("energy_monitor_switch_remaining_seconds", nullptr, (int32_t)policy.remainingTime(currentTime), 3);
+    for (uint8_t i = 0; i < loads.count(); i++)
+    {
+        char labels[40];
+        snprintf(labels, sizeof(labels), "load=\"%s\"", LOAD_CHANNELS[i].name);
+        body.metric("energy_monitor_load_on", labels, loads.isOn(i) ? 1L : 0L);
+        if (LOAD_CHANNELS[i].node >= 0)
+        {
+            body.metric("energy_monitor_load_confirmed", labels,
+                        relayLink.confirmed(LOAD_CHANNELS[i].node, LOAD_CHANNELS[i].pin) ? 1L : 0L);
+        }
+    }
+    for (uint8_t node = 0; node < relayLink.nodeCount(); node++)
+    {
+        char labels[16];
+        snprintf(labels, sizeof(labels), "node=\"%u\"", node);
+        body.metric("energy_monitor_relay_node_online", labels, relayLink.nodeOnline(node, currentTime) ? 1L : 0L);
+    }
+    body.metric("energy_monitor_poll_interval_seconds", nullptr, (int32_t)pollInterval.load(), 3);
+
+    // Counters
+    body.printf("# TYPE energy_monitor_meter_requests_total counter\n");
+    body.metric("energy_monitor_meter_requests_total", nullptr, (long)meterClient.requestCount());
+    body.metric("energy_monitor_meter_connects_total", nullptr, (long)meterClient.connectCount());
+    body.metric("energy_monitor_meter_push_messages_total", nullptr, (long)meterPush.messageCount());
+    if (METER_SHARE_MODE != METER_SHARE_OFF || meterSourceUsed(METER_SOURCE_SHARED))
+    {
+        body.metric("energy_monitor_share_sent_total", nullptr, (long)meterShare.sentCount());
+        body.metric("energy_monitor_share_received_total", nullptr, (long)meterShare.receivedCount());
+        body.metric("energy_monitor_share_lost_total", nullptr, (long)meterShare.lostCount());
+    }
+    if (meterSourceUsed(METER_SOURCE_MODBUS))
+    {
+        body.metric("energy_monitor_modbus_requests_total", nullptr, (long)modbusClient.requestCount());
+        body.metric("energy_monitor_modbus_errors_total", nullptr, (long)modbusClient.errorCount());
+    }
+    if (meterSourceUsed(METER_SOURCE_CT))
+    {
+        body.metric("energy_monitor_ct_blocks_total", nullptr, (long)ctSensor.blockCount());
+    }
+    int active = meterSources.active(currentTime);
+    for (int i = 0; i < meterSources.count(); i++)
+    {
+        char labels[24];
+        snprintf(labels, sizeof(labels), "source=\"%s\"", meterSources.source(i).name());
+        body.metric("energy_monitor_source_active", labels, i == active ? 1L : 0L);
+        body.metric("energy_monitor_source_samples_total", labels, (long)meterSources.sampleCount(i));
+        body.metric("energy_monitor_source_used_total", labels, (long)meterSources.usedCount(i));
+    }
+    body.metric("energy_monitor_sample_stale", nullptr, sampleStale ? 1L : 0L);
+    body.metric("energy_monitor_sample_stale_total", nullptr, (long)staleCount);
+    body.metric("energy_monitor_sample_queue_dropped_total", nullptr, (long)sampleQueue.droppedCount());
+    body.metric("energy_monitor_wifi_reconnects_total", nullptr, (long)wifiManager.reconnectCount());
+    body.metric("energy_monitor_wifi_connected", nullptr, wifiManager.connected() ? 1L : 0L);
+    body.metric("energy_monitor_wifi_rssi_dbm", nullptr, (long)WiFi.RSSI());
+    if (MQTT_ENABLED)
+    {
+        body.metric("energy_monitor_mqtt_batches_total", nullptr, (long)mqttPublisher.publishedCount());
+        body.metric("energy_monitor_mqtt_dropped_total", nullptr, (long)mqttPublisher.droppedCount());
+    }
+    body.metric("energy_monitor_history_records", nullptr, (long)historyLog.recordCount());
+    body.metric("energy_monitor_ota_checks_total", nullptr, (long)otaUpdater.checkCount());
+    body.metric("energy_monitor_ota_failures_total", nullptr, (long)otaUpdater.failureCount());
+    body.metric("energy_monitor_ota_progress_percent", nullptr, (long)otaUpdater.progress());
+    body.metric("energy_monitor_http_requests_total", nullptr, (long)statusServer.requestCount());
+    body.metric("energy_monitor_http_truncated_total", nullptr, (long)statusServer.truncatedCount());
+
+    // Memory
+    const MemStats &memory = memStats();
+    body.metric("energy_monitor_heap_free_bytes", nullptr, (long)memory.freeHeap);
+    body.metric("energy_monitor_heap_min_free_bytes", nullptr, (long)memory.minFreeHeap);
+    body.metric("energy_monitor_heap_largest_block_bytes", nullptr, (long)memory.largestBlock);
+    body.metric("energy_monitor_heap_min_largest_block_bytes", nullptr, (long)memory.minLargestBlock);
+    body.metric("energy_monitor_heap_fragmentation_percent", nullptr, (long)memory.fragmentation());
+    body.printf("# TYPE energy_monitor_heap_failed_allocations_total counter\n");
+    body.metric("energy_monitor_heap_failed_allocations_total", nullptr, (long)memory.failedCount);
+    body.metric("energy_monitor_heap_frees_total", nullptr, (long)memory.freeCount);
+    for (uint8_t slot = 0; slot < memTaskSlots(); slot++)
+    {
+        if (memTaskName(slot) != nullptr)
+        {
+            char labels[24];
+            snprintf(labels, sizeof(labels), "task=\"%s\"", memTaskName(slot));
+            body.metric("energy_monitor_stack_free_min_bytes", labels, (long)memTaskStackFree(slot));
+        }
     }
+    for (uint8_t i = 0; i < MEM_SUBSYSTEM_COUNT; i++)
+    {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", memSubsystemName((MemSubsystem)i));
+        body.metric("energy_monitor_allocations_total", labels, (long)memAllocationCount((MemSubsystem)i));
+        body.metric("energy_monitor_allocated_bytes_total", labels, (long)memAllocationBytes((MemSubsystem)i));
+    }
+
+    // Per-stage latency
+    body.commit(perfFormatMetrics(body.tail(), body.space(), "energy_monitor"));
+    return true;
+}
+
+//
+// Prints the per-stage latency histograms to the serial monitor.
+//
+void printPerfStats()
+{
+    static char report[1024];
+    perfFormat(report, sizeof(report));
+    Serial.print(report);
+    memFormat(report, sizeof(report));
+    Serial.print(report);
 }
 
 //
@@ -249,88 +1285,142 @@ void printStatus(int solarPower)
 //
 void setup()
 {
-    pinMode(RELAY_PIN, OUTPUT); // Set the relay pin as an output.
+    // Restore the last relay state first, so a reboot doesn't interrupt charging.
+    persistBegin();
+    bool restoredOn = false;
+    loadRelayState(restoredOn);
+    setupRelayPin(RELAY_PIN, restoredOn); // Set the level, then enable the output.
+    controller.restoreCharger(restoredOn, millis());
+    controller.setChargerPower(CHARGER_POWER);
+
+    // Additional loads start off and are staged in once measurements arrive.
+    for (int i = 0; i < LOAD_CHANNEL_COUNT; i++)
+    {
+        if (LOAD_CHANNELS[i].node < 0)
+        {
+            setupRelayPin(LOAD_CHANNELS[i].pin, false);
+        }
+        controller.addLoad(LOAD_CHANNELS[i]);
+    }
+
     pinMode(DIP_PIN_1, INPUT_PULLUP);
     pinMode(DIP_PIN_2, INPUT_PULLUP);
     pinMode(DIP_PIN_3, INPUT_PULLUP);
     Serial.begin(115200); // Start serial communication for debugging.
+    Serial.printf("Relay restored %s at %lu ms after boot.\n", restoredOn ? "ON" : "OFF", millis());
+    historyLog.begin(HISTORY_PARTITION); // Locates the end of the log from the sector headers.
 
-    // Read DIP switches using bitwise operations for efficiency
-    int dipValue = (digitalRead(DIP_PIN_1) == HIGH ? 4 : 0) |
-                   (digitalRead(DIP_PIN_2) == HIGH ? 2 : 0) |
-                   (digitalRead(DIP_PIN_3) == HIGH ? 1 : 0);
+    int dipValue = readDipSwitches();
 
-    // Set HYSTERESIS_TIME and POWER_THRESHOLD based on DIP switch settings
-    switch (dipValue)
+    // Load the stored settings; a changed DIP position selects its preset instead.
+    if (loadRuntimeConfig(runtimeConfig, dipValue))
     {
-    case 0: // 0 0 0
-        HYSTERESIS_TIME = 120UL * 1000UL;
-        POWER_THRESHOLD = 500.0;
-        break;
-    case 1: // 0 0 1
-        HYSTERESIS_TIME = 120UL * 1000UL;
-        POWER_THRESHOLD = 1000.0;
-        break;
-    case 2: // 0 1 0
-        HYSTERESIS_TIME = 120UL * 1000UL;
-        POWER_THRESHOLD = 1500.0;
-        break;
-    case 3: // 0 1 1
-        HYSTERESIS_TIME = 120UL * 1000UL;
-        POWER_THRESHOLD = 2000.0;
-        break;
-    case 4: // 1 0 0
-        HYSTERESIS_TIME = 240UL * 1000UL;
-        POWER_THRESHOLD = 500.0;
-        break;
-    case 5: // 1 0 1
-        HYSTERESIS_TIME = 240UL * 1000UL;
-        POWER_THRESHOLD = 1000.0;
-        break;
-    case 6: // 1 1 0
-        HYSTERESIS_TIME = 240UL * 1000UL;
-        POWER_THRESHOLD = 1500.0;
-        break;
-    case 7: // 1 1 1
-        HYSTERESIS_TIME = 240UL * 1000UL;
-        POWER_THRESHOLD = 2000.0;
-        break;
+        Serial.println("Using stored configuration.");
     }
+    else
+    {
+        Serial.printf("Using DIP preset %d.\n", dipValue);
+    }
+    if (FORECAST_ENABLED && loadSolarForecast(solarForecast))
+    {
+        Serial.println("Stored forecast loaded."); // Only used if it is today's.
+    }
+    applyRuntimeConfig(); // Plans the stored forecast.
+    EnergyRecord energyRecord;
+    if (loadEnergyRecord(energyRecord) && energyAccount.restore(energyRecord))
+    {
+        Serial.println("Energy counters restored."); // Closed into the totals if not today's.
+    }
+    energyAccount.setChannelPower(0, CHARGER_POWER);
+    for (int i = 0; i + 1 < ACCOUNTED_CHANNELS; i++)
+    {
+        energyAccount.setChannelPower(1 + i, LOAD_CHANNELS[i].power);
+    }
+    printRuntimeConfig();
+
+    pollScheduler.configure(MEASUREMENT_INTERVAL_FAST, MEASUREMENT_INTERVAL, MEASUREMENT_INTERVAL_SLOW,
+                            MEASUREMENT_INTERVAL_IDLE, POLL_NEAR_BAND, POLL_FAR_BAND, POLL_IDLE_DELAY);
 
     // Initialize the LCD
     Wire.begin();
     lcd.init();
     lcd.backlight();
-    lcd.print("Starting...");
+    lcdFrame.setLine(0, "Starting...");
+    lcdFrame.flush(lcd, LCD_COLS * LCD_ROWS);
 
-    WiFi.onEvent(WiFiEvent);    // Register the WiFi event handler.
-    WiFi.mode(WIFI_STA);        // Set the ESP32 to station mode.
-    WiFi.begin(ssid, password); // Connect to the WiFi network.
+    meterClient.begin(apiUrl); // Parse the meter API URL once.
 
+    // Connect in the background; loop() starts right away and the meter
+    // task skips measurements until the connection is up.
+    WiFi.onEvent(WiFiEvent);           // Register the WiFi event handler.
+    wifiManager.begin(ssid, password); // Connect to the WiFi network.
     Serial.println("Connecting to WiFi...");
-    int retries = 60;
-    // Wait for the WiFi connection to be established.
-    while (WiFi.status() != WL_CONNECTED && retries > 0)
+    powerSaveBegin(POWER_SAVE_MODE); // Sleep between measurements.
+    // Relay nodes are told to switch their loads off until the scheduler decides otherwise.
+    if (RELAY_NODE_COUNT > 0 && relayLink.begin(espnowKey))
+    {
+        for (int i = 0; i < RELAY_NODE_COUNT; i++)
+        {
+            relayLink.addNode(RELAY_NODES[i]);
+        }
+    }
+    for (int i = 0; i < LOAD_CHANNEL_COUNT; i++)
     {
-        Serial.print(".");
-        delay(1000);
-        retries--;
+        if (LOAD_CHANNELS[i].node >= RELAY_NODE_COUNT)
+        {
+            Serial.printf("Load %s: relay node %d is not configured.\n", LOAD_CHANNELS[i].name, LOAD_CHANNELS[i].node);
+        }
+        else if (LOAD_CHANNELS[i].node >= 0)
+        {
+            relayLink.setRelay(LOAD_CHANNELS[i].node, LOAD_CHANNELS[i].pin, false);
+        }
     }
 
-    // If the connection fails after multiple retries, restart the ESP32.
-    if (WiFi.status() != WL_CONNECTED)
+    configTime(0, 0, NTP_SERVER); // Wall-clock time for the history, set once connected.
+    setenv("TZ", TIME_ZONE, 1);    // Local hours for the charge plan
+    tzset();
+    if (HTTP_SERVER_ENABLED)
     {
-        Serial.println("\nFailed to connect to WiFi. Restarting...");
-        ESP.restart();
+        statusServer.begin(HTTP_SERVER_PORT, writeStatusPage); // Listens once the network is up.
     }
 
-    Serial.println("\nWiFi connected.");
-    
-    // Clear LCD buffers after initial display
-    memset(lcdLine0, ' ', LCD_COLS);
-    memset(lcdLine1, ' ', LCD_COLS);
-    lcdLine0[LCD_COLS] = '\0';
-    lcdLine1[LCD_COLS] = '\0';
+    if (MQTT_ENABLED)
+    {
+        mqttPublisher.begin(mqtt_server, MQTT_PORT); // Connected from the meter task.
+        Serial.printf("MQTT device id: %s\n", mqttPublisher.deviceId());
+    }
+
+    // loop() is woken by new samples and at hysteresis deadlines.
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    memRegisterTask("loop", loopTaskHandle, MEM_CONTROL);
+    navInput.begin(NAV_INPUT, loopTaskHandle); // Page buttons wake loop() too.
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onSwitchDeadline;
+    timerArgs.name = "switch";
+    esp_timer_create(&timerArgs, &switchTimer);
+
+    // Measurement sources in priority order
+    for (int i = 0; i < METER_SOURCE_COUNT; i++)
+    {
+        if (!meterSources.add(meterSource(METER_SOURCES[i])))
+        {
+            Serial.println("Too many meter sources. Ignoring the rest.");
+            break;
+        }
+    }
+    if (meterSourceUsed(METER_SOURCE_MODBUS))
+    {
+        modbusClient.begin(MODBUS_HOST, MODBUS_PORT, MODBUS_UNIT_ID); // Connected from the meter task.
+    }
+    if (meterSourceUsed(METER_SOURCE_CT))
+    {
+        ctSensor.begin(CT_PIN); // DMA sampling runs in the background from here on.
+    }
+
+    // Start polling the meter in the background on the other core.
+    xTaskCreatePinnedToCore(meterTask, "meter", METER_TASK_STACK_SIZE, nullptr,
+                            METER_TASK_PRIORITY, &meterTaskHandle, METER_TASK_CORE);
+    memRegisterTask("meter", meterTaskHandle, MEM_METER);
 }
 
 //
@@ -338,26 +1428,91 @@ void setup()
 //
 void loop()
 {
-    unsigned long currentTime = millis();
-    // Periodically measure the solar power and control the charger.
-    if (currentTime - lastMeasurementTime >= MEASUREMENT_INTERVAL)
+    // Consume the samples delivered by the meter task and control the charger.
+    // The relays hold their state while an update is written.
+    bool updating = otaUpdater.active();
+    MeterSample sample;
+    while (sampleQueue.pop(sample))
     {
-        lastMeasurementTime = currentTime;
-
-        int solarPower = 0;
-        // If the power is successfully fetched, control the charger and print the status.
-        if (getSolarPower(solarPower))
+        recordSample(sample);
+        accountSample(sample); // Before the relays switch on it.
+        if (!updating)
         {
-            controlCharger(solarPower);
-            printStatus(solarPower);
+            PerfTimer timer(STAGE_CONTROL);
+            controlCharger(sample);
         }
+        {
+            PerfTimer timer(STAGE_STATUS);
+            printStatus(sample);
+        }
+        publishSample(sample);
+        logSample(sample);
+        lastSampleTime = sample.timestamp;
+    }
+
+    checkSampleAge(millis()); // Switch off when measurements stopped, whatever the source.
+
+    if (!updating)
+    {
+        serviceSwitchDeadline(millis()); // Switch when a hysteresis time runs out between samples.
+    }
+
+    serviceDisplay(millis()); // Follow the page buttons; redraws only the framebuffer.
+
+    flushLCD(); // Update the display after the control decisions.
+
+    // Write the history to flash; erase ahead only while no switch is pending.
+    historyLog.service(millis(), !controller.switchPending());
+
+    // Periodically report the instrumentation.
+    unsigned long currentTime = millis();
+    if (currentTime - lastPerfReportTime >= PERF_REPORT_INTERVAL)
+    {
+        lastPerfReportTime = currentTime;
+        printPerfStats();
+    }
+
+    if (RELAY_NODE_COUNT > 0)
+    {
+        relayLink.service(currentTime); // Repeats and refreshes the relay node commands.
     }
-    
-    // Handle WiFi reconnection in loop as well
-    if (WiFi.status() != WL_CONNECTED)
+
+    if (HTTP_SERVER_ENABLED)
+    {
+        MemScope scope(MEM_STATUS_SERVER);
+        statusServer.loop(currentTime); // Answer metrics scrapes without waiting on the network.
+    }
+
+    // Handle WiFi reconnection without blocking the loop.
+    unsigned long wifiCheckStart = micros();
+    wifiManager.tick(currentTime);
+    perfRecord(STAGE_WIFI_CHECK, micros() - wifiCheckStart);
+    if (!wifiManager.connected())
+    {
+        handleWiFiOutage(currentTime);
+    }
+
+    handleSerialCommands(); // Apply configuration changes from the console.
+
+    if (MQTT_ENABLED && MQTT_CONFIG_ENABLED)
     {
-        Serial.println("WiFi disconnected. Attempting to reconnect...");
-        WiFi.reconnect();
-        delay(5000); // Wait a bit before checking again
+        serviceRemoteConfig(); // And those received over MQTT.
     }
+
+    serviceUpdate(currentTime); // Install firmware updates in the background.
+
+    serviceEnergy(currentTime); // Store the energy counters now and then.
+
+    memSample(millis()); // Heap and stack figures for the report and metrics.
+
+    if (FORECAST_ENABLED)
+    {
+        serviceChargePlan(currentTime); // Bias the thresholds by the hour of the plan.
+    }
+
+    // Yield to other tasks until the next sample arrives. With power saving the
+    // idle loop waits longer, so the chip can sleep, unless the LCD still has cells to send.
+    unsigned long period = POWER_SAVE_MODE != POWER_SAVE_OFF && !lcdFrame.dirty() ? POWER_SAVE_LOOP_PERIOD
+                                                                                   : CONTROL_LOOP_PERIOD;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(period));
 }
@@ -0,0 +1,253 @@
+//
+// Heap and stack instrumentation.
+//
+
+#include "mem_stats.h"
+#include "config.h"        // MEMORY_SAMPLE_INTERVAL
+#include <esp_heap_caps.h> // Heap figures
+#include <stdio.h>         // snprintf
+
+static const uint8_t MEM_TASK_SLOTS = 4;
+
+struct TaskSlot
+{
+    TaskHandle_t task;      // nullptr for a free slot
+    const char *name;
+    MemSubsystem subsystem; // Subsystem allocations are counted against
+    uint32_t stackFree;     // Lowest free stack sampled, in bytes
+};
+
+// All counters live in this single fixed block; the allocation counters
+// are updated from both cores.
+static MemStats stats;
+static uint32_t allocations[MEM_SUBSYSTEM_COUNT];
+static uint32_t allocatedBytes[MEM_SUBSYSTEM_COUNT];
+static TaskSlot taskSlots[MEM_TASK_SLOTS]; // Slots keep their index while in use
+static unsigned long lastDetailSample = 0;
+static portMUX_TYPE taskLock = portMUX_INITIALIZER_UNLOCKED; // Keeps a task from being removed while its stack is sampled
+
+static const char *const subsystemNames[MEM_SUBSYSTEM_COUNT] = {
+    "system",
+    "control",
+    "meter",
+    "mqtt",
+    "forecast",
+    "status_server",
+    "ota",
+};
+
+static int8_t currentSlot()
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; self != nullptr && i < MEM_TASK_SLOTS; i++)
+    {
+        if (taskSlots[i].task == self)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void countAllocation(size_t size, bool allocated)
+{
+    int8_t slot = currentSlot();
+    MemSubsystem subsystem = slot >= 0 ? taskSlots[slot].subsystem : MEM_SYSTEM;
+    __atomic_fetch_add(&allocations[subsystem], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocatedBytes[subsystem], (uint32_t)size, __ATOMIC_RELAXED);
+    if (!allocated && size > 0)
+    {
+        __atomic_fetch_add(&stats.failedCount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+//
+// Link-time wrappers (-Wl,--wrap=...) around the allocator.
+//
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *pointer, size_t size);
+    void __real_free(void *pointer);
+
+    void *__wrap_malloc(size_t size)
+    {
+        void *pointer = __real_malloc(size);
+        countAllocation(size, pointer != nullptr);
+        return pointer;
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        void *pointer = __real_calloc(count, size);
+        countAllocation(count * size, pointer != nullptr);
+        return pointer;
+    }
+
+    void *__wrap_realloc(void *pointer, size_t size)
+    {
+        void *resized = __real_realloc(pointer, size);
+        if (size > 0)
+        {
+            countAllocation(size, resized != nullptr);
+        }
+        return resized;
+    }
+
+    void __wrap_free(void *pointer)
+    {
+        if (pointer != nullptr)
+        {
+            __atomic_fetch_add(&stats.freeCount, 1, __ATOMIC_RELAXED);
+        }
+        __real_free(pointer);
+    }
+}
+
+bool memRegisterTask(const char *name, TaskHandle_t task, MemSubsystem subsystem)
+{
+    bool added = false;
+    portENTER_CRITICAL(&taskLock);
+    for (uint8_t i = 0; task != nullptr && !added && i < MEM_TASK_SLOTS; i++)
+    {
+        if (taskSlots[i].task == nullptr)
+        {
+            taskSlots[i] = {task, name, subsystem, UINT32_MAX};
+            added = true;
+        }
+    }
+    portEXIT_CRITICAL(&taskLock);
+    return added;
+}
+
+void memUnregisterTask(TaskHandle_t task)
+{
+    portENTER_CRITICAL(&taskLock);
+    for (uint8_t i = 0; i < MEM_TASK_SLOTS; i++)
+    {
+        if (taskSlots[i].task == task)
+        {
+            taskSlots[i].task = nullptr;
+        }
+    }
+    portEXIT_CRITICAL(&taskLock);
+}
+
+void memSample(unsigned long currentTime)
+{
+    // Both are kept up to date by the allocator, so these are cheap.
+    stats.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    stats.samples++;
+    if (stats.samples > 1 && currentTime - lastDetailSample < MEMORY_SAMPLE_INTERVAL)
+    {
+        return;
+    }
+    lastDetailSample = currentTime;
+
+    stats.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (stats.samples == 1 || stats.largestBlock < stats.minLargestBlock)
+    {
+        stats.minLargestBlock = stats.largestBlock;
+    }
+    for (uint8_t i = 0; i < MEM_TASK_SLOTS; i++)
+    {
+        portENTER_CRITICAL(&taskLock);
+        if (taskSlots[i].task != nullptr)
+        {
+            // Bytes on ESP-IDF, where the stack type is one byte wide.
+            uint32_t stackFree = uxTaskGetStackHighWaterMark(taskSlots[i].task);
+            if (stackFree < taskSlots[i].stackFree)
+            {
+                taskSlots[i].stackFree = stackFree;
+            }
+        }
+        portEXIT_CRITICAL(&taskLock);
+    }
+}
+
+const MemStats &memStats()
+{
+    return stats;
+}
+
+uint32_t memAllocationCount(MemSubsystem subsystem)
+{
+    return subsystem < MEM_SUBSYSTEM_COUNT ? allocations[subsystem] : 0;
+}
+
+uint32_t memAllocationBytes(MemSubsystem subsystem)
+{
+    return subsystem < MEM_SUBSYSTEM_COUNT ? allocatedBytes[subsystem] : 0;
+}
+
+const char *memSubsystemName(MemSubsystem subsystem)
+{
+    return subsystem < MEM_SUBSYSTEM_COUNT ? subsystemNames[subsystem] : "?";
+}
+
+uint8_t memTaskSlots()
+{
+    return MEM_TASK_SLOTS;
+}
+
+const char *memTaskName(uint8_t slot)
+{
+    return slot < MEM_TASK_SLOTS && taskSlots[slot].task != nullptr ? taskSlots[slot].name : nullptr;
+}
+
+uint32_t memTaskStackFree(uint8_t slot)
+{
+    return slot < MEM_TASK_SLOTS && taskSlots[slot].stackFree != UINT32_MAX ? taskSlots[slot].stackFree : 0;
+}
+
+size_t memFormat(char *buffer, size_t size)
+{
+    size_t length = snprintf(buffer, size,
+                             "heap [bytes]: free %lu, min %lu, largest %lu (min %lu), fragmentation %u%%, "
+                             "%lu failed\nstack free [bytes]:",
+                             (unsigned long)stats.freeHeap, (unsigned long)stats.minFreeHeap,
+                             (unsigned long)stats.largestBlock, (unsigned long)stats.minLargestBlock,
+                             stats.fragmentation(), (unsigned long)stats.failedCount);
+    for (uint8_t i = 0; i < MEM_TASK_SLOTS && length < size; i++)
+    {
+        if (memTaskName(i) == nullptr)
+        {
+            continue;
+        }
+        length += snprintf(buffer + length, size - length, " %s %lu", memTaskName(i),
+                           (unsigned long)memTaskStackFree(i));
+    }
+    if (length < size)
+    {
+        length += snprintf(buffer + length, size - length, "\nallocations:");
+    }
+    for (uint8_t i = 0; i < MEM_SUBSYSTEM_COUNT && length < size; i++)
+    {
+        length += snprintf(buffer + length, size - length, " %s %lu", subsystemNames[i],
+                           (unsigned long)allocations[i]);
+    }
+    if (length < size)
+    {
+        length += snprintf(buffer + length, size - length, ", %lu freed\n", (unsigned long)stats.freeCount);
+    }
+    return length < size ? length : size - 1;
+}
+
+MemScope::MemScope(MemSubsystem subsystem) : slot(currentSlot()), previous(MEM_SYSTEM)
+{
+    if (slot >= 0)
+    {
+        previous = taskSlots[slot].subsystem;
+        taskSlots[slot].subsystem = subsystem;
+    }
+}
+
+MemScope::~MemScope()
+{
+    if (slot >= 0)
+    {
+        taskSlots[slot].subsystem = previous;
+    }
+}
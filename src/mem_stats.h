@@ -0,0 +1,85 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h> // FreeRTOS types
+#include <freertos/task.h>     // Task handles and stack high-water marks
+#include <stddef.h>            // size_t
+#include <stdint.h>            // Fixed-width integer types
+
+//
+// Heap and stack instrumentation.
+//
+// memSample() is called on every loop() iteration and keeps the current
+// and lowest free heap in a fixed block; the largest free block (a walk
+// over the heap) and the stack high-water marks of the registered tasks
+// are sampled every MEMORY_SAMPLE_INTERVAL.
+//
+// malloc(), calloc(), realloc() and free() are wrapped at link time
+// (build_flags in platformio.ini). Each allocation is counted against the
+// subsystem the calling task is in: the default of a registered task, or
+// the one of the innermost MemScope. Allocations by other tasks (WiFi,
+// lwIP) count as MEM_SYSTEM.
+//
+enum MemSubsystem : uint8_t
+{
+    MEM_SYSTEM,        // Tasks not registered: WiFi, lwIP, timers
+    MEM_CONTROL,       // loop() outside the subsystems below
+    MEM_METER,         // Meter sources in the meter task
+    MEM_MQTT,          // MQTT telemetry
+    MEM_FORECAST,      // PV forecast download
+    MEM_STATUS_SERVER, // Metrics endpoint
+    MEM_OTA,           // Firmware updates
+    MEM_SUBSYSTEM_COUNT
+};
+
+struct MemStats
+{
+    uint32_t freeHeap;        // Free heap at the last sample
+    uint32_t minFreeHeap;     // Lowest free heap since boot, as tracked by the allocator
+    uint32_t largestBlock;    // Largest free block at the last sample
+    uint32_t minLargestBlock; // Lowest largest free block sampled
+    uint32_t failedCount;     // Allocations that failed
+    uint32_t freeCount;       // Calls to free() with a pointer
+    uint32_t samples;         // memSample() calls
+
+    // Share of the free heap not usable for the largest allocation, in percent.
+    uint8_t fragmentation() const { return freeHeap ? 100 - (uint64_t)largestBlock * 100 / freeHeap : 0; }
+};
+
+// Adds a task whose stack is sampled; its allocations count against `subsystem`.
+// Returns false when the table is full.
+bool memRegisterTask(const char *name, TaskHandle_t task, MemSubsystem subsystem);
+
+// Removes a task before it is deleted.
+void memUnregisterTask(TaskHandle_t task);
+
+// Samples the heap, and every MEMORY_SAMPLE_INTERVAL the largest block and stacks.
+void memSample(unsigned long currentTime);
+
+const MemStats &memStats();
+uint32_t memAllocationCount(MemSubsystem subsystem);
+uint32_t memAllocationBytes(MemSubsystem subsystem);
+const char *memSubsystemName(MemSubsystem subsystem);
+
+// The task slots: the name of the registered task (nullptr for a free
+// slot) and the lowest free stack (in bytes) sampled for it.
+uint8_t memTaskSlots();
+const char *memTaskName(uint8_t slot);
+uint32_t memTaskStackFree(uint8_t slot);
+
+// Writes the heap, stack and allocation figures into `buffer`.
+size_t memFormat(char *buffer, size_t size);
+
+//
+// Counts allocations of the calling task against `subsystem` for the
+// lifetime of the object. Has no effect in tasks that are not registered.
+//
+class MemScope
+{
+public:
+    explicit MemScope(MemSubsystem subsystem);
+    ~MemScope();
+
+private:
+    int8_t slot;
+    MemSubsystem previous;
+};
@@ -0,0 +1,212 @@
+//
+// Meter sources on top of the protocol clients.
+//
+
+#include "meter_adapters.h"
+#include "config.h"       // Timeouts, service periods and Modbus settings
+#include "json_scanner.h" // Allocation-free JSON field extraction
+#include "perf_stats.h"   // Per-stage latency histograms
+#include <WiFi.h>         // WiFi status
+
+//
+// Time (ms) until a source polled every `interval` is due again.
+//
+static uint32_t pollDelay(bool polled, uint32_t lastPoll, uint32_t interval, uint32_t currentTime)
+{
+    uint32_t elapsed = currentTime - lastPoll;
+    return !polled || elapsed >= interval ? 1 : interval - elapsed;
+}
+
+//
+// A polled source is fresh while its last poll succeeded and it is not
+// overdue: two intervals leave room for one slow response.
+//
+static bool pollFresh(bool succeeded, uint32_t lastSample, uint32_t interval, uint32_t timeout, uint32_t currentTime)
+{
+    return succeeded && currentTime - lastSample < 2 * interval + timeout;
+}
+
+void HttpMeterSource::service(uint32_t currentTime, bool needed, SampleHandler handler)
+{
+    if (!needed || (polled && currentTime - lastPoll < interval.load()))
+    {
+        return;
+    }
+    lastPoll = currentTime;
+    polled = true;
+    MeterSample sample;
+    succeeded = fetch(sample);
+    if (succeeded)
+    {
+        lastSample = currentTime;
+        handler(sample);
+    }
+}
+
+uint32_t HttpMeterSource::serviceDelay(uint32_t currentTime, bool needed) const
+{
+    return needed ? pollDelay(polled, lastPoll, interval.load(), currentTime) : UINT32_MAX;
+}
+
+bool HttpMeterSource::fresh(uint32_t currentTime) const
+{
+    return pollFresh(succeeded, lastSample, interval.load(), METER_HTTP_TIMEOUT, currentTime);
+}
+
+//
+// Fetches the current solar power generation and phase readings from the API endpoint.
+//
+bool HttpMeterSource::fetch(MeterSample &sample)
+{
+    // Check for WiFi connection before making an HTTP request.
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        Serial.println("WiFi not connected. Skipping measurement.");
+        return false;
+    }
+
+    int httpResponseCode = client.get(); // Send a GET request over the kept-alive connection.
+    if (!client.lastRequestReused())
+    {
+        perfRecord(STAGE_HTTP_CONNECT, client.lastConnectMicros());
+    }
+    if (httpResponseCode > 0)
+    {
+        perfRecord(STAGE_HTTP_GET, client.lastRequestMicros());
+    }
+
+    // Check if the request was successful.
+    if (httpResponseCode == 200)
+    {
+        // Scan the JSON response from the HTTP stream, keeping only the fields we use.
+        int32_t values[METER_FIELD_COUNT];
+        JsonFieldSet fields(meterFieldsV1, METER_FIELD_COUNT, values);
+        JsonScanner scanner(JsonFieldSet::handler, &fields);
+        unsigned long parseStart = micros();
+        bool parsed = client.readJson(scanner);
+        perfRecord(STAGE_JSON_PARSE, micros() - parseStart);
+        if (!parsed)
+        {
+            Serial.println("Meter response is not valid JSON.");
+            client.disconnect(); // Don't reuse a connection with unread data.
+            return false;
+        }
+        // Decode all fields in one pass; power is negated to represent solar generation.
+        if (!buildMeterSample(fields, values, millis(), sample))
+        {
+            Serial.println("Meter response has no active_power_w.");
+            client.end();
+            return false;
+        }
+    }
+    else
+    {
+        Serial.print("HTTP response error: ");
+        Serial.println(httpResponseCode);
+        client.disconnect();
+        return false;
+    }
+
+    client.end(); // Finish the request, keeping the connection open.
+
+    Serial.printf("Meter request: %lu us (%s, connect %lu us)\n",
+                  client.lastRequestMicros(),
+                  client.lastRequestReused() ? "reused" : "new connection",
+                  client.lastConnectMicros());
+    return true;
+}
+
+void PushMeterSource::service(uint32_t currentTime, bool needed, SampleHandler handler)
+{
+    if (!started)
+    {
+        push.begin(meter.hostName(), token, handler);
+        started = true;
+    }
+    push.loop(); // Delivers pushed measurements through the handler.
+}
+
+uint32_t PushMeterSource::serviceDelay(uint32_t currentTime, bool needed) const
+{
+    return METER_PUSH_SERVICE_PERIOD;
+}
+
+uint32_t SharedMeterSource::serviceDelay(uint32_t currentTime, bool needed) const
+{
+    return METER_SHARE_SERVICE_PERIOD;
+}
+
+void ModbusMeterSource::service(uint32_t currentTime, bool needed, SampleHandler handler)
+{
+    if (!needed || (polled && currentTime - lastPoll < interval.load()))
+    {
+        return;
+    }
+    lastPoll = currentTime;
+    polled = true;
+    MeterSample sample;
+    succeeded = fetch(sample, currentTime);
+    if (succeeded)
+    {
+        lastSample = currentTime;
+        handler(sample);
+    }
+}
+
+uint32_t ModbusMeterSource::serviceDelay(uint32_t currentTime, bool needed) const
+{
+    return needed ? pollDelay(polled, lastPoll, interval.load(), currentTime) : UINT32_MAX;
+}
+
+bool ModbusMeterSource::fresh(uint32_t currentTime) const
+{
+    return pollFresh(succeeded, lastSample, interval.load(), MODBUS_TIMEOUT, currentTime);
+}
+
+//
+// Reads the grid power register and converts it to a surplus sample.
+//
+bool ModbusMeterSource::fetch(MeterSample &sample, uint32_t currentTime)
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        return false;
+    }
+
+    uint16_t words[2];
+    PerfTimer timer(STAGE_MODBUS_READ);
+    if (!client.readRegisters(MODBUS_FUNCTION, MODBUS_POWER_REGISTER, MODBUS_POWER_WORDS, words))
+    {
+        Serial.println("Modbus read of the power register failed.");
+        return false;
+    }
+
+    // Signed 16 or 32 bits, high word first.
+    int32_t raw = MODBUS_POWER_WORDS == 2 ? (int32_t)((uint32_t)words[0] << 16 | words[1]) : (int16_t)words[0];
+    sample = {};
+    sample.timestamp = currentTime;
+    sample.power = (int32_t)((int64_t)raw * MODBUS_MILLIWATTS_PER_COUNT * MODBUS_POWER_SIGN / 1000);
+    sample.fields = 1U << FIELD_POWER;
+    return true;
+}
+
+void CtMeterSource::service(uint32_t currentTime, bool needed, SampleHandler handler)
+{
+    MeterSample sample;
+    if (sensor.read(sample, currentTime))
+    {
+        delivered = true;
+        lastSample = currentTime;
+        handler(sample);
+    }
+}
+
+uint32_t CtMeterSource::serviceDelay(uint32_t currentTime, bool needed) const
+{
+    return CT_SERVICE_PERIOD; // Drain the DMA buffers before they overflow.
+}
+
+bool CtMeterSource::fresh(uint32_t currentTime) const
+{
+    return sensor.running() && delivered && currentTime - lastSample < 2 * CT_REPORT_INTERVAL;
+}
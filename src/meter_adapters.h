@@ -0,0 +1,129 @@
+#pragma once
+
+#include "config.h"        // Stale timeouts and report interval of the sources
+#include "ct_sensor.h"     // Local CT clamp measurement
+#include "meter_client.h"  // Keep-alive HTTP client for the meter API
+#include "meter_push.h"    // WebSocket push stream from the meter
+#include "meter_share.h"   // Meter samples shared between controllers
+#include "meter_source.h"  // Source interface
+#include "modbus_client.h" // Modbus TCP register reads
+#include <atomic>          // Poll interval shared with loop()
+
+//
+// The meter sources of the controller, on top of the clients for each protocol.
+//
+
+//
+// HomeWizard P1 meter API, polled at the interval chosen by loop().
+//
+class HttpMeterSource : public MeterSource
+{
+public:
+    HttpMeterSource(MeterClient &client, const std::atomic<unsigned long> &interval)
+        : client(client), interval(interval) {}
+
+    const char *name() const override { return "http"; }
+    void service(uint32_t currentTime, bool needed, SampleHandler handler) override;
+    uint32_t serviceDelay(uint32_t currentTime, bool needed) const override;
+    bool fresh(uint32_t currentTime) const override;
+    uint32_t sampleInterval() const override { return interval.load(); }
+
+private:
+    bool fetch(MeterSample &sample);
+
+    MeterClient &client;
+    const std::atomic<unsigned long> &interval;
+    bool polled = false;      // Whether a poll was made since boot
+    bool succeeded = false;   // Whether the last poll delivered a sample
+    uint32_t lastPoll = 0;    // millis() of the last poll
+    uint32_t lastSample = 0;  // millis() of the last successful poll
+};
+
+//
+// HomeWizard local API v2 push stream. Connects on the first service() and
+// delivers through the handler given then.
+//
+class PushMeterSource : public MeterSource
+{
+public:
+    PushMeterSource(MeterPushClient &push, const MeterClient &meter, const char *token)
+        : push(push), meter(meter), token(token) {}
+
+    const char *name() const override { return "push"; }
+    void service(uint32_t currentTime, bool needed, SampleHandler handler) override;
+    uint32_t serviceDelay(uint32_t currentTime, bool needed) const override;
+    bool fresh(uint32_t currentTime) const override { return push.streaming(currentTime); }
+    uint32_t sampleInterval() const override { return METER_PUSH_STALE_TIMEOUT; }
+
+private:
+    MeterPushClient &push;
+    const MeterClient &meter; // Host of the meter, from the API URL
+    const char *token;
+    bool started = false;
+};
+
+//
+// Samples shared by another controller over UDP multicast.
+//
+class SharedMeterSource : public MeterSource
+{
+public:
+    explicit SharedMeterSource(MeterShare &share) : share(share) {}
+
+    const char *name() const override { return "shared"; }
+    void service(uint32_t currentTime, bool needed, SampleHandler handler) override { share.receive(handler); }
+    uint32_t serviceDelay(uint32_t currentTime, bool needed) const override;
+    bool fresh(uint32_t currentTime) const override { return share.streaming(currentTime); }
+    uint32_t sampleInterval() const override { return METER_SHARE_STALE_TIMEOUT; } // Follows the publisher, up to its idle interval
+
+private:
+    MeterShare &share;
+};
+
+//
+// Grid power register of an inverter or meter over Modbus TCP, polled at the
+// interval chosen by loop().
+//
+class ModbusMeterSource : public MeterSource
+{
+public:
+    ModbusMeterSource(ModbusClient &client, const std::atomic<unsigned long> &interval)
+        : client(client), interval(interval) {}
+
+    const char *name() const override { return "modbus"; }
+    void service(uint32_t currentTime, bool needed, SampleHandler handler) override;
+    uint32_t serviceDelay(uint32_t currentTime, bool needed) const override;
+    bool fresh(uint32_t currentTime) const override;
+    uint32_t sampleInterval() const override { return interval.load(); }
+
+private:
+    bool fetch(MeterSample &sample, uint32_t currentTime);
+
+    ModbusClient &client;
+    const std::atomic<unsigned long> &interval;
+    bool polled = false;
+    bool succeeded = false;
+    uint32_t lastPoll = 0;
+    uint32_t lastSample = 0;
+};
+
+//
+// Local CT clamp. The DMA buffers are drained whether or not the source is
+// needed, so it can take over without a gap.
+//
+class CtMeterSource : public MeterSource
+{
+public:
+    explicit CtMeterSource(CtSensor &sensor) : sensor(sensor) {}
+
+    const char *name() const override { return "ct"; }
+    void service(uint32_t currentTime, bool needed, SampleHandler handler) override;
+    uint32_t serviceDelay(uint32_t currentTime, bool needed) const override;
+    bool fresh(uint32_t currentTime) const override;
+    uint32_t sampleInterval() const override { return 2 * CT_REPORT_INTERVAL; }
+
+private:
+    CtSensor &sensor;
+    bool delivered = false;  // Whether a sample was delivered since boot
+    uint32_t lastSample = 0; // millis() of the last sample
+};
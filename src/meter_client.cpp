@@ -0,0 +1,135 @@
+//
+// Long-lived keep-alive HTTP client for the P1 meter API.
+//
+
+#include "meter_client.h"
+#include "config.h" // Project configuration constants
+
+//
+// Splits the API URL into host, port and path.
+//
+bool MeterClient::begin(const char *url)
+{
+    const char *prefix = "http://";
+    if (strncmp(url, prefix, strlen(prefix)) != 0)
+    {
+        Serial.println("Meter API URL must start with http://");
+        return false;
+    }
+    const char *hostStart = url + strlen(prefix);
+    const char *hostEnd = hostStart;
+    while (*hostEnd != '\0' && *hostEnd != ':' && *hostEnd != '/')
+    {
+        hostEnd++;
+    }
+
+    size_t hostLen = hostEnd - hostStart;
+    if (hostLen == 0 || hostLen >= sizeof(host))
+    {
+        Serial.println("Meter API URL has an invalid host.");
+        return false;
+    }
+    memcpy(host, hostStart, hostLen);
+    host[hostLen] = '\0';
+
+    const char *pathStart = hostEnd;
+    port = 80;
+    if (*pathStart == ':')
+    {
+        char *portEnd;
+        port = (uint16_t)strtoul(pathStart + 1, &portEnd, 10);
+        pathStart = portEnd;
+    }
+    strncpy(path, *pathStart == '/' ? pathStart : "/", sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+
+    http.setReuse(true); // Ask the meter to keep the connection open.
+    http.setTimeout(METER_HTTP_TIMEOUT);
+    return true;
+}
+
+//
+// Sends a GET request, opening a new connection only when the previous one was dropped.
+//
+int MeterClient::get()
+{
+    reused = tcp.connected();
+    if (!reused)
+    {
+        tcp.stop(); // Release any half-closed socket before reconnecting.
+        unsigned long connectStart = micros();
+        if (!tcp.connect(host, port, METER_HTTP_TIMEOUT))
+        {
+            connectMicros = micros() - connectStart;
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        }
+        connectMicros = micros() - connectStart;
+        tcp.setNoDelay(true); // Small request, don't wait for Nagle.
+        connects++;
+    }
+    else
+    {
+        connectMicros = 0;
+    }
+
+    unsigned long requestStart = micros();
+    http.begin(tcp, host, port, path);
+    int httpResponseCode = http.GET();
+    requestMicros = micros() - requestStart;
+    requests++;
+    return httpResponseCode;
+}
+
+//
+// Reads the response body in fixed-size chunks, stopping at the end of the JSON document
+// so the kept-alive connection never blocks waiting for more data.
+//
+bool MeterClient::readJson(JsonScanner &scanner)
+{
+    int remaining = http.getSize(); // Content-Length, or -1 when unknown
+    unsigned long readStart = millis();
+    while (!scanner.done() && remaining != 0)
+    {
+        int available = tcp.available();
+        if (available <= 0)
+        {
+            if (!tcp.connected() || millis() - readStart >= METER_HTTP_TIMEOUT)
+            {
+                return false;
+            }
+            delay(1);
+            continue;
+        }
+
+        size_t chunk = available < (int)sizeof(readBuffer) ? available : sizeof(readBuffer);
+        if (remaining > 0 && (int)chunk > remaining)
+        {
+            chunk = remaining;
+        }
+        int received = tcp.read((uint8_t *)readBuffer, chunk);
+        if (received <= 0)
+        {
+            return false;
+        }
+        if (remaining > 0)
+        {
+            remaining -= received;
+        }
+        if (!scanner.feed(readBuffer, received))
+        {
+            return false;
+        }
+    }
+    return scanner.done();
+}
+
+void MeterClient::end()
+{
+    http.end(); // Keeps the socket open when the meter allows reuse.
+}
+
+void MeterClient::disconnect()
+{
+    http.end();
+    tcp.stop();
+}
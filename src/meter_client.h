@@ -0,0 +1,59 @@
+#pragma once
+
+#include "json_scanner.h" // Allocation-free JSON scanning of responses
+#include <HTTPClient.h>     // HTTP client for API requests
+#include <WiFiClient.h>     // TCP connection to the meter
+
+//
+// Long-lived HTTP client for the P1 meter API.
+//
+// Keeps a single keep-alive TCP connection to the meter open between polls
+// so each measurement only pays for the request itself. When the meter or
+// the WiFi link drops the connection, the next request reconnects
+// transparently. Connect (handshake) and request latency are tracked
+// separately so they can be reported.
+//
+class MeterClient
+{
+public:
+    // Parses the API URL (http://host[:port]/path). Must be called once before get().
+    bool begin(const char *url);
+
+    // Sends a GET request, reusing the open connection when possible.
+    // Returns the HTTP status code, or a negative HTTPClient error code.
+    int get();
+
+    // Feeds the response body of the last successful get() through `scanner`
+    // until the JSON document is complete. Returns false on malformed or truncated responses.
+    bool readJson(JsonScanner &scanner);
+
+    // Finishes the current request. The connection is kept open for reuse.
+    void end();
+
+    // Closes the connection, e.g. after a malformed response.
+    void disconnect();
+
+    // Host name or IP address of the meter, as parsed from the API URL.
+    const char *hostName() const { return host; }
+
+    unsigned long lastConnectMicros() const { return connectMicros; }
+    unsigned long lastRequestMicros() const { return requestMicros; }
+    bool lastRequestReused() const { return reused; }
+    unsigned long connectCount() const { return connects; }
+    unsigned long requestCount() const { return requests; }
+
+private:
+    WiFiClient tcp;
+    HTTPClient http;
+
+    char host[64] = "";
+    char path[128] = "/";
+    uint16_t port = 80;
+    char readBuffer[128]; // Fixed chunk buffer for reading response bodies
+
+    unsigned long connectMicros = 0; // Duration of the last TCP handshake
+    unsigned long requestMicros = 0; // Duration of the last request (send + response headers)
+    bool reused = false;             // Whether the last request reused an open connection
+    unsigned long connects = 0;      // Number of TCP handshakes performed
+    unsigned long requests = 0;      // Number of requests sent
+};
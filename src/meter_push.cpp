@@ -0,0 +1,134 @@
+//
+// Push-based ingestion from the HomeWizard local WebSocket API.
+//
+
+#include "meter_push.h"
+#include "config.h"       // Project configuration constants
+#include "json_scanner.h" // Allocation-free JSON parsing of pushed messages
+
+//
+// Opens the WebSocket connection to the meter.
+//
+void MeterPushClient::begin(const char *host, const char *apiToken, SampleHandler handler)
+{
+    token = apiToken;
+    onSample = handler;
+
+    // The meter uses a self-signed certificate, so no fingerprint is checked.
+    ws.beginSSL(host, 443, "/api/ws");
+    ws.setReconnectInterval(METER_PUSH_RECONNECT_INTERVAL);
+    ws.onEvent([this](WStype_t type, uint8_t *payload, size_t length)
+               { handleEvent(type, payload, length); });
+}
+
+void MeterPushClient::loop()
+{
+    ws.loop();
+}
+
+bool MeterPushClient::streaming(unsigned long currentTime) const
+{
+    return subscribed && messages > 0 && currentTime - lastMessageTime < METER_PUSH_STALE_TIMEOUT;
+}
+
+//
+// Tracks the connection state reported by the WebSocket library.
+//
+void MeterPushClient::handleEvent(WStype_t type, uint8_t *payload, size_t length)
+{
+    switch (type)
+    {
+    case WStype_CONNECTED:
+        Serial.println("Meter push stream connected.");
+        break;
+    case WStype_DISCONNECTED:
+        if (subscribed)
+        {
+            Serial.println("Meter push stream disconnected. Falling back to polling.");
+        }
+        subscribed = false;
+        break;
+    case WStype_TEXT:
+        handleMessage((const char *)payload, length);
+        break;
+    default:
+        break;
+    }
+}
+
+// Fields of a pushed message used by the handshake and measurements
+struct PushMessage
+{
+    char type[24];  // Message type, e.g. "measurement"
+    char error[48]; // data.message of error messages
+    JsonFieldSet *data;
+};
+
+static void copyField(char *destination, size_t size, const char *value)
+{
+    strncpy(destination, value, size - 1);
+    destination[size - 1] = '\0';
+}
+
+static void handlePushValue(void *context, uint8_t depth, const char *key, const char *value, bool isString)
+{
+    PushMessage *message = (PushMessage *)context;
+    if (depth == 1 && isString && strcmp(key, "type") == 0)
+    {
+        copyField(message->type, sizeof(message->type), value);
+    }
+    else if (depth == 2 && isString && strcmp(key, "message") == 0)
+    {
+        copyField(message->error, sizeof(message->error), value);
+    }
+    else
+    {
+        JsonFieldSet::handler(message->data, depth, key, value, isString); // Measurement fields in "data"
+    }
+}
+
+//
+// Runs the authorization/subscription handshake and forwards measurements.
+//
+void MeterPushClient::handleMessage(const char *payload, size_t length)
+{
+    int32_t values[METER_FIELD_COUNT];
+    JsonFieldSet fields(meterFieldsV2, METER_FIELD_COUNT, values, 2);
+    PushMessage message = {};
+    message.data = &fields;
+    JsonScanner scanner(handlePushValue, &message);
+    if (!scanner.feed(payload, length) || !scanner.done())
+    {
+        Serial.println("Meter push message is not valid JSON.");
+        return;
+    }
+
+    char reply[128];
+    if (strcmp(message.type, "authorization_requested") == 0)
+    {
+        snprintf(reply, sizeof(reply), "{\"type\":\"authorization\",\"data\":\"%s\"}", token);
+        ws.sendTXT(reply);
+    }
+    else if (strcmp(message.type, "authorized") == 0)
+    {
+        ws.sendTXT("{\"type\":\"subscribe\",\"data\":\"measurement\"}");
+        subscribed = true;
+        Serial.println("Meter push stream subscribed.");
+    }
+    else if (strcmp(message.type, "measurement") == 0)
+    {
+        MeterSample sample;
+        if (!buildMeterSample(fields, values, millis(), sample))
+        {
+            return;
+        }
+        lastMessageTime = sample.timestamp;
+        messages++;
+        onSample(sample);
+    }
+    else if (strcmp(message.type, "error") == 0)
+    {
+        Serial.print("Meter push error: ");
+        Serial.println(message.error);
+    }
+}
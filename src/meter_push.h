@@ -0,0 +1,43 @@
+#pragma once
+
+#include "meter_sample.h"     // Decoded meter measurements
+#include <WebSocketsClient.h> // WebSocket client for the meter push API
+
+//
+// Subscribes to the real-time measurement stream of the HomeWizard local
+// API (v2, wss://<meter>/api/ws) and reports every measurement.
+//
+// The meter pushes a measurement roughly every second, so the controller
+// reacts to solar changes without waiting for the next HTTP poll. The
+// connection is re-established automatically by the WebSocket library;
+// streaming() tells the caller when to fall back to HTTP polling.
+//
+class MeterPushClient
+{
+public:
+    // Called with every pushed measurement.
+    typedef void (*SampleHandler)(const MeterSample &sample);
+
+    // Connects to the meter at `host` and authorizes with the local API `token`.
+    void begin(const char *host, const char *token, SampleHandler handler);
+
+    // Services the WebSocket connection. Must be called frequently.
+    void loop();
+
+    // True while subscribed and measurements arrived within METER_PUSH_STALE_TIMEOUT.
+    bool streaming(unsigned long currentTime) const;
+
+    unsigned long messageCount() const { return messages; }
+
+private:
+    void handleEvent(WStype_t type, uint8_t *payload, size_t length);
+    void handleMessage(const char *payload, size_t length);
+
+    WebSocketsClient ws;
+    const char *token = "";
+    SampleHandler onSample = nullptr;
+
+    bool subscribed = false;           // Authorized and subscribed to measurements
+    unsigned long lastMessageTime = 0; // millis() of the last measurement received
+    unsigned long messages = 0;        // Number of measurements received
+};
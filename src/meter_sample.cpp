@@ -0,0 +1,85 @@
+//
+// Decoding of meter responses into MeterSample.
+//
+
+#include "meter_sample.h"
+
+const JsonField meterFieldsV1[METER_FIELD_COUNT] = {
+    {"active_power_w", 0},
+    {"active_power_l1_w", 0},
+    {"active_power_l2_w", 0},
+    {"active_power_l3_w", 0},
+    {"active_voltage_l1_v", 1},
+    {"active_voltage_l2_v", 1},
+    {"active_voltage_l3_v", 1},
+    {"active_current_l1_a", 2},
+    {"active_current_l2_a", 2},
+    {"active_current_l3_a", 2},
+    {"total_power_import_kwh", 3},
+    {"total_power_export_kwh", 3},
+};
+
+const JsonField meterFieldsV2[METER_FIELD_COUNT] = {
+    {"power_w", 0},
+    {"power_l1_w", 0},
+    {"power_l2_w", 0},
+    {"power_l3_w", 0},
+    {"voltage_l1_v", 1},
+    {"voltage_l2_v", 1},
+    {"voltage_l3_v", 1},
+    {"current_l1_a", 2},
+    {"current_l2_a", 2},
+    {"current_l3_a", 2},
+    {"energy_import_kwh", 3},
+    {"energy_export_kwh", 3},
+};
+
+static int16_t clampInt16(int32_t value)
+{
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : (int16_t)value);
+}
+
+bool buildMeterSample(const JsonFieldSet &fields, const int32_t *values, uint32_t timestamp, MeterSample &sample)
+{
+    if (!fields.has(FIELD_POWER))
+    {
+        return false;
+    }
+
+    sample = {};
+    sample.timestamp = timestamp;
+    for (uint8_t field = 0; field < METER_FIELD_COUNT; field++)
+    {
+        if (fields.has(field))
+        {
+            sample.fields |= 1U << field;
+        }
+    }
+
+    // Negate grid power to represent solar surplus.
+    sample.power = -values[FIELD_POWER];
+    for (uint8_t phase = 0; phase < 3; phase++)
+    {
+        if (fields.has(FIELD_POWER_L1 + phase))
+        {
+            sample.phasePower[phase] = -values[FIELD_POWER_L1 + phase];
+        }
+        if (fields.has(FIELD_VOLTAGE_L1 + phase))
+        {
+            sample.voltage[phase] = clampInt16(values[FIELD_VOLTAGE_L1 + phase]);
+        }
+        if (fields.has(FIELD_CURRENT_L1 + phase))
+        {
+            sample.current[phase] = clampInt16(values[FIELD_CURRENT_L1 + phase]);
+        }
+    }
+    if (fields.has(FIELD_IMPORT))
+    {
+        sample.importWh = (uint32_t)values[FIELD_IMPORT];
+    }
+    if (fields.has(FIELD_EXPORT))
+    {
+        sample.exportWh = (uint32_t)values[FIELD_EXPORT];
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "json_scanner.h" // JsonField / JsonFieldSet
+#include <stdint.h>       // Fixed-width integer types
+
+//
+// One meter measurement, decoded in a single pass over the meter response.
+//
+// Values are stored as fixed-point integers. Power is given as solar surplus
+// (the negated grid power), so positive values mean power is fed back into
+// the grid. The meter omits fields it cannot measure; `fields` tells which
+// ones were present.
+//
+struct MeterSample
+{
+    uint32_t timestamp;    // millis() when the measurement was received
+    int32_t power;         // Total surplus in W
+    int32_t phasePower[3]; // Surplus per phase (L1..L3) in W
+    uint32_t importWh;     // Total energy imported from the grid in Wh
+    uint32_t exportWh;     // Total energy exported to the grid in Wh
+    int16_t voltage[3];    // Voltage per phase in 0.1 V
+    int16_t current[3];    // Current per phase in 0.01 A
+    uint16_t fields;       // Bitmask of present fields (1 << MeterField)
+
+    bool has(uint8_t field) const { return (fields & (1U << field)) != 0; }
+};
+
+// Fields decoded into a MeterSample, in the order of the field tables below
+enum MeterField : uint8_t
+{
+    FIELD_POWER,
+    FIELD_POWER_L1,
+    FIELD_POWER_L2,
+    FIELD_POWER_L3,
+    FIELD_VOLTAGE_L1,
+    FIELD_VOLTAGE_L2,
+    FIELD_VOLTAGE_L3,
+    FIELD_CURRENT_L1,
+    FIELD_CURRENT_L2,
+    FIELD_CURRENT_L3,
+    FIELD_IMPORT,
+    FIELD_EXPORT,
+    METER_FIELD_COUNT
+};
+
+// Field names of the HomeWizard /api/v1/data endpoint
+extern const JsonField meterFieldsV1[METER_FIELD_COUNT];
+
+// Field names of the HomeWizard local API v2 measurement
+extern const JsonField meterFieldsV2[METER_FIELD_COUNT];
+
+//
+// Fills `sample` from the values extracted with one of the field tables.
+// Returns false if the total power is missing.
+//
+bool buildMeterSample(const JsonFieldSet &fields, const int32_t *values, uint32_t timestamp, MeterSample &sample);
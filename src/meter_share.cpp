@@ -0,0 +1,151 @@
+//
+// Meter sample rebroadcast over UDP multicast.
+//
+
+#include "meter_share.h"
+#include "config.h" // Group address and timeouts
+#include <WiFi.h>   // Link state
+
+static const uint32_t SHARE_MAGIC = 0x4853454D; // "MESH"
+static const uint8_t SHARE_VERSION = 1;
+
+// Wire format of a shared sample (little-endian, as on the ESP32)
+struct SharePacket
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t fields;
+    uint32_t session;
+    uint32_t sequence;
+    uint32_t age; // Time (ms) between the measurement and sending it
+    int32_t power;
+    int32_t phasePower[3];
+    uint32_t importWh;
+    uint32_t exportWh;
+    int16_t voltage[3];
+    int16_t current[3];
+};
+
+static_assert(sizeof(SharePacket) == 56, "SharePacket layout changed, bump SHARE_VERSION");
+
+static IPAddress shareGroup()
+{
+    return IPAddress(METER_SHARE_GROUP[0], METER_SHARE_GROUP[1], METER_SHARE_GROUP[2], METER_SHARE_GROUP[3]);
+}
+
+void MeterShare::publish(const MeterSample &sample)
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        return;
+    }
+    if (session == 0)
+    {
+        session = esp_random() | 1; // Never 0, so subscribers can tell it from "none yet".
+    }
+
+    SharePacket packet = {};
+    packet.magic = SHARE_MAGIC;
+    packet.version = SHARE_VERSION;
+    packet.fields = sample.fields;
+    packet.session = session;
+    packet.sequence = ++sequence;
+    packet.age = millis() - sample.timestamp;
+    packet.power = sample.power;
+    packet.importWh = sample.importWh;
+    packet.exportWh = sample.exportWh;
+    for (uint8_t phase = 0; phase < 3; phase++)
+    {
+        packet.phasePower[phase] = sample.phasePower[phase];
+        packet.voltage[phase] = sample.voltage[phase];
+        packet.current[phase] = sample.current[phase];
+    }
+
+    udp.beginPacket(shareGroup(), METER_SHARE_PORT);
+    udp.write((const uint8_t *)&packet, sizeof(packet));
+    if (udp.endPacket())
+    {
+        sent++;
+    }
+}
+
+//
+// Joins the multicast group. Membership is tied to the network interface,
+// so it is renewed after every reconnect.
+//
+bool MeterShare::join()
+{
+    if (!udp.beginMulticast(shareGroup(), METER_SHARE_PORT))
+    {
+        return false;
+    }
+    joined = true;
+    Serial.printf("Joined meter share group on port %d.\n", METER_SHARE_PORT);
+    return true;
+}
+
+void MeterShare::receive(SampleHandler handler)
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        if (joined)
+        {
+            udp.stop();
+            joined = false;
+        }
+        return;
+    }
+    if (!joined && !join())
+    {
+        return;
+    }
+
+    while (udp.parsePacket() > 0)
+    {
+        SharePacket packet;
+        int length = udp.read((uint8_t *)&packet, sizeof(packet));
+        if (length != (int)sizeof(packet) || packet.magic != SHARE_MAGIC || packet.version != SHARE_VERSION)
+        {
+            continue;
+        }
+
+        // A new session means the publisher restarted (or another one took over).
+        int32_t step = (int32_t)(packet.sequence - sequence);
+        if (packet.session != session)
+        {
+            session = packet.session;
+        }
+        else if (step <= 0)
+        {
+            continue; // Duplicate or reordered.
+        }
+        else
+        {
+            lost += step - 1;
+        }
+        sequence = packet.sequence;
+
+        MeterSample sample = {};
+        unsigned long currentTime = millis();
+        sample.timestamp = currentTime - packet.age;
+        sample.power = packet.power;
+        sample.importWh = packet.importWh;
+        sample.exportWh = packet.exportWh;
+        sample.fields = packet.fields;
+        for (uint8_t phase = 0; phase < 3; phase++)
+        {
+            sample.phasePower[phase] = packet.phasePower[phase];
+            sample.voltage[phase] = packet.voltage[phase];
+            sample.current[phase] = packet.current[phase];
+        }
+        lastReceiveTime = currentTime;
+        received++;
+        handler(sample);
+    }
+}
+
+bool MeterShare::streaming(unsigned long currentTime) const
+{
+    return received > 0 && currentTime - lastReceiveTime < METER_SHARE_STALE_TIMEOUT;
+}
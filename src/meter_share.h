@@ -0,0 +1,48 @@
+#pragma once
+
+#include "meter_sample.h" // Shared meter measurements
+#include <WiFiUdp.h>      // UDP multicast
+
+//
+// Shares meter samples between controllers on the same network.
+//
+// One unit (METER_SHARE_PUBLISH) polls the meter and sends every sample to
+// a UDP multicast group; the others (METER_SOURCE_SHARED) take their
+// samples from the group instead of polling, so the meter sees a single
+// client and all units act on the same readings. Each packet carries the
+// publisher's session id (random per boot) and a sequence number:
+// duplicated or reordered packets are dropped and gaps are counted as
+// lost.
+//
+class MeterShare
+{
+public:
+    // Called with every sample received from the group.
+    typedef void (*SampleHandler)(const MeterSample &sample);
+
+    // Sends a sample to the group (publisher).
+    void publish(const MeterSample &sample);
+
+    // Joins the group while WiFi is up and delivers received samples (subscriber).
+    void receive(SampleHandler handler);
+
+    // True while samples arrived within METER_SHARE_STALE_TIMEOUT (subscriber).
+    bool streaming(unsigned long currentTime) const;
+
+    unsigned long sentCount() const { return sent; }
+    unsigned long receivedCount() const { return received; }
+    unsigned long lostCount() const { return lost; }
+
+private:
+    bool join();
+
+    WiFiUDP udp;
+    bool joined = false;   // Listening on the group (subscriber)
+    uint32_t session = 0;  // Own session id (publisher) or the one followed (subscriber)
+    uint32_t sequence = 0; // Last sequence number sent or received
+
+    unsigned long lastReceiveTime = 0; // millis() of the last accepted sample
+    unsigned long sent = 0;
+    unsigned long received = 0;
+    unsigned long lost = 0;
+};
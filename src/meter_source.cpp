@@ -0,0 +1,87 @@
+//
+// Priority-ordered meter sources with failover.
+//
+
+#include "meter_source.h"
+
+MeterSourceSet *MeterSourceSet::servicing = nullptr;
+
+bool MeterSourceSet::add(MeterSource &source)
+{
+    if (sourceCount >= MAX_SOURCES)
+    {
+        return false;
+    }
+    sources[sourceCount++] = &source;
+    return true;
+}
+
+void MeterSourceSet::service(uint32_t currentTime, MeterSource::SampleHandler handler)
+{
+    servicing = this;
+    output = handler;
+    bool covered = false; // A source above the current one is fresh
+    for (int i = 0; i < sourceCount; i++)
+    {
+        current = i;
+        currentNeeded = !covered;
+        sources[i]->service(currentTime, currentNeeded, deliver);
+        covered = covered || sources[i]->fresh(currentTime);
+    }
+    servicing = nullptr;
+}
+
+//
+// Counts a sample of the source being serviced and passes it on if no source above it is fresh.
+//
+void MeterSourceSet::deliver(const MeterSample &sample)
+{
+    MeterSourceSet &set = *servicing;
+    set.samples[set.current]++;
+    if (set.currentNeeded)
+    {
+        set.used[set.current]++;
+        set.output(sample);
+    }
+}
+
+uint32_t MeterSourceSet::serviceDelay(uint32_t currentTime) const
+{
+    uint32_t delay = UINT32_MAX;
+    bool covered = false;
+    for (int i = 0; i < sourceCount; i++)
+    {
+        uint32_t sourceDelay = sources[i]->serviceDelay(currentTime, !covered);
+        delay = sourceDelay < delay ? sourceDelay : delay;
+        covered = covered || sources[i]->fresh(currentTime);
+    }
+    return delay;
+}
+
+int MeterSourceSet::active(uint32_t currentTime) const
+{
+    for (int i = 0; i < sourceCount; i++)
+    {
+        if (sources[i]->fresh(currentTime))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint32_t MeterSourceSet::sampleInterval(uint32_t currentTime) const
+{
+    int index = active(currentTime);
+    if (index >= 0)
+    {
+        return sources[index]->sampleInterval();
+    }
+    uint32_t interval = 0;
+    for (int i = 0; i < sourceCount; i++)
+    {
+        uint32_t sourceInterval = sources[i]->sampleInterval();
+        interval = sourceInterval > interval ? sourceInterval : interval;
+    }
+    return interval;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "meter_sample.h" // Decoded meter measurements
+#include <stdint.h>       // Fixed-width integer types
+
+//
+// A source of surplus measurements: the meter API, its push stream, shared
+// samples, an inverter or a local sensor.
+//
+// Sources are serviced from the meter task. They deliver their samples
+// through the handler given to service() and report whether they are
+// currently delivering with fresh().
+//
+class MeterSource
+{
+public:
+    // Called with every sample of the source.
+    typedef void (*SampleHandler)(const MeterSample &sample);
+
+    virtual ~MeterSource() {}
+
+    // Short name for the serial monitor and metrics.
+    virtual const char *name() const = 0;
+
+    // Services the source and delivers new samples to `handler`. `needed` is
+    // false while a source of higher priority is fresh: polled sources then
+    // stop polling, streams keep their connection up.
+    virtual void service(uint32_t currentTime, bool needed, SampleHandler handler) = 0;
+
+    // Longest time (ms) until service() must be called again.
+    virtual uint32_t serviceDelay(uint32_t currentTime, bool needed) const = 0;
+
+    // True while the source delivers samples. A source that knows it failed
+    // (an error response, a lost connection) turns stale right away.
+    virtual bool fresh(uint32_t currentTime) const = 0;
+
+    // Longest time (ms) between two samples while the source delivers: the
+    // poll interval of a polled source, the stale timeout of a stream.
+    virtual uint32_t sampleInterval() const = 0;
+};
+
+//
+// Sources in priority order, with failover.
+//
+// The samples of the first fresh source are used (the active source), those
+// of the sources below it are dropped. A source is only needed, and polled,
+// while no source above it is fresh, so the fallbacks cost nothing while the
+// primary delivers and take over as soon as it turns stale. The primary stays
+// needed all along and takes over again with its first sample.
+//
+class MeterSourceSet
+{
+public:
+    static const int MAX_SOURCES = 5;
+
+    // Appends a source below the ones added before. Returns false if the set is full.
+    bool add(MeterSource &source);
+
+    // Services all sources; the samples of the active source go to `handler`.
+    void service(uint32_t currentTime, MeterSource::SampleHandler handler);
+
+    // Longest time (ms) until service() must be called again.
+    uint32_t serviceDelay(uint32_t currentTime) const;
+
+    // Index of the first fresh source, or -1 if none is fresh.
+    int active(uint32_t currentTime) const;
+
+    // Longest time (ms) between two samples: that of the active source, or the
+    // longest of all sources while none is fresh, as any of them may resume.
+    uint32_t sampleInterval(uint32_t currentTime) const;
+
+    int count() const { return sourceCount; }
+    const MeterSource &source(int index) const { return *sources[index]; }
+    unsigned long sampleCount(int index) const { return samples[index]; } // Samples delivered by the source
+    unsigned long usedCount(int index) const { return used[index]; }      // Samples passed on from the source
+
+private:
+    static void deliver(const MeterSample &sample);
+
+    MeterSource *sources[MAX_SOURCES] = {};
+    unsigned long samples[MAX_SOURCES] = {};
+    unsigned long used[MAX_SOURCES] = {};
+    int sourceCount = 0;
+
+    // The source being serviced, for deliver()
+    static MeterSourceSet *servicing;
+    int current = 0;
+    bool currentNeeded = false;
+    MeterSource::SampleHandler output = nullptr;
+};
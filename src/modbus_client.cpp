@@ -0,0 +1,112 @@
+//
+// Modbus TCP register reads.
+//
+
+#include "modbus_client.h"
+#include "config.h" // MODBUS_TIMEOUT
+
+static const uint8_t MBAP_HEADER_SIZE = 7; // Transaction, protocol, length, unit
+
+void ModbusClient::begin(const uint8_t ip[4], uint16_t devicePort, uint8_t deviceUnit)
+{
+    address = IPAddress(ip[0], ip[1], ip[2], ip[3]);
+    port = devicePort;
+    unit = deviceUnit;
+}
+
+bool ModbusClient::readRegisters(uint8_t function, uint16_t start, uint16_t count, uint16_t *values)
+{
+    if (count == 0 || count > MAX_REGISTERS)
+    {
+        return false;
+    }
+    if (!tcp.connected())
+    {
+        tcp.stop(); // Release any half-closed socket before reconnecting.
+        if (!tcp.connect(address, port, MODBUS_TIMEOUT))
+        {
+            errors++;
+            return false;
+        }
+        tcp.setNoDelay(true);
+    }
+
+    // MBAP header and PDU; all fields are big-endian.
+    transaction++;
+    uint8_t request[12] = {
+        (uint8_t)(transaction >> 8), (uint8_t)transaction, 0, 0, 0, 6, unit,
+        function, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count,
+    };
+    requests++;
+    if (tcp.write(request, sizeof(request)) != sizeof(request))
+    {
+        return fail();
+    }
+
+    // Header and function code first: an exception response is shorter.
+    unsigned long deadline = millis() + MODBUS_TIMEOUT;
+    uint8_t response[MBAP_HEADER_SIZE + 2 + 2 * MAX_REGISTERS];
+    if (!readBytes(response, MBAP_HEADER_SIZE + 2, deadline))
+    {
+        return fail();
+    }
+    uint16_t id = (uint16_t)(response[0] << 8 | response[1]);
+    if (id != transaction || response[2] != 0 || response[3] != 0 || response[6] != unit)
+    {
+        return fail(); // Not the answer to this request.
+    }
+    if (response[7] != function)
+    {
+        if (response[7] == (function | 0x80))
+        {
+            Serial.printf("Modbus exception %u reading register %u.\n", response[8], start);
+            errors++;
+            return false; // The connection is still in sync.
+        }
+        return fail();
+    }
+    if (response[8] != 2 * count || !readBytes(response + MBAP_HEADER_SIZE + 2, 2 * count, deadline))
+    {
+        return fail();
+    }
+    for (uint16_t i = 0; i < count; i++)
+    {
+        values[i] = (uint16_t)(response[MBAP_HEADER_SIZE + 2 + 2 * i] << 8 | response[MBAP_HEADER_SIZE + 3 + 2 * i]);
+    }
+    return true;
+}
+
+//
+// Reads exactly `length` bytes, waiting until `deadline` (millis()) at most.
+//
+bool ModbusClient::readBytes(uint8_t *buffer, size_t length, unsigned long deadline)
+{
+    size_t received = 0;
+    while (received < length)
+    {
+        if (tcp.available() > 0)
+        {
+            int read = tcp.read(buffer + received, length - received);
+            received += read > 0 ? read : 0;
+        }
+        else if ((long)(millis() - deadline) >= 0 || !tcp.connected())
+        {
+            return false;
+        }
+        else
+        {
+            delay(1);
+        }
+    }
+    return true;
+}
+
+//
+// Counts a failed request and drops the connection, which may hold a partial response.
+//
+bool ModbusClient::fail()
+{
+    errors++;
+    tcp.stop();
+    return false;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <WiFiClient.h> // TCP connection to the device
+#include <stdint.h>     // Fixed-width integer types
+
+//
+// Minimal Modbus TCP client for reading registers of an inverter or meter.
+//
+// One TCP connection is kept open between requests, as with the meter API.
+// Requests are answered one at a time: each carries a new transaction id
+// and a response that does not match it, or an exception response, fails
+// the read.
+//
+class ModbusClient
+{
+public:
+    // Sets the device at `ip`:`port` and its unit id. Connects on the first read.
+    void begin(const uint8_t ip[4], uint16_t port, uint8_t unit);
+
+    // Reads `count` (at most MAX_REGISTERS) registers from `address` with
+    // function 3 (holding) or 4 (input registers) into `values`. Returns
+    // false on a connection error, timeout or exception response.
+    bool readRegisters(uint8_t function, uint16_t address, uint16_t count, uint16_t *values);
+
+    // Closes the connection, e.g. after a malformed response.
+    void disconnect() { tcp.stop(); }
+
+    unsigned long requestCount() const { return requests; }
+    unsigned long errorCount() const { return errors; }
+
+    static const uint16_t MAX_REGISTERS = 4;
+
+private:
+    bool readBytes(uint8_t *buffer, size_t length, unsigned long deadline);
+    bool fail();
+
+    WiFiClient tcp;
+    IPAddress address;
+    uint16_t port = 502;
+    uint8_t unit = 1;
+    uint16_t transaction = 0;
+
+    unsigned long requests = 0; // Number of requests sent
+    unsigned long errors = 0;   // Number of failed requests
+};
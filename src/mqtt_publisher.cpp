@@ -0,0 +1,206 @@
+//
+// Batched MQTT telemetry with offline buffering.
+//
+
+#include "mqtt_publisher.h"
+#include "perf_stats.h" // Encoding time
+#include <WiFi.h>       // Link state
+#include <string.h>     // memcpy
+
+// Payload of one batch; sized for MQTT_BATCH_MAX records of at most 32 characters each.
+static const size_t PAYLOAD_SIZE = 1024;
+static_assert(MQTT_BATCH_MAX * 32 + 128 <= (int)PAYLOAD_SIZE, "MQTT_BATCH_MAX does not fit the payload buffer");
+
+// Limits the time spent catching up on a backlog per service() call.
+static const int MAX_BATCHES_PER_SERVICE = 4;
+
+void MqttPublisher::begin(const char *server, uint16_t port)
+{
+    uint64_t mac = ESP.getEfuseMac();
+    snprintf(device, sizeof(device), "esp32-%04x%08lx", (unsigned)(uint16_t)(mac >> 32), (unsigned long)(uint32_t)mac);
+    snprintf(telemetryTopic, sizeof(telemetryTopic), "%s/%s/telemetry%s", MQTT_TOPIC_PREFIX, device,
+             TELEMETRY_ENCODING == TELEMETRY_BINARY ? "/bin" : "");
+    snprintf(statusTopic, sizeof(statusTopic), "%s/%s/status", MQTT_TOPIC_PREFIX, device);
+    snprintf(configTopic, sizeof(configTopic), "%s/%s/config", MQTT_TOPIC_PREFIX, device);
+
+    mqtt.setServer(server, port);
+    mqtt.setBufferSize(PAYLOAD_SIZE + 128); // Room for the topic and packet header
+    if (MQTT_CONFIG_ENABLED)
+    {
+        mqtt.setCallback([this](char *topic, uint8_t *payload, unsigned int length)
+                         { receive(topic, payload, length); });
+    }
+}
+
+bool MqttPublisher::post(const TelemetryRecord &record)
+{
+    return queue.push(record);
+}
+
+void MqttPublisher::service(unsigned long currentTime)
+{
+    // Move the posted records into the offline buffer, overwriting the oldest when full.
+    TelemetryRecord record;
+    while (queue.pop(record))
+    {
+        if (pending.size() == MQTT_BUFFER_SIZE)
+        {
+            dropped++;
+        }
+        pending.push(record);
+    }
+
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        return;
+    }
+    if (!mqtt.connected() && !connect(currentTime))
+    {
+        return;
+    }
+    mqtt.loop(); // Delivers configuration messages to receive().
+    publishConfig();
+
+    for (int i = 0; i < MAX_BATCHES_PER_SERVICE && batchDue(currentTime); i++)
+    {
+        if (!publishBatch())
+        {
+            break; // Retried at the next service, the records stay buffered.
+        }
+    }
+}
+
+//
+// Connects to the broker, at most once per MQTT_RECONNECT_INTERVAL.
+//
+bool MqttPublisher::connect(unsigned long currentTime)
+{
+    if (attempted && currentTime - lastConnectAttempt < MQTT_RECONNECT_INTERVAL)
+    {
+        return false;
+    }
+    attempted = true;
+    lastConnectAttempt = currentTime;
+
+    if (!mqtt.connect(device, statusTopic, 0, true, "offline"))
+    {
+        Serial.printf("MQTT connection failed, state %d\n", mqtt.state());
+        return false;
+    }
+    mqtt.publish(statusTopic, "online", true);
+    if (MQTT_CONFIG_ENABLED)
+    {
+        char setTopic[72];
+        snprintf(setTopic, sizeof(setTopic), "%s/set", configTopic);
+        mqtt.subscribe(setTopic);
+    }
+    Serial.printf("MQTT connected as %s, %u records buffered.\n", device, (unsigned)pending.size());
+    return true;
+}
+
+//
+// Queues a message on the config/set topic for loop(). Called by the MQTT
+// client in the meter task; a message that is too long is passed on cut
+// off, for loop() to reject.
+//
+void MqttPublisher::receive(char *topic, uint8_t *payload, unsigned int length)
+{
+    ConfigText message;
+    message.flag = length <= (unsigned)MQTT_CONFIG_SIZE;
+    length = message.flag ? length : MQTT_CONFIG_SIZE;
+    memcpy(message.text, payload, length);
+    message.text[length] = '\0';
+    if (!configRequests.push(message))
+    {
+        Serial.println("Configuration message queue full. Dropping message.");
+    }
+}
+
+bool MqttPublisher::receiveConfig(char *buffer, size_t size, bool &complete)
+{
+    ConfigText message;
+    if (!configRequests.pop(message))
+    {
+        return false;
+    }
+    complete = message.flag;
+    snprintf(buffer, size, "%s", message.text);
+    return true;
+}
+
+bool MqttPublisher::postConfig(bool accepted, const char *text)
+{
+    ConfigText message;
+    message.flag = accepted;
+    snprintf(message.text, sizeof(message.text), "%s", text);
+    return configReplies.push(message);
+}
+
+//
+// Publishes the replies posted by loop().
+//
+void MqttPublisher::publishConfig()
+{
+    ConfigText message;
+    while (configReplies.pop(message))
+    {
+        char errorTopic[72];
+        snprintf(errorTopic, sizeof(errorTopic), "%s/error", configTopic);
+        mqtt.publish(message.flag ? configTopic : errorTopic, message.text, message.flag);
+    }
+}
+
+//
+// A batch is due when a switch event waits, enough samples have been
+// collected, or the oldest record has waited MQTT_BATCH_INTERVAL.
+//
+bool MqttPublisher::batchDue(unsigned long currentTime) const
+{
+    size_t count = pending.size();
+    if (count == 0)
+    {
+        return false;
+    }
+    if (count >= (size_t)MQTT_BATCH_SIZE || currentTime - pending.recent(count - 1).timestamp >= MQTT_BATCH_INTERVAL)
+    {
+        return true;
+    }
+    for (size_t age = 0; age < count; age++)
+    {
+        if (pending.recent(age).type == TELEMETRY_SWITCH)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Publishes the oldest buffered records as one message.
+//
+bool MqttPublisher::publishBatch()
+{
+    static TelemetryRecord batch[MQTT_BATCH_MAX];
+    static uint8_t payload[PAYLOAD_SIZE];
+    size_t count = pending.size() < (size_t)MQTT_BATCH_MAX ? pending.size() : MQTT_BATCH_MAX;
+    for (size_t i = 0; i < count; i++)
+    {
+        batch[i] = pending.recent(pending.size() - 1 - i); // Oldest first
+    }
+
+    TelemetryBatchInfo info = {device, (uint32_t)millis(), (uint32_t)droppedCount()};
+    size_t length;
+    {
+        PerfTimer timer(STAGE_TELEMETRY_ENCODE);
+        length = TELEMETRY_ENCODING == TELEMETRY_BINARY
+                     ? encodeTelemetryBinary(info, batch, count, payload, sizeof(payload))
+                     : encodeTelemetryJson(info, batch, count, (char *)payload, sizeof(payload));
+    }
+    if (!mqtt.publish(telemetryTopic, payload, length, false))
+    {
+        return false;
+    }
+    pending.dropOldest(count);
+    published++;
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "config.h"          // Buffer and batch sizes
+#include "rolling_stats.h"   // Offline record buffer
+#include "spsc_queue.h"      // Records handed over from loop()
+#include "telemetry_codec.h" // Payload encodings
+#include <PubSubClient.h>    // MQTT client
+#include <WiFiClient.h>      // TCP connection to the broker
+
+//
+// Publishes telemetry to an MQTT broker in batches.
+//
+// loop() posts records, the meter task services the connection, so broker
+// latency or outages never delay the control decisions. Samples are
+// collected into one message per batch on <prefix>/<device>/telemetry
+// (JSON) or <prefix>/<device>/telemetry/bin (TELEMETRY_BINARY);
+// records are kept in a bounded ring while the broker is unreachable and
+// flushed after reconnecting. A retained "online"/"offline" status (the
+// latter as last will) is kept on <prefix>/<device>/status.
+//
+// With MQTT_CONFIG_ENABLED, messages on <prefix>/<device>/config/set are
+// handed to loop() through receiveConfig(), and the replies loop() posts
+// with postConfig() are published on <prefix>/<device>/config (retained)
+// or <prefix>/<device>/config/error.
+//
+class MqttPublisher
+{
+public:
+    // Configures the broker. The device id is derived from the MAC address.
+    void begin(const char *server, uint16_t port);
+
+    // Queues a record for publishing. Called from loop(); never blocks.
+    bool post(const TelemetryRecord &record);
+
+    // Connects, reconnects and publishes due batches. Called from the meter task.
+    void service(unsigned long currentTime);
+
+    // Takes the next configuration message into `buffer`; `complete` is false
+    // when it was longer than MQTT_CONFIG_SIZE and cut off. Called from loop().
+    bool receiveConfig(char *buffer, size_t size, bool &complete);
+
+    // Queues the configuration (`accepted`) or the reason a message was
+    // rejected for publishing. Called from loop(); never blocks.
+    bool postConfig(bool accepted, const char *text);
+
+    bool connected() { return mqtt.connected(); }
+    const char *deviceId() const { return device; }
+    unsigned long publishedCount() const { return published; }
+    unsigned long droppedCount() const { return dropped + queue.droppedCount(); }
+
+private:
+    struct ConfigText
+    {
+        bool flag;                        // Reply: published on config, not config/error; request: complete
+        char text[MQTT_CONFIG_SIZE + 32]; // Room for the reason of a rejection
+    };
+
+    bool connect(unsigned long currentTime);
+    void receive(char *topic, uint8_t *payload, unsigned int length);
+    void publishConfig();
+    bool batchDue(unsigned long currentTime) const;
+    bool publishBatch();
+
+    WiFiClient tcp;
+    PubSubClient mqtt{tcp};
+    char device[24] = "";
+    char telemetryTopic[64] = "";
+    char statusTopic[64] = "";
+    char configTopic[64] = "";
+
+    SpscQueue<TelemetryRecord, MQTT_QUEUE_SIZE> queue;     // From loop() to the meter task
+    SampleRing<TelemetryRecord, MQTT_BUFFER_SIZE> pending; // Not yet published, oldest first
+    SpscQueue<ConfigText, 4> configRequests;               // Received by the meter task for loop()
+    SpscQueue<ConfigText, 4> configReplies;                // From loop() to the meter task
+    unsigned long lastConnectAttempt = 0;
+    bool attempted = false;
+    unsigned long published = 0; // Number of batches published
+    unsigned long dropped = 0;   // Records overwritten while the broker was unreachable
+};
@@ -0,0 +1,107 @@
+//
+// Push button and rotary encoder input.
+//
+
+#include "nav_input.h"
+#include <Arduino.h>   // Pins and interrupts
+#include <esp_timer.h> // Edge timestamps
+
+// Position change for each transition (previous AB << 2 | new AB) of the
+// quadrature channels; invalid transitions (both changed, a missed edge) count 0.
+static const int8_t QUADRATURE_STEPS[16] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+
+static uint8_t IRAM_ATTR encoderLevels()
+{
+    return (digitalRead(NAV_ENCODER_PIN_A) == HIGH ? 2 : 0) | (digitalRead(NAV_ENCODER_PIN_B) == HIGH ? 1 : 0);
+}
+
+void NavInput::begin(NavInputType type, TaskHandle_t wakeTask)
+{
+    inputType = type;
+    task = wakeTask;
+    if (type == NAV_INPUT_NONE)
+    {
+        return;
+    }
+    pinMode(NAV_BUTTON_PIN, INPUT_PULLUP);
+    attachInterruptArg(NAV_BUTTON_PIN, buttonInterrupt, this, CHANGE);
+    if (type == NAV_INPUT_ENCODER)
+    {
+        pinMode(NAV_ENCODER_PIN_A, INPUT_PULLUP);
+        pinMode(NAV_ENCODER_PIN_B, INPUT_PULLUP);
+        encoderState = encoderLevels();
+        attachInterruptArg(NAV_ENCODER_PIN_A, encoderInterrupt, this, CHANGE);
+        attachInterruptArg(NAV_ENCODER_PIN_B, encoderInterrupt, this, CHANGE);
+    }
+}
+
+NavEvent NavInput::read()
+{
+    if (presses != pressesRead)
+    {
+        pressesRead++;
+        return inputType == NAV_INPUT_ENCODER ? NAV_SELECT : NAV_NEXT;
+    }
+    int32_t steps = position - positionRead;
+    if (steps >= NAV_ENCODER_STEPS)
+    {
+        positionRead += NAV_ENCODER_STEPS;
+        return NAV_NEXT;
+    }
+    if (steps <= -NAV_ENCODER_STEPS)
+    {
+        positionRead -= NAV_ENCODER_STEPS;
+        return NAV_PREVIOUS;
+    }
+    return NAV_NONE;
+}
+
+//
+// Counts a press on a falling edge after the line was stable for NAV_DEBOUNCE_TIME.
+// Contact bounce, on press and on release, never leaves the line stable that long.
+//
+void IRAM_ATTR NavInput::buttonInterrupt(void *argument)
+{
+    NavInput *input = static_cast<NavInput *>(argument);
+    int64_t now = esp_timer_get_time();
+    bool stable = now - input->lastButtonEdge >= (int64_t)NAV_DEBOUNCE_TIME * 1000;
+    input->lastButtonEdge = now;
+    if (stable && digitalRead(NAV_BUTTON_PIN) == LOW)
+    {
+        input->presses = input->presses + 1;
+        input->wake();
+    }
+}
+
+//
+// Follows the quadrature states of the encoder; wakes the task at each detent.
+//
+void IRAM_ATTR NavInput::encoderInterrupt(void *argument)
+{
+    NavInput *input = static_cast<NavInput *>(argument);
+    uint8_t levels = encoderLevels();
+    int8_t step = QUADRATURE_STEPS[(input->encoderState << 2) | levels];
+    input->encoderState = levels;
+    if (step != 0)
+    {
+        input->position = input->position + step;
+        if (input->position % NAV_ENCODER_STEPS == 0)
+        {
+            input->wake();
+        }
+    }
+}
+
+void IRAM_ATTR NavInput::wake()
+{
+    if (task == nullptr)
+    {
+        return;
+    }
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "config.h"            // NavInputType
+#include <freertos/FreeRTOS.h> // FreeRTOS types
+#include <freertos/task.h>     // Task notifications
+#include <stdint.h>            // Fixed-width integer types
+
+//
+// Push button or rotary encoder for stepping through the LCD pages.
+//
+// The inputs are read in GPIO interrupts, so no press or encoder step is
+// missed however long loop() sleeps: the button counts presses (a falling
+// edge after the line was stable high for NAV_DEBOUNCE_TIME), the encoder
+// decodes the quadrature states of its two channels into a position. Each
+// input wakes the task given to begin(), which collects the counts with
+// read() without touching any hardware.
+//
+enum NavEvent : uint8_t
+{
+    NAV_NONE,
+    NAV_NEXT,     // Button press or encoder turned clockwise
+    NAV_PREVIOUS, // Encoder turned counter-clockwise
+    NAV_SELECT    // Encoder push switch
+};
+
+class NavInput
+{
+public:
+    // Sets up the pins and interrupts of `type`; inputs wake `wakeTask`.
+    void begin(NavInputType type, TaskHandle_t wakeTask);
+
+    // Returns the next event since the last call, NAV_NONE if there is none.
+    NavEvent read();
+
+    unsigned long pressCount() const { return presses; }
+
+private:
+    static void buttonInterrupt(void *argument);
+    static void encoderInterrupt(void *argument);
+    void wake();
+
+    NavInputType inputType = NAV_INPUT_NONE;
+    TaskHandle_t task = nullptr;
+
+    // Written by the interrupts
+    volatile unsigned long presses = 0;  // Button presses counted
+    volatile int64_t lastButtonEdge = 0; // esp_timer time (us) of the last button edge
+    volatile int32_t position = 0;       // Encoder position in quadrature steps
+    volatile uint8_t encoderState = 0;   // Last levels of channels A and B
+
+    // Used by read()
+    unsigned long pressesRead = 0;
+    int32_t positionRead = 0; // Position of the last reported detent
+};
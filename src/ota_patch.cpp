@@ -0,0 +1,100 @@
+//
+// Delta package decoding.
+//
+
+#include "ota_patch.h"
+
+bool DeltaDecoder::readVarint(uint8_t byte)
+{
+    if (shift > 28)
+    {
+        state = Failed; // Longer than 32 bits
+        return false;
+    }
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+    return (byte & 0x80) == 0;
+}
+
+bool DeltaDecoder::feed(const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        if (state == Failed || state == End)
+        {
+            state = Failed; // Nothing may follow the end of the image.
+            return false;
+        }
+
+        if (state == InsertData)
+        {
+            // Pass literal runs on in place, as large as the chunk allows.
+            size_t run = length - i < remaining ? length - i : remaining;
+            if (!onData(context, data + i, run))
+            {
+                state = Failed;
+                return false;
+            }
+            i += run;
+            remaining -= run;
+            state = remaining == 0 ? ExpectOp : InsertData;
+            continue;
+        }
+
+        uint8_t byte = data[i++];
+        if (state == ExpectOp)
+        {
+            value = 0;
+            shift = 0;
+            if (byte == 'C')
+            {
+                state = CopyOffset;
+            }
+            else if (byte == 'I')
+            {
+                state = InsertLength;
+            }
+            else if (byte == 'E')
+            {
+                state = End;
+            }
+            else
+            {
+                state = Failed;
+            }
+            continue;
+        }
+
+        if (!readVarint(byte))
+        {
+            if (state == Failed)
+            {
+                return false;
+            }
+            continue;
+        }
+        if (state == CopyOffset)
+        {
+            offset = value;
+            value = 0;
+            shift = 0;
+            state = CopyLength;
+        }
+        else if (state == CopyLength)
+        {
+            if (!onCopy(context, offset, value))
+            {
+                state = Failed;
+                return false;
+            }
+            state = ExpectOp;
+        }
+        else
+        {
+            remaining = value;
+            state = remaining > 0 ? InsertData : ExpectOp;
+        }
+    }
+    return state != Failed;
+}
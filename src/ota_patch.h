@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Firmware update packages, as written by tools/make_ota.py.
+//
+// A package is an OtaHeader followed by a zlib stream. For a full image the
+// stream inflates to the image itself. For a delta it inflates to a list of
+// operations that rebuild the new image from the running one:
+//
+//   'C' <offset> <length>  copy `length` bytes of the running image from `offset`
+//   'I' <length> <bytes>   insert `length` literal bytes
+//   'E'                    end of the image
+//
+// Numbers are unsigned LEB128 varints. Integers in the header are little-endian.
+//
+struct OtaHeader
+{
+    char magic[4];          // OTA_PACKAGE_MAGIC
+    uint8_t version;        // OTA_PACKAGE_VERSION
+    uint8_t type;           // OtaPackageType
+    uint16_t reserved;      // Zero
+    uint32_t imageSize;     // Size of the new image in bytes
+    uint32_t baseSize;      // Delta: size of the image it applies to
+    uint8_t imageHash[32];  // SHA-256 of the new image
+    uint8_t baseHash[32];   // Delta: SHA-256 of the image it applies to
+};
+
+static_assert(sizeof(OtaHeader) == 80, "OtaHeader must match tools/make_ota.py");
+
+const char OTA_PACKAGE_MAGIC[4] = {'E', 'M', 'O', 'T'};
+const uint8_t OTA_PACKAGE_VERSION = 1;
+
+enum OtaPackageType : uint8_t
+{
+    OTA_PACKAGE_FULL,  // The stream is the image
+    OTA_PACKAGE_DELTA  // The stream holds copy and insert operations
+};
+
+//
+// Decodes the operations of a delta package as the inflated stream arrives
+// in chunks of any size. Copies and inserted bytes are passed to the
+// handlers in image order; only the current operation is kept in memory.
+//
+class DeltaDecoder
+{
+public:
+    // Called for a copy from the running image. Returns false to abort.
+    typedef bool (*CopyHandler)(void *context, uint32_t offset, uint32_t length);
+    // Called with literal bytes of the new image. Returns false to abort.
+    typedef bool (*DataHandler)(void *context, const uint8_t *data, size_t length);
+
+    DeltaDecoder(CopyHandler onCopy, DataHandler onData, void *context)
+        : onCopy(onCopy), onData(onData), context(context) {}
+
+    // Processes the next chunk. Returns false once the stream is malformed,
+    // continues after 'E' or a handler aborted.
+    bool feed(const uint8_t *data, size_t length);
+
+    bool done() const { return state == End; }
+
+private:
+    enum State : uint8_t
+    {
+        ExpectOp,
+        CopyOffset,
+        CopyLength,
+        InsertLength,
+        InsertData,
+        End,
+        Failed
+    };
+
+    bool readVarint(uint8_t byte); // Returns true once the varint is complete
+
+    CopyHandler onCopy;
+    DataHandler onData;
+    void *context;
+
+    State state = ExpectOp;
+    uint32_t value = 0;     // Varint being read
+    uint8_t shift = 0;      // Bits of `value` read so far
+    uint32_t offset = 0;    // Offset of the current copy
+    uint32_t remaining = 0; // Bytes left of the current insert
+};
@@ -0,0 +1,391 @@
+//
+// Firmware update download and installation.
+//
+
+#include "ota_update.h"
+#include "config.h"    // OTA_TIMEOUT, OTA task settings
+#include "mem_stats.h" // Allocation counts of the update task
+#include <string.h> // memcmp, strncpy
+
+//
+// Keeps an image booted after an update in the pending state past setup(),
+// so it is only confirmed once it has reached a measurement-based decision
+// (confirmRunning()). Needs a bootloader built with rollback support;
+// otherwise every image counts as confirmed.
+//
+extern "C" bool verifyRollbackLater()
+{
+    return true;
+}
+
+void OtaUpdater::confirmRunning()
+{
+    esp_ota_img_states_t imageState;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &imageState) == ESP_OK &&
+        imageState == ESP_OTA_IMG_PENDING_VERIFY)
+    {
+        esp_ota_mark_app_valid_cancel_rollback();
+        Serial.println("Firmware update confirmed.");
+    }
+}
+
+bool OtaUpdater::start(const char *packageUrl)
+{
+    State current = status.load();
+    if (current == Checking || current == Installing || current == Ready)
+    {
+        return false;
+    }
+    strncpy(url, packageUrl, sizeof(url) - 1);
+    url[sizeof(url) - 1] = '\0';
+    percent.store(0);
+    status.store(Checking);
+    if (xTaskCreatePinnedToCore(task, "ota", OTA_TASK_STACK_SIZE, this, OTA_TASK_PRIORITY, nullptr,
+                                METER_TASK_CORE) != pdPASS)
+    {
+        Serial.println("Update task could not be created.");
+        status.store(Failed);
+        return false;
+    }
+    return true;
+}
+
+//
+// Runs one check or update, then deletes itself.
+//
+void OtaUpdater::task(void *parameter)
+{
+    OtaUpdater &updater = *(OtaUpdater *)parameter;
+    memRegisterTask("ota", xTaskGetCurrentTaskHandle(), MEM_OTA);
+    updater.checks++;
+    if (!updater.update())
+    {
+        updater.failures++;
+        updater.status.store(Failed);
+    }
+    else if (updater.status.load() == Checking)
+    {
+        updater.status.store(Idle); // Nothing to install.
+    }
+    memUnregisterTask(xTaskGetCurrentTaskHandle());
+    vTaskDelete(nullptr);
+}
+
+bool OtaUpdater::update()
+{
+    http.setTimeout(OTA_TIMEOUT);
+    http.setConnectTimeout(OTA_TIMEOUT);
+    if (!http.begin(tcp, url))
+    {
+        Serial.println("Update URL is invalid.");
+        return false;
+    }
+    bool updated = false;
+    int httpResponseCode = http.GET();
+    if (httpResponseCode == 200)
+    {
+        remaining = http.getSize(); // Content-Length; the package is read unframed.
+        updated = readHeader() && (upToDate || install());
+    }
+    else
+    {
+        Serial.printf("Update HTTP response error: %d\n", httpResponseCode);
+    }
+    http.end(); // The rest of the body is not needed when nothing is installed.
+    tcp.stop();
+    return updated;
+}
+
+//
+// Reads and checks the header and decides whether it holds anything new
+// for the running image.
+//
+bool OtaUpdater::readHeader()
+{
+    if (remaining < (int)sizeof(OtaHeader))
+    {
+        Serial.println("Update package has no size or is too short.");
+        return false;
+    }
+    uint8_t *bytes = (uint8_t *)&header;
+    size_t length = 0;
+    while (length < sizeof(OtaHeader))
+    {
+        int received = readBody(bytes + length, sizeof(OtaHeader) - length);
+        if (received < 0)
+        {
+            Serial.println("Update download timed out.");
+            return false;
+        }
+        length += received;
+    }
+
+    running = esp_ota_get_running_partition();
+    target = esp_ota_get_next_update_partition(nullptr);
+    if (memcmp(header.magic, OTA_PACKAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != OTA_PACKAGE_VERSION || header.type > OTA_PACKAGE_DELTA)
+    {
+        Serial.println("Not an update package of this version.");
+        return false;
+    }
+    if (running == nullptr || target == nullptr || header.imageSize > target->size ||
+        header.baseSize > running->size)
+    {
+        Serial.println("Update image does not fit the app partition.");
+        return false;
+    }
+
+    // A delta must have been made from the running image, and a full
+    // package is the running image when the hashes of its size agree.
+    bool delta = header.type == OTA_PACKAGE_DELTA;
+    uint32_t size = delta ? header.baseSize : header.imageSize;
+    uint8_t hash[32] = {};
+    if (size <= running->size && !hashRunning(size, hash))
+    {
+        return false;
+    }
+    if (delta && memcmp(hash, header.baseHash, sizeof(hash)) != 0)
+    {
+        Serial.println("Update package is a delta for another image.");
+        return false;
+    }
+    upToDate = memcmp(delta ? header.baseHash : hash, header.imageHash, sizeof(hash)) == 0 &&
+               (!delta || header.baseSize == header.imageSize);
+    if (upToDate)
+    {
+        Serial.println("Firmware is up to date.");
+    }
+    return true;
+}
+
+//
+// Hashes the first `size` bytes of the running partition.
+//
+bool OtaUpdater::hashRunning(uint32_t size, uint8_t hash[32])
+{
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    bool ok = true;
+    for (uint32_t offset = 0; ok && offset < size; offset += sizeof(copyBuffer))
+    {
+        uint32_t chunk = size - offset < sizeof(copyBuffer) ? size - offset : sizeof(copyBuffer);
+        ok = esp_partition_read(running, offset, copyBuffer, chunk) == ESP_OK;
+        mbedtls_sha256_update_ret(&sha, copyBuffer, chunk);
+    }
+    mbedtls_sha256_finish_ret(&sha, hash);
+    mbedtls_sha256_free(&sha);
+    if (!ok)
+    {
+        Serial.println("Running image could not be read.");
+    }
+    return ok;
+}
+
+//
+// Inflates the rest of the package into the other app partition and makes
+// it the boot partition once its hash matches.
+//
+bool OtaUpdater::install()
+{
+    // Sequential writes erase each sector just before it is written.
+    esp_err_t result = esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &handle);
+    if (result != ESP_OK)
+    {
+        Serial.printf("Update could not be started (%s).\n", esp_err_to_name(result));
+        return false;
+    }
+    status.store(Installing);
+    Serial.printf("Installing %s update: %lu bytes in %d, to %s.\n",
+                  header.type == OTA_PACKAGE_DELTA ? "delta" : "full", (unsigned long)header.imageSize, remaining,
+                  target->label);
+
+    DeltaDecoder delta(copyHandler, dataHandler, this);
+    decoder = &delta;
+    inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+    dictionary = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+    dictionaryPosition = 0;
+    streamEnd = false;
+    written = 0;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+
+    bool ok = inflator != nullptr && dictionary != nullptr;
+    if (!ok)
+    {
+        Serial.println("Not enough memory for the update.");
+    }
+    else
+    {
+        tinfl_init(inflator);
+    }
+    while (ok && !streamEnd)
+    {
+        int received = remaining > 0 ? readBody(input, sizeof(input)) : -1;
+        if (received < 0)
+        {
+            Serial.println("Update download ended early.");
+            ok = false;
+            break;
+        }
+        ok = inflate(input, received, remaining > 0);
+    }
+    ok = ok && written == header.imageSize && (header.type == OTA_PACKAGE_FULL || delta.done());
+
+    uint8_t hash[32];
+    mbedtls_sha256_finish_ret(&sha, hash);
+    mbedtls_sha256_free(&sha);
+    free(inflator);
+    free(dictionary);
+    inflator = nullptr;
+    dictionary = nullptr;
+    decoder = nullptr;
+
+    if (ok && memcmp(hash, header.imageHash, sizeof(hash)) != 0)
+    {
+        Serial.println("Update image hash mismatch.");
+        ok = false;
+    }
+    if (!ok)
+    {
+        esp_ota_abort(handle);
+        return false;
+    }
+    result = esp_ota_end(handle); // Also verifies the image structure.
+    if (result == ESP_OK)
+    {
+        result = esp_ota_set_boot_partition(target);
+    }
+    if (result != ESP_OK)
+    {
+        Serial.printf("Update could not be activated (%s).\n", esp_err_to_name(result));
+        return false;
+    }
+    Serial.println("Update installed.");
+    status.store(Ready);
+    return true;
+}
+
+//
+// Inflates a chunk of the package; `more` when further chunks follow. The
+// output is passed on as it leaves the dictionary.
+//
+bool OtaUpdater::inflate(const uint8_t *data, size_t length, bool more)
+{
+    uint32_t flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (more ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    for (;;)
+    {
+        size_t inputBytes = length;
+        size_t outputBytes = TINFL_LZ_DICT_SIZE - dictionaryPosition;
+        tinfl_status result = tinfl_decompress(inflator, data, &inputBytes, dictionary,
+                                               dictionary + dictionaryPosition, &outputBytes, flags);
+        data += inputBytes;
+        length -= inputBytes;
+        if (outputBytes > 0)
+        {
+            const uint8_t *output = dictionary + dictionaryPosition;
+            bool accepted = header.type == OTA_PACKAGE_DELTA ? decoder->feed(output, outputBytes)
+                                                             : writeImage(output, outputBytes);
+            if (!accepted)
+            {
+                return false;
+            }
+            dictionaryPosition = (dictionaryPosition + outputBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        if (result < TINFL_STATUS_DONE)
+        {
+            Serial.println("Update package is corrupt.");
+            return false;
+        }
+        if (result == TINFL_STATUS_DONE)
+        {
+            streamEnd = true;
+            return true;
+        }
+        if (result == TINFL_STATUS_NEEDS_MORE_INPUT)
+        {
+            return true; // All of `data` consumed.
+        }
+    }
+}
+
+//
+// Appends bytes to the new image.
+//
+bool OtaUpdater::writeImage(const uint8_t *data, size_t length)
+{
+    if (length > header.imageSize - written)
+    {
+        Serial.println("Update image is larger than announced.");
+        return false;
+    }
+    esp_err_t result = esp_ota_write(handle, data, length);
+    if (result != ESP_OK)
+    {
+        Serial.printf("Update write failed (%s).\n", esp_err_to_name(result));
+        return false;
+    }
+    mbedtls_sha256_update_ret(&sha, data, length);
+    written += length;
+    percent.store((uint8_t)((uint64_t)written * 100 / header.imageSize));
+    return true;
+}
+
+bool OtaUpdater::copyHandler(void *context, uint32_t offset, uint32_t length)
+{
+    OtaUpdater &updater = *(OtaUpdater *)context;
+    if (offset > updater.header.baseSize || length > updater.header.baseSize - offset)
+    {
+        Serial.println("Update copy outside the running image.");
+        return false;
+    }
+    while (length > 0)
+    {
+        uint32_t chunk = length < sizeof(updater.copyBuffer) ? length : sizeof(updater.copyBuffer);
+        if (esp_partition_read(updater.running, offset, updater.copyBuffer, chunk) != ESP_OK ||
+            !updater.writeImage(updater.copyBuffer, chunk))
+        {
+            return false;
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool OtaUpdater::dataHandler(void *context, const uint8_t *data, size_t length)
+{
+    return ((OtaUpdater *)context)->writeImage(data, length);
+}
+
+//
+// Reads up to `size` bytes of the body as they arrive. Returns -1 after
+// OTA_TIMEOUT without data or when the connection closed.
+//
+int OtaUpdater::readBody(uint8_t *buffer, size_t size)
+{
+    unsigned long start = millis();
+    for (;;)
+    {
+        int available = tcp.available();
+        if (available > 0)
+        {
+            size_t chunk = available < (int)size ? available : size;
+            if ((int)chunk > remaining)
+            {
+                chunk = remaining;
+            }
+            int received = tcp.read(buffer, chunk);
+            if (received <= 0)
+            {
+                return -1;
+            }
+            remaining -= received;
+            return received;
+        }
+        if (!tcp.connected() || millis() - start >= OTA_TIMEOUT)
+        {
+            return -1;
+        }
+        delay(1);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ota_patch.h"       // Package header and delta decoding
+#include <HTTPClient.h>      // HTTP client for the package download
+#include <WiFiClient.h>      // TCP connection to the update server
+#include <atomic>            // State shared with loop()
+#include <esp32/rom/miniz.h> // ROM inflater
+#include <esp_ota_ops.h>     // Writing the other app partition
+#include <esp_partition.h>   // Reading the running image
+#include <mbedtls/sha256.h>  // Image hashes
+
+//
+// Firmware update from a package built by tools/make_ota.py.
+//
+// The package is downloaded by a background task on the meter core and
+// written to the app partition not running (partitions.csv has two), so
+// loop() keeps controlling the relays while it runs. Only the header is
+// read when the package holds the running image or a delta for another
+// one; otherwise the zlib stream is inflated as it arrives (ROM inflater,
+// 32 KB dictionary) and, for a delta, the copies are read from the running
+// partition. The flash is erased sector by sector as it is written, so no
+// single erase stalls the control loop for long.
+//
+// The written image must hash to the header's SHA-256 before it is made
+// the boot partition; any error leaves the running firmware in place. The
+// restart itself is left to the caller once readyToRestart().
+//
+class OtaUpdater
+{
+public:
+    enum State : uint8_t
+    {
+        Idle,       // No check started, or the last one found nothing to install
+        Checking,   // Reading the package header and hashing the running image
+        Installing, // Writing the new image
+        Ready,      // The new image is the boot partition
+        Failed      // The last check or update failed; the running firmware stays
+    };
+
+    // Starts checking `url` for a package, installing it when it is new, in
+    // the background. Returns false while a check is running, once an update
+    // is ready or when the task cannot be created.
+    bool start(const char *url);
+
+    State state() const { return status.load(); }
+    bool active() const { return status.load() == Installing; }
+    bool readyToRestart() const { return status.load() == Ready; }
+
+    // Percentage of the new image written.
+    uint8_t progress() const { return percent.load(); }
+
+    unsigned long checkCount() const { return checks; }
+    unsigned long failureCount() const { return failures; }
+
+    // Confirms the running image to the bootloader, so an image that
+    // reached a measurement-based decision is not rolled back.
+    static void confirmRunning();
+
+private:
+    static void task(void *parameter);
+    static bool copyHandler(void *context, uint32_t offset, uint32_t length);
+    static bool dataHandler(void *context, const uint8_t *data, size_t length);
+
+    bool update();
+    bool readHeader();
+    bool hashRunning(uint32_t size, uint8_t hash[32]);
+    bool install();
+    bool inflate(const uint8_t *data, size_t length, bool more);
+    bool writeImage(const uint8_t *data, size_t length);
+    int readBody(uint8_t *buffer, size_t size);
+
+    WiFiClient tcp;
+    HTTPClient http;
+    char url[128] = "";
+
+    OtaHeader header = {};
+    const esp_partition_t *running = nullptr;
+    const esp_partition_t *target = nullptr;
+    esp_ota_handle_t handle = 0;
+    mbedtls_sha256_context sha;
+    DeltaDecoder *decoder = nullptr;
+    tinfl_decompressor *inflator = nullptr; // Allocated while installing
+    uint8_t *dictionary = nullptr;          // Wrap-around inflate output, allocated while installing
+    size_t dictionaryPosition = 0;          // Next output byte in `dictionary`
+    bool streamEnd = false;                 // The zlib stream is complete
+    bool upToDate = false;                  // The package holds the running image
+    uint32_t written = 0;                   // Bytes of the new image written
+    int remaining = 0;                      // Bytes of the body not read yet
+    uint8_t input[1024];                    // Received package data
+    uint8_t copyBuffer[512];                // Running image data being copied
+
+    std::atomic<State> status{Idle};
+    std::atomic<uint8_t> percent{0};
+    unsigned long checks = 0;   // Packages checked
+    unsigned long failures = 0; // Checks or updates that failed
+};
@@ -0,0 +1,172 @@
+//
+// Per-stage latency histograms.
+//
+
+#include "perf_stats.h"
+#include <Arduino.h> // micros()
+
+// All histograms live in this single fixed block.
+static StageHistogram perfStages[PERF_STAGE_COUNT];
+
+static const char *const stageNames[PERF_STAGE_COUNT] = {
+    "wifi_check",
+    "http_connect",
+    "http_get",
+    "json_parse",
+    "control",
+    "status",
+    "lcd_write",
+    "sample_to_relay",
+    "telemetry_encode",
+    "http_serve",
+    "switch_deadline",
+    "modbus_read",
+};
+
+//
+// Maps a value to a log-linear bucket: the power of two selects the group,
+// the next two bits below the leading one select the bucket in the group.
+//
+static uint8_t bucketIndex(uint32_t value)
+{
+    if (value < StageHistogram::SUB_BUCKETS)
+    {
+        return value;
+    }
+    uint8_t exponent = 31 - __builtin_clz(value);
+    uint8_t fraction = (value >> (exponent - 2)) & (StageHistogram::SUB_BUCKETS - 1);
+    uint32_t index = (exponent - 1) * StageHistogram::SUB_BUCKETS + fraction;
+    return index < StageHistogram::BUCKET_COUNT ? index : StageHistogram::BUCKET_COUNT - 1;
+}
+
+// Upper bound of the values that fall into a bucket.
+static uint32_t bucketLimit(uint8_t index)
+{
+    if (index < StageHistogram::SUB_BUCKETS)
+    {
+        return index;
+    }
+    uint8_t exponent = index / StageHistogram::SUB_BUCKETS + 1;
+    uint8_t fraction = index % StageHistogram::SUB_BUCKETS;
+    return ((uint32_t)(StageHistogram::SUB_BUCKETS + fraction + 1) << (exponent - 2)) - 1;
+}
+
+void StageHistogram::record(uint32_t micros)
+{
+    if (count == 0 || micros < min)
+    {
+        min = micros;
+    }
+    if (micros > max)
+    {
+        max = micros;
+    }
+    count++;
+    total += micros;
+
+    uint8_t index = bucketIndex(micros);
+    if (buckets[index] == UINT16_MAX)
+    {
+        // Halve all buckets so the distribution keeps its shape without overflowing.
+        for (uint8_t i = 0; i < BUCKET_COUNT; i++)
+        {
+            buckets[i] >>= 1;
+        }
+    }
+    buckets[index]++;
+}
+
+uint32_t StageHistogram::percentile(uint8_t percent) const
+{
+    uint32_t bucketTotal = 0;
+    for (uint8_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        bucketTotal += buckets[i];
+    }
+    if (bucketTotal == 0)
+    {
+        return 0;
+    }
+
+    uint32_t rank = (bucketTotal * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            uint32_t limit = bucketLimit(i);
+            return limit < max ? limit : max;
+        }
+    }
+    return max;
+}
+
+void perfRecord(PerfStage stage, uint32_t micros)
+{
+    perfStages[stage].record(micros);
+}
+
+const StageHistogram &perfStage(PerfStage stage)
+{
+    return perfStages[stage];
+}
+
+const char *perfStageName(PerfStage stage)
+{
+    return stageNames[stage];
+}
+
+void perfReset()
+{
+    memset(perfStages, 0, sizeof(perfStages));
+}
+
+size_t perfFormat(char *buffer, size_t size)
+{
+    size_t length = snprintf(buffer, size, "%-16s %8s %8s %8s %8s %8s\n", "stage [us]", "count", "min", "avg", "p99", "max");
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT && length < size; i++)
+    {
+        const StageHistogram &stage = perfStages[i];
+        length += snprintf(buffer + length, size - length, "%-16s %8lu %8lu %8lu %8lu %8lu\n", stageNames[i],
+                           (unsigned long)stage.count, (unsigned long)stage.min, (unsigned long)stage.mean(),
+                           (unsigned long)stage.percentile(99), (unsigned long)stage.max);
+    }
+    return length < size ? length : size - 1;
+}
+
+size_t perfFormatMetrics(char *buffer, size_t size, const char *prefix)
+{
+    size_t length = snprintf(buffer, size, "# TYPE %s_stage_latency_seconds summary\n", prefix);
+    for (uint8_t i = 0; i < PERF_STAGE_COUNT && length < size; i++)
+    {
+        const StageHistogram &stage = perfStages[i];
+        static const uint8_t quantiles[] = {50, 90, 99};
+        for (uint8_t q = 0; q < sizeof(quantiles) && length < size; q++)
+        {
+            length += snprintf(buffer + length, size - length,
+                               "%s_stage_latency_seconds{stage=\"%s\",quantile=\"0.%02u\"} %lu.%06lu\n", prefix,
+                               stageNames[i], quantiles[q], (unsigned long)(stage.percentile(quantiles[q]) / 1000000),
+                               (unsigned long)(stage.percentile(quantiles[q]) % 1000000));
+        }
+        if (length < size)
+        {
+            length += snprintf(buffer + length, size - length,
+                               "%s_stage_latency_seconds_sum{stage=\"%s\"} %llu.%06llu\n"
+                               "%s_stage_latency_seconds_count{stage=\"%s\"} %lu\n",
+                               prefix, stageNames[i], (unsigned long long)(stage.total / 1000000),
+                               (unsigned long long)(stage.total % 1000000), prefix, stageNames[i],
+                               (unsigned long)stage.count);
+        }
+    }
+    return length < size ? length : size - 1;
+}
+
+PerfTimer::PerfTimer(PerfStage stage) : stage(stage), start(micros())
+{
+}
+
+PerfTimer::~PerfTimer()
+{
+    perfRecord(stage, micros() - start);
+}
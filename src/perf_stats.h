@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Hot-path instrumentation of the measurement and control pipeline.
+//
+// Each stage keeps a latency histogram (in microseconds) in a fixed,
+// statically allocated block: count, min, max, mean and log-linear buckets
+// from which percentiles are estimated to within about 20%. Recording is a
+// handful of integer operations and never allocates. Every stage must only
+// be recorded from one task.
+//
+enum PerfStage : uint8_t
+{
+    STAGE_WIFI_CHECK,       // WiFi status check in loop()
+    STAGE_HTTP_CONNECT,     // TCP handshake with the meter
+    STAGE_HTTP_GET,         // HTTP request until the response headers are in
+    STAGE_JSON_PARSE,       // Reading and scanning the response body
+    STAGE_CONTROL,          // controlCharger()
+    STAGE_STATUS,           // printStatus(), rendering into the LCD framebuffer
+    STAGE_LCD_WRITE,        // I2C writes of one LCD flush
+    STAGE_SAMPLE_TO_RELAY,  // Sample received until the relay switched
+    STAGE_TELEMETRY_ENCODE, // Encoding one MQTT telemetry batch
+    STAGE_HTTP_SERVE,       // Answering one status server request
+    STAGE_SWITCH_DEADLINE,  // Hysteresis deadline until the relay switched
+    STAGE_MODBUS_READ,      // Modbus TCP register read, including the connect
+    PERF_STAGE_COUNT
+};
+
+struct StageHistogram
+{
+    static const uint8_t SUB_BUCKETS = 4;                 // Buckets per power of two
+    static const uint8_t BUCKET_COUNT = 24 * SUB_BUCKETS; // Covers 1 us .. ~16 s
+
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint16_t buckets[BUCKET_COUNT];
+
+    void record(uint32_t micros);
+    uint32_t mean() const { return count ? (uint32_t)(total / count) : 0; }
+
+    // Estimated value below which `percent` of the recorded values lie.
+    uint32_t percentile(uint8_t percent) const;
+};
+
+// Records a duration (in microseconds) for `stage`.
+void perfRecord(PerfStage stage, uint32_t micros);
+
+const StageHistogram &perfStage(PerfStage stage);
+const char *perfStageName(PerfStage stage);
+
+// Clears all histograms.
+void perfReset();
+
+// Writes a table of all stages (count, min, avg, p99, max) into `buffer`.
+size_t perfFormat(char *buffer, size_t size);
+
+// Writes all stages as a Prometheus summary <prefix>_stage_latency_seconds into `buffer`.
+size_t perfFormatMetrics(char *buffer, size_t size, const char *prefix);
+
+//
+// Records the lifetime of the object as a stage duration.
+//
+class PerfTimer
+{
+public:
+    explicit PerfTimer(PerfStage stage);
+    ~PerfTimer();
+
+private:
+    PerfStage stage;
+    uint32_t start;
+};
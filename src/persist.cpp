@@ -0,0 +1,103 @@
+//
+// NVS-backed persistent state.
+//
+
+#include "persist.h"
+#include <Preferences.h> // NVS key/value storage
+#include <string.h>      // memcmp
+
+static Preferences prefs;
+static Preferences configPrefs; // Runtime configuration, in its own namespace
+
+void persistBegin()
+{
+    prefs.begin("energy", false);
+}
+
+bool loadRelayState(bool &on)
+{
+    if (!prefs.isKey("relay"))
+    {
+        return false;
+    }
+    on = prefs.getBool("relay");
+    return true;
+}
+
+void saveRelayState(bool on)
+{
+    // Only called when the relay switches, which is rare enough for the flash.
+    prefs.putBool("relay", on);
+}
+
+bool loadWifiApCache(WifiApCache &cache)
+{
+    return prefs.getBytes("wifi_ap", &cache, sizeof(cache)) == sizeof(cache) && cache.channel > 0;
+}
+
+void saveWifiApCache(const WifiApCache &cache)
+{
+    WifiApCache stored;
+    if (loadWifiApCache(stored) && memcmp(&stored, &cache, sizeof(cache)) == 0)
+    {
+        return; // Unchanged, spare the flash.
+    }
+    prefs.putBytes("wifi_ap", &cache, sizeof(cache));
+}
+
+void clearWifiApCache()
+{
+    prefs.remove("wifi_ap");
+}
+
+bool loadSolarForecast(SolarForecast &forecast)
+{
+    return prefs.getBytesLength("forecast") == sizeof(forecast) &&
+           prefs.getBytes("forecast", &forecast, sizeof(forecast)) == sizeof(forecast) &&
+           forecast.version == SOLAR_FORECAST_VERSION;
+}
+
+void saveSolarForecast(const SolarForecast &forecast)
+{
+    // Written once a day.
+    prefs.putBytes("forecast", &forecast, sizeof(forecast));
+}
+
+bool loadEnergyRecord(EnergyRecord &record)
+{
+    return prefs.getBytesLength("counters") == sizeof(record) &&
+           prefs.getBytes("counters", &record, sizeof(record)) == sizeof(record) &&
+           record.version == ENERGY_RECORD_VERSION;
+}
+
+void saveEnergyRecord(const EnergyRecord &record)
+{
+    // Every ENERGY_SAVE_INTERVAL and at the end of a day.
+    prefs.putBytes("counters", &record, sizeof(record));
+}
+
+bool loadRuntimeConfig(RuntimeConfig &config, uint8_t dipValue)
+{
+    configPrefs.begin("config", false);
+    bool stored = configPrefs.getBytesLength("runtime") == sizeof(config) &&
+                  configPrefs.getBytes("runtime", &config, sizeof(config)) == sizeof(config) &&
+                  config.version == RUNTIME_CONFIG_VERSION;
+    if (!stored)
+    {
+        runtimeConfigDefaults(config);
+    }
+
+    // A changed DIP position means someone set a preset on site: it wins over the stored values.
+    if (!stored || config.dipSetting != (dipValue & 7))
+    {
+        runtimeConfigApplyDip(config, dipValue);
+        saveRuntimeConfig(config);
+        return false;
+    }
+    return true;
+}
+
+void saveRuntimeConfig(const RuntimeConfig &config)
+{
+    configPrefs.putBytes("runtime", &config, sizeof(config));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "charge_plan.h"    // SolarForecast
+#include "energy_account.h" // EnergyRecord
+#include "runtime_config.h" // RuntimeConfig
+#include <stdint.h>         // Fixed-width integer types
+
+//
+// State kept in NVS (non-volatile storage) across reboots.
+//
+// Restoring it lets the firmware resume right where it left off: the relay
+// is driven to its last state immediately at boot, and WiFi reconnects to
+// the last access point without scanning all channels first.
+//
+
+// Access point of the last successful connection
+struct WifiApCache
+{
+    uint8_t bssid[6];
+    int32_t channel;
+};
+
+// Opens the NVS namespace. Must be called once before the other functions.
+void persistBegin();
+
+bool loadRelayState(bool &on);
+void saveRelayState(bool on);
+
+bool loadWifiApCache(WifiApCache &cache);
+void saveWifiApCache(const WifiApCache &cache);
+void clearWifiApCache();
+
+//
+// Loads the stored runtime configuration and reconciles it with the DIP
+// switches. Falls back to the defaults plus DIP preset when nothing valid
+// is stored. Returns true if stored values were used.
+//
+bool loadRuntimeConfig(RuntimeConfig &config, uint8_t dipValue);
+
+void saveRuntimeConfig(const RuntimeConfig &config);
+
+// The forecast of the current day, so a reboot does not fetch it again.
+bool loadSolarForecast(SolarForecast &forecast);
+void saveSolarForecast(const SolarForecast &forecast);
+
+// The energy counters, so a reboot keeps the day and the totals.
+bool loadEnergyRecord(EnergyRecord &record);
+void saveEnergyRecord(const EnergyRecord &record);
@@ -0,0 +1,43 @@
+//
+// Adaptive meter poll interval.
+//
+
+#include "poll_scheduler.h"
+
+void PollScheduler::configure(uint32_t fastInterval, uint32_t normalInterval, uint32_t slowInterval,
+                              uint32_t idleInterval, int32_t nearDistance, int32_t farDistance, uint32_t idleAfter)
+{
+    fast = fastInterval;
+    normal = normalInterval;
+    slow = slowInterval;
+    idle = idleInterval;
+    nearBand = nearDistance;
+    farBand = farDistance;
+    idleDelay = idleAfter;
+    current = normal;
+    far = false;
+}
+
+uint32_t PollScheduler::update(int32_t distance, bool switchPending, uint32_t timestamp)
+{
+    if (switchPending || distance <= nearBand)
+    {
+        far = false;
+        current = fast; // A decision is close, react quickly.
+    }
+    else if (distance >= farBand)
+    {
+        if (!far)
+        {
+            far = true;
+            farSince = timestamp;
+        }
+        current = timestamp - farSince >= idleDelay ? idle : slow;
+    }
+    else
+    {
+        far = false;
+        current = normal;
+    }
+    return current;
+}
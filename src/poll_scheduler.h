@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Chooses the meter poll interval from how close the controller is to a decision.
+//
+// Polls fast while a switch is pending or the power is within `nearDistance`
+// of the switching threshold, at the normal interval in between, slowly when
+// the power is more than `farDistance` away, and at the idle interval once
+// it has stayed that far away for `idleAfter` (e.g. at night).
+//
+class PollScheduler
+{
+public:
+    void configure(uint32_t fastInterval, uint32_t normalInterval, uint32_t slowInterval, uint32_t idleInterval,
+                   int32_t nearDistance, int32_t farDistance, uint32_t idleAfter);
+
+    // Updates the interval after a decision. `distance` is how far (in W) the
+    // decision power is from causing the next switch. Returns the new interval.
+    uint32_t update(int32_t distance, bool switchPending, uint32_t timestamp);
+
+    uint32_t interval() const { return current; }
+
+private:
+    uint32_t fast = 0;
+    uint32_t normal = 0;
+    uint32_t slow = 0;
+    uint32_t idle = 0;
+    int32_t nearBand = 0;
+    int32_t farBand = 0;
+    uint32_t idleDelay = 0;
+
+    uint32_t current = 0;  // Current poll interval in ms
+    bool far = false;      // The power is currently far from the threshold
+    uint32_t farSince = 0; // Timestamp at which the power got far from the threshold
+};
@@ -0,0 +1,64 @@
+//
+// Modem sleep, light sleep and latched relay outputs.
+//
+
+#include "power_save.h"
+#include <Arduino.h>     // digitalWrite, Serial
+#include <WiFi.h>        // Modem sleep
+#include <driver/gpio.h> // Pad hold
+#include <esp_pm.h>      // Frequency scaling and automatic light sleep
+
+PowerSaveMode powerSaveBegin(PowerSaveMode mode)
+{
+    if (mode == POWER_SAVE_OFF)
+    {
+        return mode;
+    }
+
+    // Wake for the beacons at the listen interval only; kept by WiFi across reconnects.
+    WiFi.setSleep(WIFI_PS_MAX_MODEM);
+
+    esp_pm_config_esp32_t config = {POWER_SAVE_MAX_FREQ, POWER_SAVE_MIN_FREQ, mode == POWER_SAVE_LIGHT};
+    esp_err_t result = esp_pm_configure(&config);
+    if (result != ESP_OK && mode == POWER_SAVE_LIGHT)
+    {
+        Serial.printf("Light sleep unavailable (%s). Using modem sleep.\n", esp_err_to_name(result));
+        mode = POWER_SAVE_MODEM;
+        config.light_sleep_enable = false;
+        result = esp_pm_configure(&config);
+    }
+    if (result != ESP_OK)
+    {
+        Serial.printf("CPU frequency scaling unavailable (%s).\n", esp_err_to_name(result));
+    }
+    Serial.println(mode == POWER_SAVE_LIGHT ? "Power saving: light sleep." : "Power saving: modem sleep.");
+    return mode;
+}
+
+void setupRelayPin(int pin, bool on)
+{
+    gpio_hold_dis((gpio_num_t)pin);     // A hold survives a software reset.
+    digitalWrite(pin, on ? HIGH : LOW); // Set the level before enabling the output.
+    pinMode(pin, OUTPUT);
+    if (POWER_SAVE_MODE != POWER_SAVE_OFF)
+    {
+        gpio_hold_en((gpio_num_t)pin);
+    }
+}
+
+void writeRelayPin(int pin, bool on)
+{
+    if (POWER_SAVE_MODE == POWER_SAVE_OFF)
+    {
+        digitalWrite(pin, on ? HIGH : LOW);
+        return;
+    }
+    gpio_hold_dis((gpio_num_t)pin);
+    digitalWrite(pin, on ? HIGH : LOW);
+    gpio_hold_en((gpio_num_t)pin);
+}
+
+void holdRelayPin(int pin)
+{
+    gpio_hold_en((gpio_num_t)pin);
+}
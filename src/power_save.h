@@ -0,0 +1,31 @@
+#pragma once
+
+#include "config.h" // PowerSaveMode
+
+//
+// Power saving between measurements.
+//
+// The WiFi modem sleeps between beacons (maximum modem sleep) and, with
+// POWER_SAVE_LIGHT, the power management driver enters light sleep
+// whenever every task is blocked; the next FreeRTOS timeout, e.g. the
+// meter task waiting for the next poll, wakes the chip. In both modes the
+// CPU clock is scaled down while idle.
+//
+// Relay outputs are latched with the pad hold function, so their level is
+// kept through light sleep and frequency changes, and across a software
+// reset until setupRelayPin() takes them over again.
+//
+
+// Applies `mode`. Call after WiFi has been started. Returns the mode in effect,
+// which is lower than requested when the framework lacks light sleep support.
+PowerSaveMode powerSaveBegin(PowerSaveMode mode);
+
+// Takes over a relay output at boot: drives it to `on`, then latches it.
+void setupRelayPin(int pin, bool on);
+
+// Switches a latched relay output.
+void writeRelayPin(int pin, bool on);
+
+// Latches a relay output through a software reset, whatever the power
+// saving mode, e.g. before restarting into a firmware update.
+void holdRelayPin(int pin);
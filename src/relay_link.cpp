@@ -0,0 +1,173 @@
+//
+// ESP-NOW link to remote relay nodes.
+//
+
+#include "relay_link.h"
+#include "config.h"  // Retry and refresh intervals
+#include <Arduino.h> // millis, Serial
+#include <esp_now.h> // ESP-NOW
+#include <string.h>  // memcpy, memcmp
+
+// The receive callback has no context argument.
+static RelayLink *activeLink = nullptr;
+
+bool RelayLink::begin(const char *key)
+{
+    if (esp_now_init() != ESP_OK)
+    {
+        Serial.println("ESP-NOW initialization failed. Relay nodes disabled.");
+        return false;
+    }
+    memset(lmk, 0, sizeof(lmk));
+    memcpy(lmk, key, strnlen(key, sizeof(lmk)));
+    esp_now_set_pmk(lmk);
+    session = esp_random() | 1;
+    activeLink = this;
+    esp_now_register_recv_cb(onReceive);
+    return true;
+}
+
+int RelayLink::addNode(const uint8_t mac[6])
+{
+    if (nodes >= MAX_NODES)
+    {
+        return -1;
+    }
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, 6);
+    memcpy(peer.lmk, lmk, sizeof(lmk));
+    peer.channel = 0; // The channel of the access point
+    peer.ifidx = WIFI_IF_STA;
+    peer.encrypt = true;
+    if (esp_now_add_peer(&peer) != ESP_OK)
+    {
+        Serial.println("Adding relay node failed.");
+        return -1;
+    }
+    memcpy(nodeMacs[nodes], mac, 6);
+    lastAck[nodes].store(0);
+    return nodes++;
+}
+
+int RelayLink::find(uint8_t node, uint8_t output) const
+{
+    for (uint8_t i = 0; i < outputCount; i++)
+    {
+        if (outputs[i].node == node && outputs[i].output == output)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RelayLink::setRelay(uint8_t node, uint8_t output, bool on)
+{
+    int index = find(node, output);
+    if (index < 0)
+    {
+        if (outputCount >= MAX_OUTPUTS || node >= nodes)
+        {
+            return;
+        }
+        Output &entry = outputs[outputCount];
+        entry.node = node;
+        entry.output = output;
+        entry.on = !on; // Forces the first command below.
+        entry.sequence = 0;
+        entry.acked.store(0);
+        index = outputCount++; // Visible to the receive callback once initialized
+    }
+    Output &entry = outputs[index];
+    if (entry.on != on)
+    {
+        entry.on = on;
+        entry.changeSequence = entry.sequence + 1;
+        entry.retries = 0;
+        send(entry, millis());
+    }
+}
+
+void RelayLink::service(unsigned long currentTime)
+{
+    for (uint8_t i = 0; i < outputCount; i++)
+    {
+        Output &entry = outputs[i];
+        bool pending = !isConfirmed(entry) && entry.retries < RELAY_RETRY_LIMIT;
+        if (currentTime - entry.lastSend >= (pending ? RELAY_RETRY_INTERVAL : RELAY_REFRESH_INTERVAL))
+        {
+            if (pending)
+            {
+                entry.retries++;
+            }
+            send(entry, currentTime);
+        }
+    }
+}
+
+//
+// Every command since the last change carries the current state, so an
+// acknowledgement of any of them confirms it.
+//
+bool RelayLink::isConfirmed(const Output &entry)
+{
+    return (int32_t)(entry.acked.load() - entry.changeSequence) >= 0;
+}
+
+//
+// Sends the wanted state of one output with a new sequence number.
+//
+void RelayLink::send(Output &entry, unsigned long currentTime)
+{
+    RelayMessage message = {RELAY_MAGIC, RELAY_PROTOCOL_VERSION, RELAY_COMMAND, entry.output, entry.on,
+                            session, ++entry.sequence};
+    esp_now_send(nodeMacs[entry.node], (const uint8_t *)&message, sizeof(message));
+    entry.lastSend = currentTime;
+}
+
+//
+// Runs in the WiFi task: records acknowledgements for service() and confirmed().
+//
+void RelayLink::onReceive(const uint8_t *mac, const uint8_t *data, int length)
+{
+    RelayLink *link = activeLink;
+    if (link == nullptr || !relayMessageValid(data, length))
+    {
+        return;
+    }
+    const RelayMessage *message = (const RelayMessage *)data;
+    if (message->type != RELAY_ACK || message->session != link->session)
+    {
+        return;
+    }
+    for (uint8_t node = 0; node < link->nodes; node++)
+    {
+        if (memcmp(link->nodeMacs[node], mac, 6) != 0)
+        {
+            continue;
+        }
+        link->lastAck[node].store(millis());
+        int index = link->find(node, message->output);
+        if (index >= 0)
+        {
+            std::atomic<uint32_t> &acked = link->outputs[index].acked;
+            if ((int32_t)(message->sequence - acked.load()) > 0)
+            {
+                acked.store(message->sequence);
+            }
+        }
+        return;
+    }
+}
+
+bool RelayLink::confirmed(uint8_t node, uint8_t output) const
+{
+    int index = find(node, output);
+    return index >= 0 && isConfirmed(outputs[index]);
+}
+
+bool RelayLink::nodeOnline(uint8_t node, unsigned long currentTime) const
+{
+    unsigned long last = lastAck[node].load();
+    return last != 0 && currentTime - last < RELAY_NODE_OFFLINE_TIMEOUT;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "relay_protocol.h" // ESP-NOW message format
+#include <atomic>           // State shared with the ESP-NOW receive callback
+#include <stdint.h>         // Fixed-width integer types
+
+//
+// Controller side of the ESP-NOW relay node link.
+//
+// setRelay() only records the wanted state; service() sends it, repeats it
+// every RELAY_RETRY_INTERVAL until the node acknowledges, and refreshes it
+// every RELAY_REFRESH_INTERVAL afterwards. Acknowledgements arrive in the
+// WiFi task and are handed over through atomics, so nothing here blocks.
+//
+class RelayLink
+{
+public:
+    static const uint8_t MAX_NODES = 8;
+    static const uint8_t MAX_OUTPUTS = 16;
+
+    // Starts ESP-NOW with the 16-byte `key` for encryption. WiFi must be in STA mode.
+    bool begin(const char *key);
+
+    // Registers a node by MAC address. Returns its index, or -1 on failure.
+    int addNode(const uint8_t mac[6]);
+
+    // Sets the wanted state of `output` on `node`.
+    void setRelay(uint8_t node, uint8_t output, bool on);
+
+    // Sends, repeats and refreshes commands. Called from loop().
+    void service(unsigned long currentTime);
+
+    // True once the node acknowledged the current state of the output.
+    bool confirmed(uint8_t node, uint8_t output) const;
+
+    // True if the node acknowledged a command within RELAY_NODE_OFFLINE_TIMEOUT.
+    bool nodeOnline(uint8_t node, unsigned long currentTime) const;
+
+    uint8_t nodeCount() const { return nodes; }
+
+private:
+    struct Output
+    {
+        uint8_t node;
+        uint8_t output;
+        bool on;
+        uint32_t sequence;           // Of the last command sent
+        uint32_t changeSequence;     // Of the first command with the current state
+        unsigned long lastSend;      // millis() of the last command sent
+        uint8_t retries;             // Repeats of the current state so far
+        std::atomic<uint32_t> acked; // Highest sequence number acknowledged
+    };
+
+    static void onReceive(const uint8_t *mac, const uint8_t *data, int length);
+    int find(uint8_t node, uint8_t output) const;
+    void send(Output &output, unsigned long currentTime);
+    static bool isConfirmed(const Output &output);
+
+    uint8_t nodeMacs[MAX_NODES][6];
+    std::atomic<unsigned long> lastAck[MAX_NODES];
+    uint8_t nodes = 0;
+    Output outputs[MAX_OUTPUTS];
+    uint8_t outputCount = 0;
+    uint8_t lmk[16];
+    uint32_t session = 0;
+};
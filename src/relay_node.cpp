@@ -0,0 +1,150 @@
+//
+// Firmware of a remote relay node (the relay_node environment).
+//
+// The node switches its outputs on ESP-NOW commands from the controller
+// and acknowledges each one. It never associates with an access point:
+// while it hears nothing it listens on each WiFi channel in turn until it
+// finds the one the controller transmits on. Without commands for
+// RELAY_NODE_FAILSAFE_TIMEOUT all outputs are switched off.
+//
+
+#include "config.h"         // Node pins and timeouts
+#include "relay_protocol.h" // ESP-NOW message format
+#include "secrets.h"        // ESP-NOW key
+#include "spsc_queue.h"     // Commands handed from the WiFi task to loop()
+#include <WiFi.h>           // Station mode for ESP-NOW
+#include <esp_now.h>        // ESP-NOW
+#include <esp_wifi.h>       // Channel selection
+#include <string.h>         // memcpy, memcmp
+
+const int OUTPUT_COUNT = sizeof(RELAY_NODE_PINS) / sizeof(RELAY_NODE_PINS[0]);
+const uint8_t CHANNEL_COUNT = 13;
+
+// Commands received in the WiFi task and applied in loop()
+SpscQueue<RelayMessage, 8> commands;
+
+// Global state variables
+uint32_t controllerSession = 0;             // Session of the controller followed
+uint32_t lastSequence[OUTPUT_COUNT] = {};   // Sequence number of the last command applied per output
+bool outputOn[OUTPUT_COUNT] = {};           // Current output states
+unsigned long lastCommandTime = 0;          // millis() of the last valid command
+unsigned long lastHopTime = 0;              // millis() of the last channel change
+uint8_t channel = 1;                        // WiFi channel listened on
+
+//
+// Runs in the WiFi task: queues commands from the controller for loop().
+//
+void onReceive(const uint8_t *mac, const uint8_t *data, int length)
+{
+    if (memcmp(mac, RELAY_CONTROLLER_MAC, 6) != 0 || !relayMessageValid(data, length))
+    {
+        return;
+    }
+    const RelayMessage *message = (const RelayMessage *)data;
+    if (message->type == RELAY_COMMAND)
+    {
+        commands.push(*message);
+    }
+}
+
+void setOutput(uint8_t output, bool on)
+{
+    if (outputOn[output] != on)
+    {
+        digitalWrite(RELAY_NODE_PINS[output], on ? HIGH : LOW);
+        outputOn[output] = on;
+        Serial.printf("Output %u %s\n", output, on ? "ON" : "OFF");
+    }
+}
+
+//
+// Applies a command, unless it is older than one already applied, and acknowledges it.
+//
+void handleCommand(const RelayMessage &command, unsigned long currentTime)
+{
+    if (command.output >= OUTPUT_COUNT)
+    {
+        return;
+    }
+    if (command.session != controllerSession)
+    {
+        controllerSession = command.session; // The controller restarted.
+        memset(lastSequence, 0, sizeof(lastSequence));
+    }
+    else if ((int32_t)(command.sequence - lastSequence[command.output]) <= 0)
+    {
+        return; // Duplicate or reordered.
+    }
+    lastSequence[command.output] = command.sequence;
+    lastCommandTime = currentTime;
+    setOutput(command.output, command.state != 0);
+
+    RelayMessage ack = command;
+    ack.type = RELAY_ACK;
+    ack.state = outputOn[command.output];
+    esp_now_send(RELAY_CONTROLLER_MAC, (const uint8_t *)&ack, sizeof(ack));
+}
+
+void setup()
+{
+    for (int i = 0; i < OUTPUT_COUNT; i++)
+    {
+        digitalWrite(RELAY_NODE_PINS[i], LOW); // Outputs start off until the controller says otherwise.
+        pinMode(RELAY_NODE_PINS[i], OUTPUT);
+    }
+    Serial.begin(115200);
+
+    WiFi.mode(WIFI_STA);
+    WiFi.disconnect();
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    Serial.printf("Relay node %s, %d outputs\n", WiFi.macAddress().c_str(), OUTPUT_COUNT);
+
+    if (esp_now_init() != ESP_OK)
+    {
+        Serial.println("ESP-NOW initialization failed. Restarting...");
+        ESP.restart();
+    }
+    uint8_t key[16] = {};
+    memcpy(key, espnowKey, strnlen(espnowKey, sizeof(key)));
+    esp_now_set_pmk(key);
+
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, RELAY_CONTROLLER_MAC, 6);
+    memcpy(peer.lmk, key, sizeof(key));
+    peer.channel = 0; // The channel currently listened on
+    peer.ifidx = WIFI_IF_STA;
+    peer.encrypt = true;
+    esp_now_add_peer(&peer);
+    esp_now_register_recv_cb(onReceive);
+}
+
+void loop()
+{
+    unsigned long currentTime = millis();
+    RelayMessage command;
+    while (commands.pop(command))
+    {
+        handleCommand(command, currentTime);
+    }
+
+    unsigned long silence = currentTime - lastCommandTime;
+
+    // Fail safe when the controller is gone.
+    if (silence >= RELAY_NODE_FAILSAFE_TIMEOUT)
+    {
+        for (int i = 0; i < OUTPUT_COUNT; i++)
+        {
+            setOutput(i, false);
+        }
+    }
+
+    // Search the channels while the controller is not heard.
+    if (silence >= RELAY_NODE_SEARCH_TIMEOUT && currentTime - lastHopTime >= RELAY_NODE_HOP_DWELL)
+    {
+        lastHopTime = currentTime;
+        channel = channel % CHANNEL_COUNT + 1;
+        esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    }
+
+    delay(1);
+}
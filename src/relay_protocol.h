@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+//
+// ESP-NOW messages between the controller and remote relay nodes.
+//
+// The controller sends a command with the wanted state of one node output;
+// the node applies it and acknowledges with the same session and sequence
+// number. Commands are repeated until acknowledged and refreshed
+// periodically, so the node can switch its outputs off when the controller
+// goes silent. All switching decisions, including the hysteresis, stay on
+// the controller.
+//
+const uint32_t RELAY_MAGIC = 0x594C4552; // "RELY"
+const uint8_t RELAY_PROTOCOL_VERSION = 1;
+
+enum RelayMessageType : uint8_t
+{
+    RELAY_COMMAND = 1, // Controller to node: set `output` to `state`
+    RELAY_ACK = 2      // Node to controller: `output` is now `state`
+};
+
+struct RelayMessage
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;     // RelayMessageType
+    uint8_t output;   // Output index on the node
+    uint8_t state;    // 1 on, 0 off
+    uint32_t session; // Random per controller boot
+    uint32_t sequence;
+};
+
+static_assert(sizeof(RelayMessage) == 16, "RelayMessage layout changed, bump RELAY_PROTOCOL_VERSION");
+
+inline bool relayMessageValid(const uint8_t *data, int length)
+{
+    const RelayMessage *message = (const RelayMessage *)data;
+    return length == (int)sizeof(RelayMessage) && message->magic == RELAY_MAGIC &&
+           message->version == RELAY_PROTOCOL_VERSION;
+}
@@ -0,0 +1,367 @@
+//
+// Host-side replay of recorded power traces through the control core.
+//
+// Built by the native environment in platformio.ini and run on the PC:
+//
+//   pio run -e native
+//   .pio/build/native/program trace.csv policy=ewma threshold=1500 loads=2
+//
+// The trace has one sample per line, "<time in s>,<surplus in W>"; the
+// output of the `history` console command can be used as is. Lines that do
+// not start with a number are skipped. The trace is taken as the surplus
+// with none of the controlled loads on: while the simulation has a load on,
+// its draw is subtracted before the controller sees the sample, as the
+// meter would. The charger's draw is only subtracted when given with
+// charger_power, since the charger policy works on the surplus including it.
+//
+// Settings are given like the `set` console command (threshold, deadband,
+// hysteresis, ewma_tau, horizon, policy), the rest default to the firmware
+// defaults. loads=N enables the first N entries of LOAD_CHANNELS. verbose=1
+// prints every switch.
+//
+// forecast=<Wh>,<Wh>,... gives the PV forecast of the 24 hours of a day,
+// used for every day of the trace: the charge plan biases the thresholds
+// hour by hour as on the device (FORECAST_* settings of config.h). The hour
+// is taken from the trace time as Unix time plus utc_offset=<hours>.
+//
+// The clock is simulated, so a year of samples replays in seconds. Switches
+// happen at their hysteresis deadline between samples, as on the device.
+// Reported are the switch counts, on-times, the surplus energy used and the
+// CPU time spent per decision. The energy is also counted by the firmware's
+// EnergyAccount from the samples alone, for comparison.
+//
+
+#include "charge_controller.h" // Control core
+#include "charge_plan.h"       // Forecast-based charge plan
+#include "config.h"            // LOAD_CHANNELS
+#include "energy_account.h"    // Fixed-point energy accounting of the firmware
+#include "runtime_config.h"    // Settings by name
+#include <chrono>              // Decision timing
+#include <math.h>              // fmod, llround, lround
+#include <stdio.h>             // File input, printf
+#include <stdlib.h>            // strtod, strtol, atoi
+#include <string.h>            // strchr, strcmp
+
+const double MAX_SAMPLE_GAP = 900.0; // Longer gaps (in s) in the trace are not counted as on-time or energy
+
+//
+// Simulated clock and relays that keep the statistics of each channel.
+//
+class ReplayHal : public Hal
+{
+public:
+    struct Channel
+    {
+        bool on;
+        unsigned long switches;
+        double onTime; // s
+    };
+
+    uint32_t millis() override { return now; }
+
+    void setRelay(uint8_t channel, bool on, uint32_t) override
+    {
+        channels[channel].on = on;
+        channels[channel].switches++;
+        if (verbose)
+        {
+            printf("%12.0f %s %s\n", traceTime, channel == 0 ? "charger" : LOAD_CHANNELS[channel - 1].name,
+                   on ? "ON" : "OFF");
+        }
+    }
+
+    uint32_t now = 0;        // Simulated millis()
+    double traceTime = 0.0;  // Time of the current sample in the trace (s)
+    bool verbose = false;
+    Channel channels[1 + LoadScheduler::MAX_CHANNELS] = {};
+};
+
+//
+// Reads 24 comma-separated hourly energies (Wh) into `forecast`.
+//
+static bool parseForecast(const char *text, SolarForecast &forecast)
+{
+    forecast = {};
+    forecast.version = SOLAR_FORECAST_VERSION;
+    for (int hour = 0; hour < 24; hour++)
+    {
+        char *end;
+        long energy = strtol(text, &end, 10);
+        if (end == text || energy < 0 || energy > 65535 || (hour < 23 && *end != ','))
+        {
+            return false;
+        }
+        forecast.energy[hour] = (uint16_t)energy;
+        text = end + 1;
+    }
+    return true;
+}
+
+//
+// Reads "<time>,<power>" from a line. Returns false for headers and comments.
+//
+static bool parseSample(const char *line, double &time, double &power)
+{
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+    char *end;
+    time = strtod(line, &end);
+    if (end == line)
+    {
+        return false;
+    }
+    line = end;
+    while (*line == ',' || *line == ';' || *line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+    power = strtod(line, &end);
+    return end != line;
+}
+
+int main(int argc, char **argv)
+{
+    RuntimeConfig config;
+    runtimeConfigDefaults(config);
+    FILE *input = stdin;
+    int loadCount = 0;
+    double chargerPower = 0.0;
+    bool forecastUsed = false;
+    SolarForecast forecast;
+    double utcOffset = 0.0; // Hours
+    ReplayHal hal;
+
+    for (int i = 1; i < argc; i++)
+    {
+        char *value = strchr(argv[i], '=');
+        if (value == nullptr)
+        {
+            input = fopen(argv[i], "r");
+            if (input == nullptr)
+            {
+                fprintf(stderr, "Cannot open %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        *value++ = '\0';
+        if (strcmp(argv[i], "loads") == 0)
+        {
+            loadCount = atoi(value);
+        }
+        else if (strcmp(argv[i], "charger_power") == 0)
+        {
+            chargerPower = atof(value);
+        }
+        else if (strcmp(argv[i], "forecast") == 0)
+        {
+            forecastUsed = parseForecast(value, forecast);
+            if (!forecastUsed)
+            {
+                fprintf(stderr, "forecast needs 24 hourly energies in Wh\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "utc_offset") == 0)
+        {
+            utcOffset = atof(value);
+        }
+        else if (strcmp(argv[i], "verbose") == 0)
+        {
+            hal.verbose = atoi(value) != 0;
+        }
+        else if (!runtimeConfigSet(config, argv[i], value))
+        {
+            fprintf(stderr, "Invalid setting %s=%s\n", argv[i], value);
+            fprintf(stderr, "Usage: %s [trace.csv] [name=value ...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int maxLoads = (int)(sizeof(LOAD_CHANNELS) / sizeof(LOAD_CHANNELS[0]));
+    maxLoads = maxLoads < LoadScheduler::MAX_CHANNELS ? maxLoads : LoadScheduler::MAX_CHANNELS;
+    if (loadCount < 0 || loadCount > maxLoads)
+    {
+        fprintf(stderr, "loads must be 0..%d\n", maxLoads);
+        return 1;
+    }
+
+    ChargeController controller(hal);
+    controller.configure(config);
+    controller.setChargerPower((uint16_t)chargerPower);
+    for (int i = 0; i < loadCount; i++)
+    {
+        controller.addLoad(LOAD_CHANNELS[i]);
+    }
+
+    // Counts from what the device sees: the measured samples and relay states.
+    EnergyAccount energy((uint32_t)(MAX_SAMPLE_GAP * 1000.0));
+    energy.setChannelPower(0, (uint16_t)chargerPower);
+    for (int i = 0; i + 1 < ENERGY_CHANNELS && i < loadCount; i++)
+    {
+        energy.setChannelPower(1 + i, LOAD_CHANNELS[i].power);
+    }
+
+    ChargePlan plan;
+    if (forecastUsed)
+    {
+        plan.build(forecast, config.powerThreshold, CHARGER_POWER, FORECAST_CHARGE_TARGET,
+                   FORECAST_BASE_LOAD, FORECAST_MAX_BIAS);
+    }
+
+    char text[128];
+    runtimeConfigFormat(config, text, sizeof(text));
+    printf("Config: %s loads=%d charger_power=%.0f\n", text, loadCount, chargerPower);
+    if (forecastUsed)
+    {
+        printf("Plan:     ");
+        for (uint8_t hour = 0; hour < 24; hour++)
+        {
+            if (plan.planned(hour))
+            {
+                printf(" %u (%ldW)", hour, (long)plan.bias(hour));
+            }
+        }
+        printf(", %lu Wh forecast surplus\n", (unsigned long)plan.plannedEnergy());
+    }
+
+    unsigned long samples = 0;
+    double firstTime = 0.0;
+    double previousTime = 0.0;
+    double previousPower = 0.0;
+    double surplusWh = 0.0;        // Positive surplus in the trace
+    double chargerSurplusWh = 0.0; // Positive surplus while the charger was on
+    double drawWh = 0.0;           // Energy drawn by the simulated loads (and charger_power)
+    double coveredWh = 0.0;        // Part of drawWh covered by the surplus
+    double decisionNs = 0.0;
+    double maxDecisionNs = 0.0;
+    auto replayStart = std::chrono::steady_clock::now();
+
+    // Accounts the time from `from` to `to` (s) with the current relay states.
+    auto account = [&](double from, double to, double power)
+    {
+        double elapsed = to - from;
+        if (elapsed <= 0.0 || elapsed > MAX_SAMPLE_GAP)
+        {
+            return;
+        }
+        double surplus = power > 0.0 ? power : 0.0;
+        double draw = hal.channels[0].on ? chargerPower : 0.0;
+        surplusWh += surplus * elapsed / 3600.0;
+        for (int channel = 0; channel <= loadCount; channel++)
+        {
+            if (hal.channels[channel].on)
+            {
+                hal.channels[channel].onTime += elapsed;
+                draw += channel > 0 ? LOAD_CHANNELS[channel - 1].power : 0.0;
+            }
+        }
+        if (hal.channels[0].on)
+        {
+            chargerSurplusWh += surplus * elapsed / 3600.0;
+        }
+        drawWh += draw * elapsed / 3600.0;
+        coveredWh += (draw < surplus ? draw : surplus) * elapsed / 3600.0;
+    };
+
+    char line[256];
+    while (fgets(line, sizeof(line), input) != nullptr)
+    {
+        double time;
+        double power;
+        if (!parseSample(line, time, power))
+        {
+            continue;
+        }
+        if (samples == 0)
+        {
+            firstTime = previousTime = time;
+        }
+
+        // Hysteresis deadlines before this sample switch at their due time, as
+        // the switch timer does on the device.
+        while (controller.switchPending() && time - previousTime <= MAX_SAMPLE_GAP)
+        {
+            uint32_t remaining = controller.remainingTime(hal.now);
+            double due = previousTime + remaining / 1000.0;
+            if (due >= time)
+            {
+                break;
+            }
+            account(previousTime, due, previousPower);
+            previousTime = hal.traceTime = due;
+            hal.now += remaining;
+            if (!controller.expire(hal.now))
+            {
+                break;
+            }
+        }
+        account(previousTime, time, previousPower);
+        previousTime = time;
+        previousPower = power;
+        samples++;
+
+        // The meter sees the surplus left after the simulated loads.
+        double measured = power - (hal.channels[0].on ? chargerPower : 0.0);
+        for (int i = 0; i < loadCount; i++)
+        {
+            measured -= hal.channels[1 + i].on ? LOAD_CHANNELS[i].power : 0.0;
+        }
+
+        // The plan biases the thresholds by the local hour.
+        if (forecastUsed)
+        {
+            double local = fmod(time + utcOffset * 3600.0, 86400.0);
+            int32_t bias = plan.bias((uint8_t)((local < 0.0 ? local + 86400.0 : local) / 3600.0));
+            if (bias != controller.thresholdBias())
+            {
+                controller.setThresholdBias(bias);
+            }
+        }
+
+        // Millisecond timestamps wrap after 49 days, as millis() does on the device.
+        hal.traceTime = time;
+        hal.now = (uint32_t)(uint64_t)llround((time - firstTime) * 1000.0);
+        energy.add((int32_t)lround(measured), controller.relayStates(), hal.now);
+        auto start = std::chrono::steady_clock::now();
+        controller.update((int32_t)lround(measured), hal.now);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        decisionNs += ns;
+        maxDecisionNs = ns > maxDecisionNs ? ns : maxDecisionNs;
+    }
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+
+    double replaySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+    double traceSeconds = previousTime - firstTime;
+    if (samples == 0)
+    {
+        fprintf(stderr, "No samples in the trace\n");
+        return 1;
+    }
+
+    printf("Samples:   %lu over %.1f days, replayed in %.2f s (%.0fx real time)\n", samples, traceSeconds / 86400.0,
+           replaySeconds, replaySeconds > 0.0 ? traceSeconds / replaySeconds : 0.0);
+    printf("Charger:   %lu switches, on %.1f h, %.1f kWh surplus while on\n", hal.channels[0].switches,
+           hal.channels[0].onTime / 3600.0, chargerSurplusWh / 1000.0);
+    for (int i = 0; i < loadCount; i++)
+    {
+        const ReplayHal::Channel &channel = hal.channels[1 + i];
+        printf("Load %s: %lu switches, on %.1f h, %.1f kWh\n", LOAD_CHANNELS[i].name, channel.switches,
+               channel.onTime / 3600.0, channel.onTime * LOAD_CHANNELS[i].power / 3600000.0);
+    }
+    printf("Surplus:   %.1f kWh in the trace\n", surplusWh / 1000.0);
+    if (drawWh > 0.0)
+    {
+        printf("Loads:     %.1f kWh drawn, %.1f kWh (%.0f%%) from the surplus, %.1f kWh imported\n", drawWh / 1000.0,
+               coveredWh / 1000.0, 100.0 * coveredWh / drawWh, (drawWh - coveredWh) / 1000.0);
+    }
+    printf("Account:   %.1f kWh diverted, %.1f kWh exported, counted by the firmware from the samples\n",
+           energy.divertedToday() / 1000.0, energy.exportedToday() / 1000.0);
+    printf("Decisions: %.0f ns mean, %.0f ns max per sample\n", decisionNs / samples, maxDecisionNs);
+    return 0;
+}
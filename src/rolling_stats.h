@@ -0,0 +1,168 @@
+#pragma once
+
+#include <math.h>   // sqrtf
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Fixed-capacity ring buffer keeping the most recent items.
+// Pushing into a full buffer overwrites the oldest item.
+//
+template <typename T, size_t Capacity>
+class SampleRing
+{
+public:
+    void push(const T &item)
+    {
+        items[head] = item;
+        head = (head + 1) % Capacity;
+        if (length < Capacity)
+        {
+            length++;
+        }
+    }
+
+    // Item `age` positions back in time (0 = newest). `age` must be < size().
+    const T &recent(size_t age) const
+    {
+        return items[(head + Capacity - 1 - age) % Capacity];
+    }
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    void clear() { head = length = 0; }
+
+    // Removes the `count` oldest items, e.g. once they have been sent.
+    void dropOldest(size_t count) { length -= count < length ? count : length; }
+
+private:
+    T items[Capacity];
+    size_t head = 0;   // Next slot to write
+    size_t length = 0; // Number of valid items
+};
+
+//
+// Rolling mean, minimum, maximum and variance over the last `window` values.
+//
+// Every statistic is maintained incrementally when a value is added: sums
+// are updated with the entering and leaving value, and minimum/maximum use
+// monotonic queues, so add() is amortized O(1) and reading a statistic
+// never rescans the window. Integer sums keep the mean and variance exact
+// no matter how long the unit runs.
+//
+template <size_t Capacity>
+class RollingStats
+{
+public:
+    // `window` is the number of values covered, at most Capacity.
+    explicit RollingStats(size_t window = Capacity)
+        : window(window < 1 ? 1 : (window > Capacity ? Capacity : window))
+    {
+    }
+
+    void add(int32_t value)
+    {
+        // Drop the value leaving the window from the sums.
+        if (length == window)
+        {
+            int32_t oldest = values[(next + Capacity - window) % Capacity];
+            sum -= oldest;
+            sumSquares -= (int64_t)oldest * oldest;
+        }
+        else
+        {
+            length++;
+        }
+        values[next] = value;
+        next = (next + 1) % Capacity;
+        sum += value;
+        sumSquares += (int64_t)value * value;
+
+        uint32_t position = added++;
+        minimums.add(position, value, window, false);
+        maximums.add(position, value, window, true);
+    }
+
+    size_t count() const { return length; }
+    size_t windowSize() const { return window; }
+
+    int32_t mean() const { return length ? (int32_t)(sum / (int64_t)length) : 0; }
+    int32_t min() const { return length ? minimums.front() : 0; }
+    int32_t max() const { return length ? maximums.front() : 0; }
+
+    // Population variance in squared units.
+    int64_t variance() const
+    {
+        if (length == 0)
+        {
+            return 0;
+        }
+        int64_t n = (int64_t)length;
+        return (sumSquares * n - sum * sum) / (n * n);
+    }
+
+    int32_t stddev() const { return (int32_t)sqrtf((float)variance()); }
+
+    void clear()
+    {
+        length = next = 0;
+        sum = sumSquares = 0;
+        minimums.clear();
+        maximums.clear();
+    }
+
+private:
+    //
+    // Queue of window positions whose values are monotonic, so the front is
+    // always the window's minimum (or maximum).
+    //
+    class MonotonicQueue
+    {
+    public:
+        void add(uint32_t position, int32_t value, size_t window, bool keepMaximum)
+        {
+            // Values that can never become the extreme again are dropped from the back.
+            while (size > 0)
+            {
+                int32_t last = entries[(start + size - 1) % Capacity].value;
+                if (keepMaximum ? last > value : last < value)
+                {
+                    break;
+                }
+                size--;
+            }
+            entries[(start + size) % Capacity] = {position, value};
+            size++;
+
+            // The front expires once it falls out of the window.
+            if (position - entries[start].position >= window)
+            {
+                start = (start + 1) % Capacity;
+                size--;
+            }
+        }
+
+        int32_t front() const { return entries[start].value; }
+        void clear() { start = size = 0; }
+
+    private:
+        struct Entry
+        {
+            uint32_t position;
+            int32_t value;
+        };
+        Entry entries[Capacity];
+        size_t start = 0;
+        size_t size = 0;
+    };
+
+    size_t window;
+    int32_t values[Capacity];
+    size_t next = 0;   // Next slot to write in `values`
+    size_t length = 0; // Number of values in the window
+    int64_t sum = 0;
+    int64_t sumSquares = 0;
+    uint32_t added = 0; // Total number of values added, used as position
+    MonotonicQueue minimums;
+    MonotonicQueue maximums;
+};
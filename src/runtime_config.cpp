@@ -0,0 +1,138 @@
+//
+// Runtime configuration record.
+//
+
+#include "runtime_config.h"
+#include "config.h" // Project configuration constants
+#include <stdio.h>  // snprintf
+#include <stdlib.h> // strtoul
+#include <string.h> // strcmp, strtok_r
+
+// Threshold and hysteresis selected by each DIP switch position
+struct DipPreset
+{
+    uint16_t hysteresisTime; // s
+    uint16_t powerThreshold; // W
+};
+
+static const DipPreset dipPresets[8] = {
+    {120, 500},  // 0 0 0
+    {120, 1000}, // 0 0 1
+    {120, 1500}, // 0 1 0
+    {120, 2000}, // 0 1 1
+    {240, 500},  // 1 0 0
+    {240, 1000}, // 1 0 1
+    {240, 1500}, // 1 1 0
+    {240, 2000}, // 1 1 1
+};
+
+// Settings that can be changed by name, with their valid range
+struct ConfigSetting
+{
+    const char *name;
+    uint16_t RuntimeConfig::*field;
+    uint16_t min;
+    uint16_t max;
+};
+
+static const ConfigSetting settings[] = {
+    {"threshold", &RuntimeConfig::powerThreshold, 0, 20000},
+    {"deadband", &RuntimeConfig::switchDeadband, 0, 5000},
+    {"hysteresis", &RuntimeConfig::hysteresisTime, 0, 3600},
+    {"ewma_tau", &RuntimeConfig::ewmaTimeConstant, 1, 3600},
+    {"horizon", &RuntimeConfig::trendHorizon, 0, 3600},
+};
+
+void runtimeConfigDefaults(RuntimeConfig &config)
+{
+    config = {};
+    config.version = RUNTIME_CONFIG_VERSION;
+    config.dipSetting = 0xFF; // Not synchronized with the DIP switches yet
+    config.policy = SWITCH_POLICY;
+    config.powerThreshold = 1000;
+    config.switchDeadband = SWITCH_DEADBAND;
+    config.hysteresisTime = 120;
+    config.ewmaTimeConstant = EWMA_TIME_CONSTANT / 1000;
+    config.trendHorizon = TREND_HORIZON / 1000;
+}
+
+void runtimeConfigApplyDip(RuntimeConfig &config, uint8_t dipValue)
+{
+    const DipPreset &preset = dipPresets[dipValue & 7];
+    config.hysteresisTime = preset.hysteresisTime;
+    config.powerThreshold = preset.powerThreshold;
+    config.dipSetting = dipValue & 7;
+}
+
+bool runtimeConfigSet(RuntimeConfig &config, const char *name, const char *value)
+{
+    if (strcmp(name, "policy") == 0)
+    {
+        if (strcmp(value, "hysteresis") == 0)
+        {
+            config.policy = POLICY_HYSTERESIS;
+        }
+        else if (strcmp(value, "ewma") == 0)
+        {
+            config.policy = POLICY_EWMA;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    for (const ConfigSetting &setting : settings)
+    {
+        if (strcmp(name, setting.name) != 0)
+        {
+            continue;
+        }
+        char *end;
+        unsigned long number = strtoul(value, &end, 10);
+        if (end == value || *end != '\0' || number < setting.min || number > setting.max)
+        {
+            return false;
+        }
+        config.*setting.field = (uint16_t)number;
+        return true;
+    }
+    return false;
+}
+
+bool runtimeConfigSetPairs(RuntimeConfig &config, char *text, char *error, size_t size)
+{
+    bool any = false;
+    char *position = nullptr;
+    for (char *pair = strtok_r(text, " \r\n", &position); pair != nullptr;
+         pair = strtok_r(nullptr, " \r\n", &position))
+    {
+        char *value = strchr(pair, '=');
+        if (value != nullptr)
+        {
+            *value++ = '\0';
+        }
+        if (value == nullptr || !runtimeConfigSet(config, pair, value))
+        {
+            snprintf(error, size, "invalid setting: %s%s%s", pair, value ? "=" : "", value ? value : "");
+            return false;
+        }
+        any = true;
+    }
+    if (!any)
+    {
+        snprintf(error, size, "no settings. Usage: <name>=<value> ...");
+    }
+    return any;
+}
+
+size_t runtimeConfigFormat(const RuntimeConfig &config, char *buffer, size_t size)
+{
+    int length = snprintf(buffer, size,
+                          "policy=%s threshold=%u deadband=%u hysteresis=%u ewma_tau=%u horizon=%u dip=%u",
+                          config.policy == POLICY_EWMA ? "ewma" : "hysteresis", config.powerThreshold,
+                          config.switchDeadband, config.hysteresisTime, config.ewmaTimeConstant,
+                          config.trendHorizon, config.dipSetting);
+    return length < 0 ? 0 : ((size_t)length < size ? length : size - 1);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Runtime configuration stored in NVS.
+//
+// The settings are kept as one compact, versioned binary record and loaded
+// once at boot. The DIP switches act as presets: when their position differs
+// from the one the stored record was last synchronized with, a technician
+// has changed them and the matching preset overrides the stored thresholds.
+// Otherwise the stored (possibly remotely tuned) values are used. Loading
+// and saving the record is part of persist.h.
+//
+struct RuntimeConfig
+{
+    uint8_t version;           // Layout version, RUNTIME_CONFIG_VERSION
+    uint8_t dipSetting;        // DIP switch value the record was last synchronized with
+    uint16_t powerThreshold;   // Switch-on threshold in W
+    uint16_t switchDeadband;   // Deadband below the threshold in W (EWMA policy)
+    uint16_t hysteresisTime;   // Hysteresis time in s
+    uint16_t ewmaTimeConstant; // Power filter time constant in s (EWMA policy)
+    uint16_t trendHorizon;     // Trend extrapolation horizon in s (EWMA policy)
+    uint8_t policy;            // Switching policy (SwitchPolicyType)
+    uint8_t reserved;          // Keeps the record free of implicit padding
+};
+
+// Fields are ordered so the record has no padding and every field stays aligned.
+static_assert(sizeof(RuntimeConfig) == 14, "RuntimeConfig layout changed, bump RUNTIME_CONFIG_VERSION");
+
+const uint8_t RUNTIME_CONFIG_VERSION = 1;
+
+// Fills in the firmware defaults from config.h.
+void runtimeConfigDefaults(RuntimeConfig &config);
+
+// Applies the DIP switch preset (threshold and hysteresis) for `dipValue` (0..7).
+void runtimeConfigApplyDip(RuntimeConfig &config, uint8_t dipValue);
+
+//
+// Changes one setting by name (threshold, deadband, hysteresis, ewma_tau,
+// horizon, policy). Returns false for unknown names or out-of-range values.
+//
+bool runtimeConfigSet(RuntimeConfig &config, const char *name, const char *value);
+
+//
+// Changes the settings of "name=value" pairs separated by spaces, as
+// printed by runtimeConfigFormat() but without `dip`. Stops at the first
+// invalid pair and returns false with the reason in `error`, leaving
+// `config` partly changed; apply it to a copy to change all or nothing.
+// `text` is modified.
+//
+bool runtimeConfigSetPairs(RuntimeConfig &config, char *text, char *error, size_t size);
+
+// Describes the configuration as "name=value" pairs.
+size_t runtimeConfigFormat(const RuntimeConfig &config, char *buffer, size_t size);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>   // Lock-free head/tail indices
+#include <stddef.h> // size_t
+
+//
+// Fixed-capacity lock-free single-producer/single-consumer queue.
+//
+// One task may call push() and one other task may call pop(); no locks or
+// heap allocations are involved, so producer and consumer can run on
+// different cores without ever blocking each other. Capacity must be a
+// power of two, one slot is kept free to tell "full" from "empty".
+//
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Adds an item. Returns false (and drops the item) when the queue is full.
+    bool push(const T &item)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        size_t next = (head + 1) & (Capacity - 1);
+        if (next == tailIndex.load(std::memory_order_acquire))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items[head] = item;
+        headIndex.store(next, std::memory_order_release); // Publish the item to the consumer.
+        return true;
+    }
+
+    // Removes the oldest item. Returns false when the queue is empty.
+    bool pop(T &item)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail == headIndex.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[tail];
+        tailIndex.store((tail + 1) & (Capacity - 1), std::memory_order_release); // Hand the slot back.
+        return true;
+    }
+
+    bool empty() const
+    {
+        return tailIndex.load(std::memory_order_acquire) == headIndex.load(std::memory_order_acquire);
+    }
+
+    // Number of items rejected by push() because the consumer fell behind.
+    unsigned long droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    T items[Capacity];
+    std::atomic<size_t> headIndex{0}; // Next slot to write, owned by the producer
+    std::atomic<size_t> tailIndex{0}; // Next slot to read, owned by the consumer
+    std::atomic<unsigned long> dropped{0};
+};
@@ -0,0 +1,208 @@
+//
+// Non-blocking HTTP status endpoint.
+//
+
+#include "status_server.h"
+#include "config.h"        // Server settings
+#include "perf_stats.h"    // Serving time
+#include <errno.h>         // errno of a full send buffer
+#include <lwip/sockets.h>  // Non-blocking send
+#include <stdio.h>         // vsnprintf
+#include <string.h>        // strncmp
+
+// Page buffer, reused for every response
+static char pageBuffer[HTTP_RESPONSE_SIZE];
+
+TextWriter::TextWriter(char *buffer, size_t size) : buffer(buffer), size(size)
+{
+    buffer[0] = '\0';
+}
+
+void TextWriter::printf(const char *format, ...)
+{
+    if (full)
+    {
+        return;
+    }
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(buffer + used, size - used, format, arguments);
+    va_end(arguments);
+    if (length < 0 || (size_t)length >= size - used)
+    {
+        full = true;
+        used = size - 1;
+        return;
+    }
+    used += length;
+}
+
+void TextWriter::commit(size_t length)
+{
+    used += length < size - used ? length : size - 1 - used;
+    full = full || used == size - 1;
+}
+
+void TextWriter::trimToLine()
+{
+    while (used > 0 && buffer[used - 1] != '\n')
+    {
+        used--;
+    }
+    buffer[used] = '\0';
+}
+
+void TextWriter::metric(const char *name, const char *labels, long value)
+{
+    printf(labels ? "%s{%s} %ld\n" : "%s%s %ld\n", name, labels ? labels : "", value);
+}
+
+void TextWriter::metric(const char *name, const char *labels, int32_t value, uint8_t decimals)
+{
+    int32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++)
+    {
+        scale *= 10;
+    }
+    long whole = value / scale;
+    long fraction = value % scale;
+    printf(labels ? "%s{%s} %s%ld.%0*ld\n" : "%s%s %s%ld.%0*ld\n", name, labels ? labels : "",
+           value < 0 && whole == 0 ? "-" : "", whole, decimals, fraction < 0 ? -fraction : fraction);
+}
+
+void StatusServer::begin(uint16_t port, PageHandler handler)
+{
+    onPage = handler;
+    server.begin(port);
+    server.setNoDelay(true);
+}
+
+void StatusServer::loop(unsigned long currentTime)
+{
+    if (sending)
+    {
+        if (!sendResponse() || currentTime - sendTime >= HTTP_SEND_TIMEOUT)
+        {
+            close(); // All sent, or the client stopped reading.
+        }
+        return;
+    }
+
+    if (!active)
+    {
+        client = server.available();
+        if (!client)
+        {
+            return;
+        }
+        active = true;
+        acceptTime = currentTime;
+        requestLength = 0;
+        headerEnd = 0;
+    }
+
+    // Read whatever has arrived, keeping the start of the request.
+    static const char HEADER_END[] = "\r\n\r\n";
+    while (client.available() > 0 && headerEnd < 4)
+    {
+        char c = (char)client.read();
+        headerEnd = c == HEADER_END[headerEnd] ? headerEnd + 1 : (c == '\r' ? 1 : 0);
+        if (requestLength < sizeof(request) - 1)
+        {
+            request[requestLength++] = c;
+        }
+    }
+
+    if (headerEnd == 4)
+    {
+        PerfTimer timer(STAGE_HTTP_SERVE);
+        request[requestLength] = '\0';
+        respond(currentTime);
+        if (!sendResponse())
+        {
+            close(); // Small responses go out at once.
+        }
+    }
+    else if (!client.connected() || currentTime - acceptTime >= HTTP_SERVER_TIMEOUT)
+    {
+        close(); // Incomplete or idle request.
+    }
+}
+
+//
+// Answers the buffered request: GET <path> is passed to the page handler.
+// The response is then sent by sendResponse().
+//
+void StatusServer::respond(unsigned long currentTime)
+{
+    TextWriter writer(pageBuffer, sizeof(pageBuffer));
+
+    const char *status = "404 Not Found";
+    if (strncmp(request, "GET ", 4) != 0)
+    {
+        status = "405 Method Not Allowed";
+    }
+    else
+    {
+        char *path = request + 4;
+        char *end = strpbrk(path, " ?\r");
+        if (end != nullptr)
+        {
+            *end = '\0';
+        }
+        if (onPage != nullptr && onPage(path, writer))
+        {
+            status = "200 OK";
+        }
+    }
+    if (strncmp(status, "200", 3) != 0)
+    {
+        writer.printf("%s\n", status);
+    }
+    if (writer.truncated())
+    {
+        writer.trimToLine(); // Serve complete lines only.
+        truncated++;
+        Serial.printf("Status page for %s cut off at %u bytes.\n", request, (unsigned)writer.length());
+    }
+
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: %u\r\nConnection: close\r\n\r\n",
+                          status, (unsigned)writer.length());
+    headerLength = length > 0 && (size_t)length < sizeof(header) ? length : 0;
+    body = writer.text();
+    bodyLength = writer.length();
+    sent = 0;
+    sending = true;
+    sendTime = currentTime;
+    requests++;
+}
+
+//
+// Sends as much of the response as the socket's send buffer takes without
+// waiting. Returns true while there is more to send.
+//
+bool StatusServer::sendResponse()
+{
+    while (sent < headerLength + bodyLength)
+    {
+        const char *data = sent < headerLength ? header + sent : body + (sent - headerLength);
+        size_t length = sent < headerLength ? headerLength - sent : headerLength + bodyLength - sent;
+        int written = ::send(client.fd(), data, length, MSG_DONTWAIT);
+        if (written < 0)
+        {
+            // A full buffer is retried on the next call; any other error ends the response.
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        sent += written;
+    }
+    return false;
+}
+
+void StatusServer::close()
+{
+    client.stop();
+    active = false;
+    sending = false;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <WiFi.h>   // WiFiServer and WiFiClient
+#include <stdarg.h> // va_list
+
+//
+// Appends formatted text to a fixed buffer; output beyond its size is cut off.
+//
+class TextWriter
+{
+public:
+    TextWriter(char *buffer, size_t size);
+
+    void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Writes a Prometheus sample line: <name>[{labels}] <value>
+    void metric(const char *name, const char *labels, long value);
+    void metric(const char *name, const char *labels, int32_t value, uint8_t decimals);
+
+    // Lets a formatting function write at the end of the buffer: it gets
+    // tail() and space() and reports the characters it wrote to commit().
+    char *tail() { return buffer + used; }
+    size_t space() const { return size - used; }
+    void commit(size_t length);
+
+    const char *text() const { return buffer; }
+    size_t length() const { return used; }
+    bool truncated() const { return full; }
+
+    // Drops a cut-off last line, so the text ends after a complete one.
+    void trimToLine();
+
+private:
+    char *buffer;
+    size_t size;
+    size_t used = 0;
+    bool full = false;
+};
+
+//
+// Minimal HTTP server for status scraping, serviced from loop().
+//
+// Serves one connection at a time without ever waiting on the network: a
+// request is read as far as it has arrived on each call and answered once
+// its header is complete, or dropped after HTTP_SERVER_TIMEOUT. The
+// response body is written into a static buffer by the handler, so no heap
+// allocation or String concatenation is involved. The response is sent as
+// far as the socket's send buffer takes it on each call, never waiting for
+// the client's acknowledgements, and the connection is closed once all of
+// it is sent, or after HTTP_SEND_TIMEOUT.
+//
+// A page larger than HTTP_RESPONSE_SIZE is cut after its last complete
+// line and counted in truncatedCount().
+//
+class StatusServer
+{
+public:
+    // Writes the body for `path`. Returns false for unknown paths (404).
+    typedef bool (*PageHandler)(const char *path, TextWriter &body);
+
+    void begin(uint16_t port, PageHandler handler);
+
+    // Accepts, reads and answers requests without blocking.
+    void loop(unsigned long currentTime);
+
+    unsigned long requestCount() const { return requests; }
+    unsigned long truncatedCount() const { return truncated; }
+
+private:
+    void respond(unsigned long currentTime);
+    bool sendResponse();
+    void close();
+
+    WiFiServer server;
+    WiFiClient client;
+    PageHandler onPage = nullptr;
+
+    bool active = false;          // A connection is being served
+    unsigned long acceptTime = 0; // millis() at which the connection was accepted
+    char request[128];            // Start of the request, up to the end of the header
+    size_t requestLength = 0;
+    uint8_t headerEnd = 0;        // Characters of "\r\n\r\n" matched so far
+
+    bool sending = false;         // The response is being sent
+    unsigned long sendTime = 0;   // millis() at which sending started
+    char header[128];             // Response header
+    size_t headerLength = 0;
+    const char *body = nullptr;   // Response body, in the static page buffer
+    size_t bodyLength = 0;
+    size_t sent = 0;              // Bytes of header and body sent so far
+
+    unsigned long requests = 0;   // Number of requests answered
+    unsigned long truncated = 0;  // Number of pages cut off at the buffer size
+};
@@ -0,0 +1,124 @@
+//
+// Charger switching policies.
+//
+
+#include "switch_policy.h"
+#include <math.h> // expf
+
+uint32_t SwitchPolicy::remainingTime(uint32_t currentTime) const
+{
+    if (!pending)
+    {
+        return 0;
+    }
+    uint32_t elapsed = currentTime - pendingStart;
+    return elapsed < holdTime ? holdTime - elapsed : 0;
+}
+
+bool SwitchPolicy::expire(uint32_t timestamp)
+{
+    if (!pending || timestamp - pendingStart < holdTime)
+    {
+        return false;
+    }
+    pending = false;
+    return true;
+}
+
+bool SwitchPolicy::holdFor(bool condition, uint32_t timestamp)
+{
+    if (!condition)
+    {
+        pending = false; // Reset the timer
+        return false;
+    }
+    if (!pending)
+    {
+        pending = true; // Start the timer
+        pendingStart = timestamp;
+    }
+    if (timestamp - pendingStart >= holdTime)
+    {
+        pending = false;
+        return true;
+    }
+    return false;
+}
+
+void HysteresisPolicy::configure(int32_t thresholdPower, uint32_t hysteresisTime)
+{
+    threshold = thresholdPower;
+    setHoldTime(hysteresisTime);
+    reset();
+}
+
+bool HysteresisPolicy::update(int32_t power, uint32_t timestamp, bool chargerOn)
+{
+    lastPower = power;
+    // Switch on with enough surplus, off when the power drops below the threshold.
+    bool crossed = chargerOn ? power < threshold : power >= threshold;
+    return holdFor(crossed, timestamp) ? !chargerOn : chargerOn;
+}
+
+int32_t HysteresisPolicy::switchDistance(bool chargerOn) const
+{
+    return chargerOn ? lastPower - threshold + 1 : threshold - lastPower;
+}
+
+void EwmaPolicy::configure(int32_t onPower, int32_t offPower, uint32_t hysteresisTime,
+                           uint32_t filterTimeConstant, uint32_t horizon)
+{
+    onThreshold = onPower;
+    offThreshold = offPower < onPower ? offPower : onPower;
+    timeConstant = filterTimeConstant > 0 ? (float)filterTimeConstant : 1.0f;
+    trendHorizon = (float)horizon;
+    setHoldTime(hysteresisTime);
+    reset();
+}
+
+void EwmaPolicy::setThresholds(int32_t onPower, int32_t offPower)
+{
+    onThreshold = onPower;
+    offThreshold = offPower < onPower ? offPower : onPower;
+}
+
+void EwmaPolicy::reset()
+{
+    SwitchPolicy::reset();
+    primed = false;
+    filtered = slope = projected = 0.0f;
+}
+
+int32_t EwmaPolicy::switchDistance(bool chargerOn) const
+{
+    int32_t power = decisionPower();
+    return chargerOn ? power - offThreshold + 1 : onThreshold - power;
+}
+
+bool EwmaPolicy::update(int32_t power, uint32_t timestamp, bool chargerOn)
+{
+    if (!primed)
+    {
+        primed = true;
+        filtered = projected = (float)power;
+        slope = 0.0f;
+    }
+    else
+    {
+        float elapsed = (float)(timestamp - lastTimestamp);
+        if (elapsed > 0.0f)
+        {
+            // Weight the new sample by the time it covers, so the filter behaves
+            // the same regardless of the sample interval.
+            float alpha = 1.0f - expf(-elapsed / timeConstant);
+            float previous = filtered;
+            filtered += alpha * ((float)power - filtered);
+            slope += alpha * ((filtered - previous) / elapsed - slope);
+            projected = filtered + slope * trendHorizon;
+        }
+    }
+    lastTimestamp = timestamp;
+
+    bool crossed = chargerOn ? projected < offThreshold : projected >= onThreshold;
+    return holdFor(crossed, timestamp) ? !chargerOn : chargerOn;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h> // Fixed-width integer types
+
+//
+// Decides when the charger should switch, based on the surplus power samples.
+//
+// A policy is fed every sample and returns the desired charger state. A
+// switch is only requested once its condition has held for the hold time
+// (the hysteresis time); remainingTime() reports how long a pending switch
+// still has to wait, which printStatus() shows as a countdown. As the
+// condition holds until a sample says otherwise, the caller can switch at
+// the deadline itself with expire(), between samples.
+//
+// Timestamps are millis() values. Only differences between them are used,
+// so they stay correct across the 49-day rollover.
+//
+class SwitchPolicy
+{
+public:
+    virtual ~SwitchPolicy() {}
+
+    // Feeds a sample of surplus `power` (W) taken at `timestamp` (ms).
+    // Returns the desired charger state.
+    virtual bool update(int32_t power, uint32_t timestamp, bool chargerOn) = 0;
+
+    // Power (W) the last decision was based on.
+    virtual int32_t decisionPower() const = 0;
+
+    // How far (W) the decision power is from the threshold of the next switch.
+    // Negative once the threshold has been crossed.
+    virtual int32_t switchDistance(bool chargerOn) const = 0;
+
+    // Forgets all history, e.g. after the configuration changed.
+    virtual void reset() { pending = false; }
+
+    bool switchPending() const { return pending; }
+
+    // Time (ms) until a pending switch happens, 0 if none is pending.
+    uint32_t remainingTime(uint32_t currentTime) const;
+
+    // Returns true if a pending switch is due at `timestamp`. The caller
+    // then switches the charger; the switch is no longer pending.
+    bool expire(uint32_t timestamp);
+
+    void setHoldTime(uint32_t time) { holdTime = time; }
+    uint32_t getHoldTime() const { return holdTime; }
+
+protected:
+    // Returns true once `condition` has held continuously for the hold time.
+    bool holdFor(bool condition, uint32_t timestamp);
+
+private:
+    uint32_t holdTime = 0;
+    bool pending = false;      // A switch condition is currently holding
+    uint32_t pendingStart = 0; // Timestamp at which the condition started to hold
+};
+
+//
+// Classic hysteresis: switch on when the raw power has been at or above the
+// threshold for the hold time, switch off when it has been below it for the
+// hold time. Any single sample on the other side restarts the timer.
+//
+class HysteresisPolicy : public SwitchPolicy
+{
+public:
+    void configure(int32_t thresholdPower, uint32_t hysteresisTime);
+
+    // Moves the threshold without restarting a pending switch.
+    void setThreshold(int32_t thresholdPower) { threshold = thresholdPower; }
+
+    bool update(int32_t power, uint32_t timestamp, bool chargerOn) override;
+    int32_t decisionPower() const override { return lastPower; }
+    int32_t switchDistance(bool chargerOn) const override;
+
+private:
+    int32_t threshold = 0;
+    int32_t lastPower = 0;
+};
+
+//
+// Smoothed, trend-aware switching with a deadband.
+//
+// The power is filtered with an exponentially weighted moving average whose
+// time constant is independent of the sample interval, and the filtered
+// trend is extrapolated over a short horizon. The charger switches on when
+// the projected power has stayed at or above `onThreshold` for the hold time
+// and off when it has stayed below `offThreshold`. Short cloud-edge dips
+// hardly move the filtered value, so they no longer restart the timer.
+//
+class EwmaPolicy : public SwitchPolicy
+{
+public:
+    void configure(int32_t onThreshold, int32_t offThreshold, uint32_t hysteresisTime,
+                   uint32_t timeConstant, uint32_t trendHorizon);
+
+    // Moves the thresholds without restarting a pending switch or the filter.
+    void setThresholds(int32_t onPower, int32_t offPower);
+
+    bool update(int32_t power, uint32_t timestamp, bool chargerOn) override;
+    int32_t decisionPower() const override { return (int32_t)projected; }
+    int32_t switchDistance(bool chargerOn) const override;
+    void reset() override;
+
+    int32_t filteredPower() const { return (int32_t)filtered; }
+
+private:
+    int32_t onThreshold = 0;
+    int32_t offThreshold = 0;
+    float timeConstant = 1.0f; // EWMA time constant in ms
+    float trendHorizon = 0.0f; // Extrapolation horizon in ms
+
+    bool primed = false;       // The filter has seen a first sample
+    uint32_t lastTimestamp = 0;
+    float filtered = 0.0f;     // Filtered power in W
+    float slope = 0.0f;        // Filtered trend in W/ms
+    float projected = 0.0f;    // Filtered power extrapolated over the horizon
+};
@@ -0,0 +1,126 @@
+//
+// Telemetry payload encodings.
+//
+
+#include "telemetry_codec.h"
+#include <stdio.h> // snprintf
+
+size_t encodeTelemetryJson(const TelemetryBatchInfo &info, const TelemetryRecord *records, size_t count,
+                           char *buffer, size_t size)
+{
+    size_t length = snprintf(buffer, size, "{\"device\":\"%s\",\"uptime\":%lu,\"dropped\":%lu,\"samples\":[",
+                             info.device, (unsigned long)info.uptime, (unsigned long)info.dropped);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        bool first = true;
+        for (size_t i = 0; i < count && length < size; i++)
+        {
+            const TelemetryRecord &record = records[i];
+            if (record.type != (pass == 0 ? TELEMETRY_SAMPLE : TELEMETRY_SWITCH))
+            {
+                continue;
+            }
+            if (pass == 0)
+            {
+                length += snprintf(buffer + length, size - length, "%s[%lu,%ld,%u]", first ? "" : ",",
+                                   (unsigned long)record.timestamp, (long)record.power, record.state);
+            }
+            else
+            {
+                length += snprintf(buffer + length, size - length, "%s[%lu,%u,%u,%ld]", first ? "" : ",",
+                                   (unsigned long)record.timestamp, record.channel, record.state, (long)record.power);
+            }
+            first = false;
+        }
+        if (length < size)
+        {
+            length += snprintf(buffer + length, size - length, pass == 0 ? "],\"events\":[" : "]}");
+        }
+    }
+    return length < size ? length : size - 1;
+}
+
+//
+// Appends bytes and varints to a fixed buffer, remembering any overflow.
+//
+class BinaryWriter
+{
+public:
+    BinaryWriter(uint8_t *buffer, size_t size) : buffer(buffer), size(size) {}
+
+    void byte(uint8_t value)
+    {
+        if (length < size)
+        {
+            buffer[length++] = value;
+        }
+        else
+        {
+            overflow = true;
+        }
+    }
+
+    void varint(uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            byte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        byte((uint8_t)value);
+    }
+
+    // Maps small negative and positive values to small unsigned ones.
+    void zigzag(int32_t value)
+    {
+        varint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+
+    size_t result() const { return overflow ? 0 : length; }
+
+private:
+    uint8_t *buffer;
+    size_t size;
+    size_t length = 0;
+    bool overflow = false;
+};
+
+size_t encodeTelemetryBinary(const TelemetryBatchInfo &info, const TelemetryRecord *records, size_t count,
+                             uint8_t *buffer, size_t size)
+{
+    BinaryWriter writer(buffer, size);
+    writer.byte(TELEMETRY_BINARY_VERSION);
+    writer.varint(info.uptime);
+    writer.varint(info.dropped);
+    writer.varint(count ? records[0].timestamp : 0);
+    writer.varint(count);
+
+    uint32_t previousTime = count ? records[0].timestamp : 0;
+    int32_t previousPower = 0;
+    uint16_t previousStates = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const TelemetryRecord &record = records[i];
+        bool statesChanged = record.type == TELEMETRY_SAMPLE && record.state != previousStates;
+        writer.byte((statesChanged ? 2 : 0) | (record.type & 1));
+        writer.zigzag((int32_t)(record.timestamp - previousTime)); // Negative for an out-of-order record
+        if (record.type == TELEMETRY_SAMPLE)
+        {
+            writer.zigzag(record.power - previousPower);
+            if (statesChanged)
+            {
+                writer.varint(record.state);
+                previousStates = record.state;
+            }
+        }
+        else
+        {
+            writer.varint(record.channel);
+            writer.byte((uint8_t)record.state);
+            writer.zigzag(record.power - previousPower);
+        }
+        previousTime = record.timestamp;
+        previousPower = record.power;
+    }
+    return writer.result();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // Fixed-width integer types
+
+// Kinds of telemetry records
+enum TelemetryType : uint8_t
+{
+    TELEMETRY_SAMPLE, // Meter sample with the relay states
+    TELEMETRY_SWITCH  // A relay channel switched
+};
+
+//
+// One telemetry record. For a sample `state` holds the relay states as a
+// bitmask (bit 0 the charger, bit 1 + i load channel i); for a switch event
+// `channel` is the relay (0 the charger, 1 + i load channel i) and `state`
+// its new state.
+//
+struct TelemetryRecord
+{
+    uint32_t timestamp; // millis() of the sample or switch
+    int32_t power;      // Surplus power in W
+    uint8_t type;       // TelemetryType
+    uint8_t channel;
+    uint16_t state;
+};
+
+// Batch-wide fields sent with every message
+struct TelemetryBatchInfo
+{
+    const char *device; // Device id
+    uint32_t uptime;    // millis() when the batch was encoded
+    uint32_t dropped;   // Records lost to buffer overflow so far
+};
+
+//
+// Encodes records (oldest first) as JSON:
+//   {"device":"...","uptime":ms,"dropped":n,
+//    "samples":[[ms,power,states],...],"events":[[ms,channel,state,power],...]}
+// Returns the payload length; output beyond `size` is cut off.
+//
+size_t encodeTelemetryJson(const TelemetryBatchInfo &info, const TelemetryRecord *records, size_t count,
+                           char *buffer, size_t size);
+
+const uint8_t TELEMETRY_BINARY_VERSION = 2;
+
+//
+// Encodes records (oldest first) in the compact binary format. Integers are
+// LEB128 varints, signed values zigzag encoded first:
+//
+//   version (byte), uptime, dropped, first timestamp, record count
+//   per record: tag (byte) = states changed << 1 | type, zigzag time delta
+//     sample: zigzag power delta [, states if changed]
+//     switch: channel, state, zigzag power delta
+//
+// Time and power deltas are taken from the previous record (power from 0,
+// the timestamp from the first one, states from 0), so a typical sample
+// takes 5 to 7 bytes. The time delta is signed and taken modulo 2^32:
+// records are not strictly in time order (a switch at a deadline can be
+// posted before a sample whose read started earlier), and the decoder
+// adds the deltas modulo 2^32 like millis() wraps. The device id is part
+// of the topic. Returns the payload length, 0 if it does not fit in `size`.
+//
+size_t encodeTelemetryBinary(const TelemetryBatchInfo &info, const TelemetryRecord *records, size_t count,
+                             uint8_t *buffer, size_t size);
@@ -0,0 +1,114 @@
+//
+// Non-blocking WiFi reconnection with exponential backoff.
+//
+
+#include "wifi_manager.h"
+#include "config.h" // Project configuration constants
+
+void WifiManager::begin(const char *networkSsid, const char *networkPassword)
+{
+    ssid = networkSsid;
+    password = networkPassword;
+
+    WiFi.persistent(false);       // Credentials come from secrets.h, don't rewrite them in flash.
+    WiFi.setAutoReconnect(false); // Reconnection is handled here, not by the WiFi driver.
+    WiFi.mode(WIFI_STA);          // Set the ESP32 to station mode.
+
+    useApCache = loadWifiApCache(apCache);
+    backoff = WIFI_BACKOFF_MIN;
+    outageStart = millis();
+    startAttempt(outageStart);
+}
+
+void WifiManager::tick(unsigned long currentTime)
+{
+    bool linkUp = WiFi.status() == WL_CONNECTED;
+    switch (state)
+    {
+    case STATE_CONNECTED:
+        if (!linkUp)
+        {
+            Serial.println("WiFi lost connection. Reconnecting...");
+            outageStart = currentTime;
+            attempts = 0;
+            backoff = WIFI_BACKOFF_MIN;
+            startAttempt(currentTime); // Retry right away, back off only if that fails.
+        }
+        break;
+
+    case STATE_CONNECTING:
+        if (linkUp)
+        {
+            handleConnected(currentTime);
+        }
+        else if (currentTime - stateStart >= WIFI_CONNECT_TIMEOUT)
+        {
+            useApCache = false; // The access point may have moved, scan on the next attempt.
+            Serial.printf("WiFi connect attempt %lu failed. Retrying in %lus.\n", attempts, backoff / 1000);
+            state = STATE_BACKOFF;
+            stateStart = currentTime;
+        }
+        break;
+
+    case STATE_BACKOFF:
+        if (linkUp)
+        {
+            handleConnected(currentTime);
+        }
+        else if (currentTime - stateStart >= backoff)
+        {
+            backoff = backoff * 2 < WIFI_BACKOFF_MAX ? backoff * 2 : WIFI_BACKOFF_MAX;
+            startAttempt(currentTime);
+        }
+        break;
+    }
+}
+
+unsigned long WifiManager::outageDuration(unsigned long currentTime) const
+{
+    return state == STATE_CONNECTED ? 0 : currentTime - outageStart;
+}
+
+void WifiManager::startAttempt(unsigned long currentTime)
+{
+    WiFi.disconnect(); // Drop any half-open association.
+    // Returns immediately, the result shows up in WiFi.status().
+    if (useApCache)
+    {
+        WiFi.begin(ssid, password, apCache.channel, apCache.bssid);
+    }
+    else
+    {
+        WiFi.begin(ssid, password);
+    }
+    state = STATE_CONNECTING;
+    stateStart = currentTime;
+    attempts++;
+}
+
+void WifiManager::handleConnected(unsigned long currentTime)
+{
+    state = STATE_CONNECTED;
+    unsigned long outage = currentTime - outageStart;
+
+    // Remember the access point for a fast reconnect.
+    memcpy(apCache.bssid, WiFi.BSSID(), sizeof(apCache.bssid));
+    apCache.channel = WiFi.channel();
+    saveWifiApCache(apCache);
+    useApCache = true;
+
+    if (!everConnected)
+    {
+        everConnected = true;
+        Serial.printf("WiFi connected after %lu ms.\n", outage);
+        return;
+    }
+
+    lastOutage = outage;
+    minOutage = reconnects == 0 || outage < minOutage ? outage : minOutage;
+    maxOutage = outage > maxOutage ? outage : maxOutage;
+    totalOutage += outage;
+    reconnects++;
+    Serial.printf("WiFi reconnected after %lu ms (%lu attempts). Reconnects: %lu, avg %lu ms, max %lu ms\n",
+                  outage, attempts, reconnects, averageReconnectTime(), maxOutage);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "persist.h" // Cached access point
+#include <WiFi.h>      // WiFi connectivity
+
+//
+// Non-blocking WiFi reconnection state machine.
+//
+// tick() is called from every loop() iteration and only ever starts a
+// connection attempt; it never waits for one. A failed attempt is retried
+// after an exponentially growing backoff, so a missing access point costs
+// neither control-loop time nor a flood of association requests. Outage and
+// reconnect times are recorded for reporting.
+//
+// The BSSID and channel of the last access point are kept in NVS, so the
+// first attempt after a reboot or link loss skips the full channel scan.
+// If that attempt fails, the following ones scan normally.
+//
+class WifiManager
+{
+public:
+    // Starts connecting to the network. Returns immediately.
+    void begin(const char *ssid, const char *password);
+
+    // Advances the state machine. Must be called frequently from loop().
+    void tick(unsigned long currentTime);
+
+    bool connected() const { return state == STATE_CONNECTED; }
+
+    // Time (ms) since the link was lost (or since boot before the first connection), 0 while connected.
+    unsigned long outageDuration(unsigned long currentTime) const;
+
+    unsigned long reconnectCount() const { return reconnects; }
+    unsigned long lastReconnectTime() const { return lastOutage; }
+    unsigned long minReconnectTime() const { return minOutage; }
+    unsigned long maxReconnectTime() const { return maxOutage; }
+    unsigned long averageReconnectTime() const { return reconnects ? totalOutage / reconnects : 0; }
+
+private:
+    enum State
+    {
+        STATE_CONNECTING, // An attempt is in progress
+        STATE_BACKOFF,    // Waiting before the next attempt
+        STATE_CONNECTED
+    };
+
+    void startAttempt(unsigned long currentTime);
+    void handleConnected(unsigned long currentTime);
+
+    const char *ssid = "";
+    const char *password = "";
+
+    State state = STATE_CONNECTING;
+    bool everConnected = false;    // The first connection is not counted as a reconnect
+    bool useApCache = false;       // Connect straight to the cached access point
+    WifiApCache apCache = {};
+    unsigned long stateStart = 0;  // Start of the current attempt or backoff
+    unsigned long backoff = 0;     // Current backoff delay in ms
+    unsigned long outageStart = 0; // Time the link was lost
+    unsigned long attempts = 0;    // Attempts during the current outage
+
+    unsigned long reconnects = 0;  // Number of completed reconnects
+    unsigned long lastOutage = 0;  // Duration of the last outage in ms
+    unsigned long minOutage = 0;   // Shortest outage in ms
+    unsigned long maxOutage = 0;   // Longest outage in ms
+    unsigned long totalOutage = 0; // Sum of all outages in ms
+};
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Decodes a binary telemetry payload (TELEMETRY_BINARY) into the JSON layout.
+
+Usage: decode_telemetry.py <payload file>   (or the payload on stdin)
+"""
+
+import json
+import sys
+
+
+def decode(data):
+    position = 0
+
+    def varint():
+        nonlocal position
+        value = shift = 0
+        while True:
+            byte = data[position]
+            position += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if byte < 0x80:
+                return value
+
+    def zigzag():
+        value = varint()
+        return (value >> 1) ^ -(value & 1)
+
+    version = data[position]
+    position += 1
+    if version != 2:
+        raise ValueError("unsupported version %d" % version)
+    batch = {"uptime": varint(), "dropped": varint(), "samples": [], "events": []}
+    timestamp = varint()
+    count = varint()
+    power = states = 0
+    for _ in range(count):
+        tag = data[position]
+        position += 1
+        # Signed deltas, added modulo 2^32 like the millis() timestamps
+        timestamp = (timestamp + zigzag()) & 0xFFFFFFFF
+        if tag & 1:
+            channel = varint()
+            state = data[position]
+            position += 1
+            power += zigzag()
+            batch["events"].append([timestamp, channel, state, power])
+        else:
+            power += zigzag()
+            if tag & 2:
+                states = varint()
+            batch["samples"].append([timestamp, power, states])
+    return batch
+
+
+if __name__ == "__main__":
+    source = open(sys.argv[1], "rb") if len(sys.argv) > 1 else sys.stdin.buffer
+    print(json.dumps(decode(source.read())))
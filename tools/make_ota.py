@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Builds a firmware update package for the `update` console command and OTA_CHECK_INTERVAL checks.
+
+Usage: make_ota.py <new firmware.bin> <package.ota> [<running firmware.bin>]
+
+Without the running image a full package is written: the new image,
+zlib-compressed. With it, a delta package: copy and insert operations that
+rebuild the new image from the running one, zlib-compressed. A delta only
+applies to the exact image it was made from; the device checks its hash and
+refuses it otherwise. The layout is described in src/ota_patch.h.
+"""
+
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"EMOT"
+VERSION = 1
+TYPE_FULL = 0
+TYPE_DELTA = 1
+KEY_SIZE = 16    # Bytes hashed to find a match in the running image
+KEY_STRIDE = 4   # Running image positions indexed
+MIN_COPY = 24    # Shorter matches are inserted as literals
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def delta(base, image):
+    index = {}
+    for position in range(0, len(base) - KEY_SIZE + 1, KEY_STRIDE):
+        index.setdefault(base[position:position + KEY_SIZE], position)
+
+    ops = bytearray()
+    literal_start = 0
+    position = 0
+
+    def insert(end):
+        if end > literal_start:
+            ops.extend(b"I" + varint(end - literal_start) + image[literal_start:end])
+
+    while position + KEY_SIZE <= len(image):
+        source = index.get(image[position:position + KEY_SIZE])
+        if source is None:
+            position += 1
+            continue
+        # Extend the match forwards, then backwards into the pending literals.
+        length = KEY_SIZE
+        while position + length < len(image) and source + length < len(base) and \
+                image[position + length] == base[source + length]:
+            length += 1
+        start = position
+        while start > literal_start and source > 0 and image[start - 1] == base[source - 1]:
+            start -= 1
+            source -= 1
+        length += position - start
+        if length < MIN_COPY:
+            position += 1
+            continue
+        insert(start)
+        ops.extend(b"C" + varint(source) + varint(length))
+        position = start + length
+        literal_start = position
+    insert(len(image))
+    ops.extend(b"E")
+    return bytes(ops)
+
+
+def apply(base, ops):
+    """Rebuilds the image from the operations, to check the package before it is shipped."""
+    image = bytearray()
+    position = 0
+
+    def read():
+        nonlocal position
+        value = shift = 0
+        while True:
+            byte = ops[position]
+            position += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if byte < 0x80:
+                return value
+
+    while True:
+        op = ops[position:position + 1]
+        position += 1
+        if op == b"C":
+            offset = read()
+            length = read()
+            image.extend(base[offset:offset + length])
+        elif op == b"I":
+            length = read()
+            image.extend(ops[position:position + length])
+            position += length
+        elif op == b"E":
+            return bytes(image)
+        else:
+            raise ValueError("invalid operation")
+
+
+def package(image, base=None):
+    if base is None:
+        kind, payload, base_hash = TYPE_FULL, image, bytes(32)
+    else:
+        kind, payload, base_hash = TYPE_DELTA, delta(base, image), hashlib.sha256(base).digest()
+        assert apply(base, payload) == image
+    header = MAGIC + struct.pack("<BBHII", VERSION, kind, 0, len(image), len(base) if base else 0)
+    header += hashlib.sha256(image).digest() + base_hash
+    return header + zlib.compress(payload, 9)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (3, 4):
+        sys.exit(__doc__)
+    image = open(sys.argv[1], "rb").read()
+    base = open(sys.argv[3], "rb").read() if len(sys.argv) == 4 else None
+    data = package(image, base)
+    open(sys.argv[2], "wb").write(data)
+    print("%s package: %d bytes for a %d byte image (%.0f%%)" %
+          ("Delta" if base else "Full", len(data), len(image), 100.0 * len(data) / len(image)))